@@ -0,0 +1,174 @@
+#include "lyra.h"
+
+// Batch mode
+//
+// `lyra --batch <file|->` runs one command per line in this process. A line
+// is either the usual flags ("-i ripgrep <url>") or a word alias ("install
+// ripgrep <url>"); blank lines and lines starting with # are skipped. All
+// commands share one in-memory DB (see db_session_begin), written back once
+// at the end, or after every command with --commit-each. A failing line is
+// reported and the batch carries on.
+
+#define BATCH_MAX_ARGS 64
+
+static const char *batch_aliases[][2] = {
+    { "install", "-i" },
+    { "remove", "-rmpkg" },
+    { "purge", "-rmcpkg" },
+    { "mute", "-m" },
+    { "unmute", "-um" },
+    { "freeze", "-fc" },
+    { "restore", "-r" },
+    { "snapshot", "-ss" },
+    { "update", "-U" },
+    { "list", "-list" },
+    { "versions", "-lv" },
+    { "query", "-q" },
+};
+
+// Commands that tear down ~/.lyra or would nest a session
+static const char *batch_refused[] = { "-clean", "-uninstall", "--batch" };
+
+// Commands that may read an answer from stdin; with `--batch -` that would
+// swallow the next batch line. -fc and -r only prompt without a cached key.
+static const char *batch_prompting[] = { "-rsw", "-unlock", "-fc", "-r" };
+
+typedef struct {
+    int line;
+    char *text;
+} BatchFailure;
+
+// Split a line into words; '...' and "..." group words with spaces
+static int batch_split(char *line, char **args, int max_args) {
+    int count = 0;
+    char *p = line;
+
+    while (*p && count < max_args) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        char quote = 0;
+        if (*p == '\'' || *p == '"') quote = *p++;
+        args[count++] = p;
+
+        while (*p && (quote ? *p != quote : (*p != ' ' && *p != '\t'))) p++;
+        if (*p) *p++ = '\0';
+    }
+    return count;
+}
+
+static const char *batch_command(const char *word) {
+    for (size_t i = 0; i < sizeof(batch_aliases) / sizeof(batch_aliases[0]); i++) {
+        if (strcmp(word, batch_aliases[i][0]) == 0) return batch_aliases[i][1];
+    }
+    return word;
+}
+
+static int batch_refuses(const char *command) {
+    for (size_t i = 0; i < sizeof(batch_refused) / sizeof(batch_refused[0]); i++) {
+        if (strcmp(command, batch_refused[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int batch_prompts(const char *command) {
+    for (size_t i = 0; i < sizeof(batch_prompting) / sizeof(batch_prompting[0]); i++) {
+        if (strcmp(command, batch_prompting[i]) != 0) continue;
+        if (strcmp(command, "-fc") == 0 || strcmp(command, "-r") == 0) return vault_unlock_prompts();
+        return 1;
+    }
+    return 0;
+}
+
+int batch_run(char *path, int commit_each) {
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        printf("✗ Error: Could not open batch file %s\n", path);
+        return 1;
+    }
+
+    db_init();
+    db_session_begin();
+
+    BatchFailure *failures = NULL;
+    int failure_count = 0;
+    int command_count = 0;
+    int line_number = 0;
+    char line[4096];
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char text[4096];
+        snprintf(text, sizeof(text), "%s", line);
+
+        char *args[BATCH_MAX_ARGS + 2];  // "lyra", the words, NULL
+        args[0] = "lyra";
+        int argc = 1 + batch_split(line, &args[1], BATCH_MAX_ARGS);
+        if (argc == 1 || args[1][0] == '#') continue;
+        args[argc] = NULL;
+
+        // Allow lines copied from a shell script
+        if (strcmp(args[1], "lyra") == 0 || strcmp(args[1], "sudo") == 0) {
+            int skip = 1;
+            if (strcmp(args[1], "sudo") == 0 && argc > 2 && strcmp(args[2], "lyra") == 0) skip = 2;
+            // args[1 + skip] .. args[argc], the NULL included
+            memmove(&args[1], &args[1 + skip], (argc - skip) * sizeof(char *));
+            argc -= skip;
+            if (argc == 1) continue;
+        }
+        args[1] = (char *)batch_command(args[1]);
+
+        command_count++;
+        printf("\n━━ [%d] %s\n", line_number, text);
+
+        int status;
+        if (batch_refuses(args[1])) {
+            printf("✗ Error: %s cannot run inside --batch\n", args[1]);
+            status = 1;
+        } else if (fp == stdin && batch_prompts(args[1])) {
+            printf("✗ Error: %s would read its answer from the batch commands on stdin\n", args[1]);
+            printf("  Put the batch in a file%s\n",
+                   strcmp(args[1], "-fc") == 0 || strcmp(args[1], "-r") == 0 ? ", or run lyra -unlock first" : "");
+            status = 1;
+        } else {
+            status = lyra_command(argc, args);
+        }
+
+        if (commit_each && !db_session_flush()) status = 1;
+
+        if (status != 0) {
+            BatchFailure *grown = realloc(failures, (failure_count + 1) * sizeof(BatchFailure));
+            if (grown) {
+                failures = grown;
+                failures[failure_count].line = line_number;
+                failures[failure_count].text = strdup(text);
+                failure_count++;
+            }
+            printf("✗ Line %d failed\n", line_number);
+        }
+
+        fflush(stdout);
+    }
+
+    if (fp != stdin) fclose(fp);
+    int saved = db_session_end();
+
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    if (!saved) printf("✗ The package database could not be saved; the batch's changes are lost\n");
+    if (failure_count == 0) {
+        printf("%s Batch done: %d command%s\n", saved ? "✓" : "✗", command_count,
+               command_count == 1 ? "" : "s");
+    } else {
+        printf("✗ Batch done: %d of %d command%s failed\n", failure_count, command_count,
+               command_count == 1 ? "" : "s");
+        for (int i = 0; i < failure_count; i++) {
+            printf("  line %d: %s\n", failures[i].line, failures[i].text ? failures[i].text : "");
+            free(failures[i].text);
+        }
+    }
+    free(failures);
+
+    return failure_count > 0 || !saved ? 1 : 0;
+}
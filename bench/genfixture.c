@@ -0,0 +1,319 @@
+// Synthetic ~/.lyra trees for bench/run.sh
+//
+//   genfixture home <dir> <packages> <history> <snapshots> <vault_limit> <url_base>
+//   genfixture restore-point <snapshot_in> <snapshot_out> [package@version ...]
+//
+// "home" writes <dir>/.lyra with an active_packages.json of <packages>
+// packages named bench-00000.. whose muted history runs from 0 to <history>
+// versions, raw vault copies of the muted versions of the first
+// <vault_limit> packages, and <snapshots> snapshots of the whole DB. The
+// same arguments always give the same bytes.
+//
+// "restore-point" turns a snapshot taken by lyra -ss into one -rsw can
+// replay without touching the network: bench-* packages lose their url (so
+// they plan as unavailable) and each package@version is set back to that
+// version.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <cjson/cJSON.h>
+
+#define VAULT_COPY_BYTES 4096
+
+// Fixed dates so the output never depends on when it was generated
+#define FIXTURE_EPOCH 978307200 // 2001-01-01T00:00:00Z
+
+static int make_dirs(const char *path) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char *p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(buf, 0755) != 0 && errno != EEXIST) return 0;
+        *p = '/';
+    }
+    return mkdir(buf, 0755) == 0 || errno == EEXIST;
+}
+
+static int write_json(const char *path, cJSON *root) {
+    char *json_str = cJSON_Print(root);
+    if (!json_str) return 0;
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        free(json_str);
+        return 0;
+    }
+    fputs(json_str, fp);
+    fclose(fp);
+    free(json_str);
+    return 1;
+}
+
+static void fixture_date(long offset_seconds, char *out, size_t size) {
+    time_t t = FIXTURE_EPOCH + offset_seconds;
+    strftime(out, size, "%Y-%m-%dT%H:%M:%S", gmtime(&t));
+}
+
+// Stand-in for a SHA-256; -list only prints it
+static void fixture_hash(int package, int version, char *out) {
+    unsigned long long x = (unsigned long long)package * 1000003ULL + (unsigned long long)version + 1;
+    for (int i = 0; i < 64; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        out[i] = "0123456789abcdef"[x & 15];
+    }
+    out[64] = '\0';
+}
+
+static void fixture_url(const char *url_base, const char *name, const char *version, char *out, size_t size) {
+    snprintf(out, size, "%s/mirror/%s/releases/download/v%s/%s-%s-linux-x86_64.tar.gz",
+             url_base, name, version, name, version);
+}
+
+static int write_vault_copy(const char *lyra_dir, const char *name, const char *version, int seed) {
+    char dir[1200];
+    char path[1300];
+    snprintf(dir, sizeof(dir), "%s/vault/%s/%s", lyra_dir, name, version);
+    if (!make_dirs(dir)) return 0;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) return 0;
+    fprintf(fp, "#!/bin/sh\necho %s %s\n", name, version);
+    unsigned int x = (unsigned int)seed * 2654435761u + 1;
+    for (long i = ftell(fp); i < VAULT_COPY_BYTES; i++) {
+        x = x * 1103515245u + 12345u;
+        fputc('#' + (x >> 16) % 64, fp);
+    }
+    fclose(fp);
+    chmod(path, 0755);
+    return 1;
+}
+
+static cJSON* build_db(const char *lyra_dir, int packages, int history, int vault_limit, const char *url_base) {
+    cJSON *root = cJSON_CreateObject();
+
+    for (int i = 0; i < packages; i++) {
+        char name[32];
+        char version[32];
+        char url[512];
+        char hash[65];
+        char date[32];
+        char path[64];
+        snprintf(name, sizeof(name), "bench-%05d", i);
+
+        int muted = history > 0 ? i % (history + 1) : 0;
+        snprintf(version, sizeof(version), "1.%d.0", muted);
+
+        cJSON *pkg = cJSON_CreateObject();
+        cJSON_AddStringToObject(pkg, "version", version);
+        fixture_url(url_base, name, version, url, sizeof(url));
+        cJSON_AddStringToObject(pkg, "url", url);
+        fixture_hash(i, muted, hash);
+        cJSON_AddStringToObject(pkg, "sha256", hash);
+        cJSON_AddStringToObject(pkg, "source", "mirror");
+        snprintf(path, sizeof(path), "/usr/local/bin/%s", name);
+        cJSON_AddStringToObject(pkg, "installed_path", path);
+        cJSON_AddStringToObject(pkg, "status", "active");
+        fixture_date((long)i * 60 + muted * 86400L, date, sizeof(date));
+        cJSON_AddStringToObject(pkg, "installed_date", date);
+        cJSON_AddNumberToObject(pkg, "vault_bytes", 0);
+
+        int vaulted = i < vault_limit;
+        cJSON *versions = cJSON_CreateArray();
+        for (int k = 0; k < muted; k++) {
+            char old_version[32];
+            snprintf(old_version, sizeof(old_version), "1.%d.0", k);
+
+            cJSON *ver = cJSON_CreateObject();
+            cJSON_AddStringToObject(ver, "version", old_version);
+            fixture_url(url_base, name, old_version, url, sizeof(url));
+            cJSON_AddStringToObject(ver, "url", url);
+            cJSON_AddStringToObject(ver, "status", "muted");
+            fixture_hash(i, k, hash);
+            cJSON_AddStringToObject(ver, "sha256", hash);
+            fixture_date((long)i * 60 + k * 86400L, date, sizeof(date));
+            cJSON_AddStringToObject(ver, "installed_date", date);
+            fixture_date((long)i * 60 + (k + 1) * 86400L, date, sizeof(date));
+            cJSON_AddStringToObject(ver, "last_active", date);
+
+            if (vaulted && !write_vault_copy(lyra_dir, name, old_version, i * 64 + k)) {
+                fprintf(stderr, "Error: Could not write vault copy for %s %s\n", name, old_version);
+                cJSON_Delete(versions);
+                cJSON_Delete(pkg);
+                cJSON_Delete(root);
+                return NULL;
+            }
+            cJSON_AddNumberToObject(ver, "vault_bytes", vaulted ? VAULT_COPY_BYTES : 0);
+            cJSON_AddItemToArray(versions, ver);
+        }
+        cJSON_AddItemToObject(pkg, "versions", versions);
+
+        cJSON_AddItemToObject(root, name, pkg);
+    }
+
+    return root;
+}
+
+// Same layout take_snapshot writes
+static cJSON* build_snapshot(cJSON *db, int number) {
+    char timestamp[32];
+    char date[32];
+    time_t t = FIXTURE_EPOCH + (time_t)number * 86400;
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", gmtime(&t));
+    strftime(date, sizeof(date), "%d-%m-%Y", gmtime(&t));
+
+    cJSON *snapshot = cJSON_CreateObject();
+    cJSON_AddStringToObject(snapshot, "timestamp", timestamp);
+    cJSON_AddStringToObject(snapshot, "date", date);
+    cJSON_AddNumberToObject(snapshot, "snapshotNumber", 1);
+
+    cJSON *packages = cJSON_CreateObject();
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, db) {
+        cJSON *entry = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry, "version", cJSON_GetObjectItem(pkg, "version")->valuestring);
+        cJSON_AddStringToObject(entry, "status", "active");
+        cJSON_AddStringToObject(entry, "installPath", cJSON_GetObjectItem(pkg, "installed_path")->valuestring);
+        cJSON_AddStringToObject(entry, "url", cJSON_GetObjectItem(pkg, "url")->valuestring);
+
+        cJSON *muted = cJSON_CreateArray();
+        cJSON *ver = NULL;
+        cJSON_ArrayForEach(ver, cJSON_GetObjectItem(pkg, "versions")) {
+            cJSON_AddItemToArray(muted, cJSON_CreateString(cJSON_GetObjectItem(ver, "version")->valuestring));
+        }
+        cJSON_AddItemToObject(entry, "mutedVersions", muted);
+        cJSON_AddItemToObject(packages, pkg->string, entry);
+    }
+    cJSON_AddItemToObject(snapshot, "packages", packages);
+    return snapshot;
+}
+
+static int generate_home(char *argv[]) {
+    const char *home = argv[2];
+    int packages = atoi(argv[3]);
+    int history = atoi(argv[4]);
+    int snapshots = atoi(argv[5]);
+    int vault_limit = atoi(argv[6]);
+    const char *url_base = argv[7];
+
+    char lyra_dir[1024];
+    char path[1200];
+    snprintf(lyra_dir, sizeof(lyra_dir), "%s/.lyra", home);
+
+    snprintf(path, sizeof(path), "%s/vault/snapshots", lyra_dir);
+    if (!make_dirs(path)) {
+        fprintf(stderr, "Error: Could not create %s\n", path);
+        return 1;
+    }
+
+    cJSON *db = build_db(lyra_dir, packages, history, vault_limit, url_base);
+    if (!db) return 1;
+
+    snprintf(path, sizeof(path), "%s/active_packages.json", lyra_dir);
+    if (!write_json(path, db)) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        cJSON_Delete(db);
+        return 1;
+    }
+
+    for (int s = 0; s < snapshots; s++) {
+        cJSON *snapshot = build_snapshot(db, s);
+        snprintf(path, sizeof(path), "%s/vault/snapshots/%s_1.json", lyra_dir,
+                 cJSON_GetObjectItem(snapshot, "date")->valuestring);
+        int ok = write_json(path, snapshot);
+        cJSON_Delete(snapshot);
+        if (!ok) {
+            fprintf(stderr, "Error: Could not write %s\n", path);
+            cJSON_Delete(db);
+            return 1;
+        }
+    }
+
+    cJSON_Delete(db);
+    return 0;
+}
+
+static int generate_restore_point(int argc, char *argv[]) {
+    FILE *fp = fopen(argv[2], "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open %s\n", argv[2]);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(size + 1);
+    size_t got = data ? fread(data, 1, size, fp) : 0;
+    fclose(fp);
+    if (!data || got != (size_t)size) {
+        fprintf(stderr, "Error: Could not read %s\n", argv[2]);
+        free(data);
+        return 1;
+    }
+    data[size] = '\0';
+
+    cJSON *snapshot = cJSON_Parse(data);
+    free(data);
+    cJSON *packages = cJSON_GetObjectItem(snapshot, "packages");
+    if (!packages) {
+        fprintf(stderr, "Error: %s is not a snapshot\n", argv[2]);
+        cJSON_Delete(snapshot);
+        return 1;
+    }
+
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, packages) {
+        if (strncmp(pkg->string, "bench-", 6) == 0) {
+            cJSON_DeleteItemFromObject(pkg, "url");
+        }
+    }
+
+    for (int i = 4; i < argc; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "%s", argv[i]);
+        char *version = strchr(name, '@');
+        if (!version) {
+            fprintf(stderr, "Error: Use package@version, got %s\n", argv[i]);
+            cJSON_Delete(snapshot);
+            return 1;
+        }
+        *version++ = '\0';
+
+        pkg = cJSON_GetObjectItem(packages, name);
+        if (!pkg) {
+            fprintf(stderr, "Error: %s is not in the snapshot\n", name);
+            cJSON_Delete(snapshot);
+            return 1;
+        }
+        cJSON_DeleteItemFromObject(pkg, "version");
+        cJSON_AddStringToObject(pkg, "version", version);
+    }
+
+    int ok = write_json(argv[3], snapshot);
+    cJSON_Delete(snapshot);
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write %s\n", argv[3]);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 8 && strcmp(argv[1], "home") == 0) {
+        return generate_home(argv);
+    }
+    if (argc >= 4 && strcmp(argv[1], "restore-point") == 0) {
+        return generate_restore_point(argc, argv);
+    }
+
+    fprintf(stderr, "Usage: genfixture home <dir> <packages> <history> <snapshots> <vault_limit> <url_base>\n");
+    fprintf(stderr, "       genfixture restore-point <snapshot_in> <snapshot_out> [package@version ...]\n");
+    return 2;
+}
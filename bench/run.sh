@@ -0,0 +1,258 @@
+#!/bin/bash
+# Scale benchmarks: the everyday commands against synthetic DBs of 100 to
+# 50k packages, with release tarballs and a stand-in GitHub API served from
+# a local HTTP server. Prints the median wall time and external process
+# count of each command and writes them as TSV so a later run can be
+# compared against it.
+#
+#   sudo bench/run.sh [--lyra path] [--sizes "100 1000 10000 50000"]
+#                     [--history N] [--runs N] [--out file] [--baseline file]
+#
+# --history is the deepest muted history; package i has i % (N + 1) muted
+# versions. Needs root (lyrabench-* test packages go into /usr/local/bin and
+# are removed at the end), python3 for the HTTP server, and cJSON to build
+# bench/genfixture.c (set CC, CFLAGS, LDFLAGS or GENFIXTURE_LIBS to build it
+# elsewhere). Everything else lives under a throwaway HOME.
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+LYRA=./lyra
+SIZES="100 1000 10000 50000"
+HISTORY=4
+RUNS=5
+SNAPSHOTS=5
+VAULT_LIMIT=1000
+OUT=""
+BASELINE=""
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --lyra) LYRA=$2; shift ;;
+        --sizes) SIZES=$2; shift ;;
+        --history) HISTORY=$2; shift ;;
+        --runs) RUNS=$2; shift ;;
+        --out) OUT=$2; shift ;;
+        --baseline) BASELINE=$2; shift ;;
+        *)
+            echo "Usage: bench/run.sh [--lyra path] [--sizes \"100 1000\"] [--history N] [--runs N] [--out file] [--baseline file]"
+            exit 1
+            ;;
+    esac
+    shift
+done
+
+if [ "$(id -u)" -ne 0 ]; then
+    echo "Error: bench/run.sh installs test packages into /usr/local/bin, run it with sudo"
+    exit 1
+fi
+if [ ! -x "$LYRA" ]; then
+    echo "Error: $LYRA is not executable (build lyra first)"
+    exit 1
+fi
+if [ -n "$BASELINE" ] && [ ! -f "$BASELINE" ]; then
+    echo "Error: Baseline $BASELINE not found"
+    exit 1
+fi
+for tool in python3 curl tar sha256sum; do
+    if ! command -v $tool >/dev/null 2>&1; then
+        echo "Error: bench/run.sh needs $tool"
+        exit 1
+    fi
+done
+LYRA=$(realpath "$LYRA")
+
+GENFIXTURE=$BENCH_DIR/genfixture
+echo "[*] Building genfixture..."
+${CC:-gcc} -O2 $CFLAGS "$BENCH_DIR/genfixture.c" -o "$GENFIXTURE" $LDFLAGS ${GENFIXTURE_LIBS:--lcjson} || exit 1
+
+WORK=$(mktemp -d)
+SERVER_PID=""
+cleanup() {
+    [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null
+    rm -f /usr/local/bin/lyrabench-*
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# lyrabench-0 gets two versions for mute/unmute and -rsw, the rest are
+# installed once each by the install runs
+PORT=$(python3 -c 'import socket; s = socket.socket(); s.bind(("127.0.0.1", 0)); print(s.getsockname()[1])')
+BASE_URL=http://127.0.0.1:$PORT
+SRV=$WORK/srv
+
+release_url() {
+    echo "$BASE_URL/github.com/lyrabench/$1/releases/download/v$2/$1-$2-linux-x86_64.tar.gz"
+}
+
+make_release() {
+    local name=$1 version=$2
+    local dir=$SRV/github.com/lyrabench/$name/releases/download/v$version
+    local asset=$name-$version-linux-x86_64.tar.gz
+    local stage=$WORK/stage/$name-$version
+
+    # A real ELF of a realistic size; the trailer keeps versions distinct
+    mkdir -p "$dir" "$stage"
+    { cat "$LYRA"; echo "$name $version"; } > "$stage/$name"
+    chmod 755 "$stage/$name"
+    tar -czf "$dir/$asset" -C "$WORK/stage" "$name-$version"
+    (cd "$dir" && sha256sum "$asset" > "$asset.sha256")
+
+    mkdir -p "$SRV/repos/lyrabench/$name/releases"
+    cat > "$SRV/repos/lyrabench/$name/releases/latest" <<EOF
+{
+  "tag_name": "v$version",
+  "assets": [
+    {
+      "browser_download_url": "$(release_url "$name" "$version")"
+    }
+  ]
+}
+EOF
+}
+
+echo "[*] Building release tarballs..."
+make_release lyrabench-0 1.0.0
+make_release lyrabench-0 1.1.0
+for ((r = 1; r <= RUNS; r++)); do
+    make_release lyrabench-$r 1.0.0
+done
+
+python3 -m http.server "$PORT" --bind 127.0.0.1 --directory "$SRV" >"$WORK/http.log" 2>&1 &
+SERVER_PID=$!
+for ((i = 0; i < 50; i++)); do
+    curl -fs "$BASE_URL/repos/lyrabench/lyrabench-0/releases/latest" >/dev/null && break
+    sleep 0.1
+done
+
+export LYRA_NO_DAEMON=1
+export LYRA_DEBUG_SPAWNS=1
+export LYRA_GITHUB_API=$BASE_URL
+unset SUDO_USER
+
+[ -z "$OUT" ] && OUT=$BENCH_DIR/results/$(date +%Y%m%d-%H%M%S).tsv
+mkdir -p "$(dirname "$OUT")"
+{
+    echo "# lyra bench $(git -C "$BENCH_DIR/.." rev-parse --short HEAD 2>/dev/null || echo unknown)"
+    echo "# runs=$RUNS history=$HISTORY snapshots=$SNAPSHOTS vault_limit=$VAULT_LIMIT nproc=$(nproc)"
+    printf "size\thistory\tcommand\truns\tmedian_ms\tmin_ms\tmax_ms\tspawns\n"
+} > "$OUT"
+
+printf "\n%-8s %-12s %6s %12s %10s %10s %7s %10s\n" "Size" "Command" "Runs" "Median (ms)" "Min" "Max" "Spawns" "vs base"
+printf "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n"
+
+SAMPLES=()
+SPAWNS=()
+FAILED=0
+
+now_us() {
+    echo "${EPOCHREALTIME/./}"
+}
+
+# sample <stdin> <args...>: time one lyra run, output to the log
+sample() {
+    local input=$1
+    shift
+    local start end
+    start=$(now_us)
+    printf "%s" "$input" | "$LYRA" "$@" >>"$WORK/lyra.log" 2>"$WORK/stderr"
+    local status=$?
+    end=$(now_us)
+    cat "$WORK/stderr" >> "$WORK/lyra.log"
+    SPAWNS+=($(awk '/^lyra: [0-9]+ external process/ { n = $2 } END { print n + 0 }' "$WORK/stderr"))
+    if [ $status -ne 0 ]; then
+        echo "  ✗ lyra $* exited $status (see below)"
+        tail -n 5 "$WORK/lyra.log"
+        FAILED=1
+    fi
+    SAMPLES+=($((end - start)))
+}
+
+# report <size> <command>: print and record the samples taken since the last report
+report() {
+    local size=$1 command=$2
+    local stats
+    stats=$(printf "%s\n" "${SAMPLES[@]}" | sort -n | awk '
+        { v[NR] = $1 }
+        END {
+            median = NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2
+            printf "%d\t%.2f\t%.2f\t%.2f", NR, median / 1000, v[1] / 1000, v[NR] / 1000
+        }')
+    local spawns
+    spawns=$(printf "%s\n" "${SPAWNS[@]}" | sort -n | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }')
+    SAMPLES=()
+    SPAWNS=()
+    printf "%s\t%s\t%s\t%s\t%s\n" "$size" "$HISTORY" "$command" "$stats" "$spawns" >> "$OUT"
+
+    local median=$(echo "$stats" | cut -f2)
+    local delta=""
+    if [ -n "$BASELINE" ]; then
+        delta=$(awk -F'\t' -v s="$size" -v h="$HISTORY" -v c="$command" -v m="$median" '
+            $1 == s && $2 == h && $3 == c && $5 > 0 { printf "%+.1f%%", (m - $5) / $5 * 100 }' "$BASELINE")
+        [ -z "$delta" ] && delta="n/a"
+    fi
+    printf "%-8s %-12s %6s %12s %10s %10s %7s %10s\n" "$size" "$command" \
+        "$(echo "$stats" | cut -f1)" "$median" "$(echo "$stats" | cut -f3)" "$(echo "$stats" | cut -f4)" \
+        "$spawns" "$delta"
+}
+
+for size in $SIZES; do
+    HOME=$WORK/home-$size
+    export HOME
+    rm -f /usr/local/bin/lyrabench-*
+
+    "$GENFIXTURE" home "$HOME" "$size" "$HISTORY" "$SNAPSHOTS" "$VAULT_LIMIT" "$BASE_URL" || exit 1
+    DB=$HOME/.lyra/active_packages.json
+
+    # First runs create the layout and the snapshot catalog
+    "$LYRA" -list >/dev/null 2>&1
+    "$LYRA" -ssl >/dev/null 2>&1
+
+    for ((r = 0; r < RUNS; r++)); do sample "" -list; done
+    report "$size" "-list"
+
+    for ((r = 0; r < RUNS; r++)); do sample "" -lv bench-$(printf %05d $((size / 2))); done
+    report "$size" "-lv"
+
+    for ((r = 0; r < RUNS; r++)); do sample "" -ssl; done
+    report "$size" "-ssl"
+
+    "$LYRA" -i lyrabench-0 "$(release_url lyrabench-0 1.0.0)" >>"$WORK/lyra.log" 2>&1
+    "$LYRA" -i lyrabench-0 "$(release_url lyrabench-0 1.1.0)" >>"$WORK/lyra.log" 2>&1
+
+    for ((r = 1; r <= RUNS; r++)); do sample "" -i lyrabench-$r "$(release_url lyrabench-$r 1.0.0)"; done
+    report "$size" "install"
+
+    # Each -m and -um swaps lyrabench-0 between its two versions, so the
+    # pairs end where they started
+    for ((r = 0; r < RUNS; r++)); do
+        sample "" -m lyrabench-0
+        sample "" -um lyrabench-0
+    done
+    report "$size" "mute/unmute"
+
+    for ((r = 0; r < RUNS; r++)); do sample "" -U; done
+    report "$size" "-U"
+
+    for ((r = 0; r < RUNS; r++)); do sample "" -ss; done
+    report "$size" "-ss"
+
+    # Replay the last snapshot with lyrabench-0 set back to 1.0.0 (a vault
+    # restore); the bench-* packages plan as unavailable rather than downloading
+    last=$(ls -t "$HOME/.lyra/vault/snapshots/"*_*.json | head -n 1)
+    "$GENFIXTURE" restore-point "$last" "$HOME/.lyra/vault/snapshots/01-01-2000_1.json" lyrabench-0@1.0.0 || exit 1
+    cp "$DB" "$WORK/db.before-rsw"
+    for ((r = 0; r < RUNS; r++)); do
+        cp "$WORK/db.before-rsw" "$DB"
+        sample "y
+" -rsw 01-01-2000 1
+    done
+    report "$size" "-rsw"
+
+    rm -rf "$HOME"
+done
+
+echo
+echo "Results written to $OUT"
+if [ $FAILED -ne 0 ]; then
+    echo "✗ Some commands failed; their timings are not comparable"
+    exit 1
+fi
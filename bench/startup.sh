@@ -0,0 +1,66 @@
+#!/bin/bash
+# Startup cost per command: wall time per invocation and, when strace is
+# available, syscall count per invocation.
+#
+#   bench/startup.sh [path/to/lyra] [runs]
+#
+# Runs against a throwaway HOME so it never touches the real ~/.lyra. The
+# read-only commands don't set up the layout at all. -unlock (with the key
+# agent off) is the cheapest command that goes through db_init(), so it runs
+# twice: with the layout marker in place (the fast path), and "cold", with
+# the marker removed before every run so the full setup runs each time.
+# -unlock needs root (it would stop in ensure_sudo first), so without it
+# those two rows are skipped.
+
+LYRA=${1:-./lyra}
+RUNS=${2:-200}
+
+if [ ! -x "$LYRA" ]; then
+    echo "Error: $LYRA is not executable (build lyra first)"
+    exit 1
+fi
+LYRA=$(realpath "$LYRA")
+
+BENCH_HOME=$(mktemp -d)
+trap 'rm -rf "$BENCH_HOME"' EXIT
+export HOME=$BENCH_HOME
+unset SUDO_USER
+
+COMMANDS=("-list" "-lv lyra" "-fl" "-ssl" "du" "--help")
+if [ "$(id -u)" -eq 0 ]; then
+    # Creates the layout and the marker for the warm -unlock rows
+    "$LYRA" -unlock >/dev/null 2>&1
+    COMMANDS+=("-unlock" "-unlock cold")
+else
+    echo "Note: not root, skipping the -unlock (db_init) rows; run with sudo to include them"
+fi
+
+printf "%-14s %12s %12s\n" "Command" "Wall (ms)" "Syscalls"
+printf "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n"
+
+for label in "${COMMANDS[@]}"; do
+    cmd=${label% cold}
+    cold=0
+    [ "$cmd" != "$label" ] && cold=1
+
+    # Only the lyra run itself is timed, not removing the marker
+    total_us=0
+    for ((i = 0; i < RUNS; i++)); do
+        [ $cold -eq 1 ] && rm -f "$BENCH_HOME"/.lyra/.layout-v*
+        start=${EPOCHREALTIME/./}
+        "$LYRA" $cmd >/dev/null 2>&1
+        end=${EPOCHREALTIME/./}
+        total_us=$((total_us + end - start))
+    done
+    wall=$(awk -v us="$total_us" -v n="$RUNS" 'BEGIN { printf "%.3f", us / n / 1e3 }')
+
+    syscalls="n/a"
+    if command -v strace >/dev/null 2>&1; then
+        [ $cold -eq 1 ] && rm -f "$BENCH_HOME"/.lyra/.layout-v*
+        strace -f -c -o "$BENCH_HOME/strace.out" "$LYRA" $cmd >/dev/null 2>&1
+        syscalls=$(awk '$NF == "total" { print $4 }' "$BENCH_HOME/strace.out")
+        [ -z "$syscalls" ] && syscalls="n/a"
+    fi
+
+    printf "%-14s %12s %12s\n" "$label" "$wall" "$syscalls"
+done
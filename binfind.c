@@ -0,0 +1,204 @@
+#include "lyra.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <strings.h>
+
+// Binary discovery
+//
+// Release archives often carry more than one executable: completion
+// scripts, helper tools, builds for other architectures. Every executable
+// under the extract dir is ranked by what it is (an ELF for this machine
+// beats a script), how close its name is to the package, whether it sits in
+// a bin/ dir, and size. The walk stops at the first ELF for this machine
+// whose name is exactly the package's.
+
+#if defined(__x86_64__)
+#define BINARY_HOST_MACHINE EM_X86_64
+#elif defined(__aarch64__)
+#define BINARY_HOST_MACHINE EM_AARCH64
+#elif defined(__i386__)
+#define BINARY_HOST_MACHINE EM_386
+#elif defined(__arm__)
+#define BINARY_HOST_MACHINE EM_ARM
+#elif defined(__riscv)
+#define BINARY_HOST_MACHINE EM_RISCV
+#elif defined(__powerpc64__)
+#define BINARY_HOST_MACHINE EM_PPC64
+#else
+#define BINARY_HOST_MACHINE EM_NONE  // unknown host, take any machine
+#endif
+
+#define BINARY_SCORE_ELF 400
+#define BINARY_SCORE_SCRIPT 100
+#define BINARY_SCORE_EXACT_NAME 200
+#define BINARY_SCORE_NAME_CASE 150
+#define BINARY_SCORE_NAME_PREFIX 100
+#define BINARY_SCORE_BIN_DIR 20
+#define BINARY_SCORE_LIBRARY -300
+
+typedef struct {
+    const char *name;
+    int exact_only;
+    char *path_out;
+    size_t size;
+    int best_score;
+    off_t best_size;
+    int rejected_machine;  // ELFs built for another architecture
+} BinarySearch;
+
+enum { BINARY_OTHER, BINARY_SCRIPT, BINARY_ELF, BINARY_FOREIGN_ELF };
+
+static int binary_kind(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return BINARY_OTHER;
+
+    unsigned char header[EI_NIDENT + 4];
+    ssize_t n = read(fd, header, sizeof(header));
+    close(fd);
+
+    if (n >= 2 && header[0] == '#' && header[1] == '!') return BINARY_SCRIPT;
+    if (n < (ssize_t)sizeof(header) || memcmp(header, ELFMAG, SELFMAG) != 0) return BINARY_OTHER;
+
+    // e_type and e_machine follow e_ident in both ELF classes
+    int big_endian = header[EI_DATA] == ELFDATA2MSB;
+    unsigned char *type = header + EI_NIDENT;
+    int e_type = big_endian ? (type[0] << 8 | type[1]) : (type[1] << 8 | type[0]);
+    int e_machine = big_endian ? (type[2] << 8 | type[3]) : (type[3] << 8 | type[2]);
+
+    if (e_type != ET_EXEC && e_type != ET_DYN) return BINARY_OTHER;
+    if (BINARY_HOST_MACHINE != EM_NONE && e_machine != BINARY_HOST_MACHINE) return BINARY_FOREIGN_ELF;
+    return BINARY_ELF;
+}
+
+static int binary_name_score(const char *base, const char *name) {
+    size_t len = strlen(name);
+    if (strcmp(base, name) == 0) return BINARY_SCORE_EXACT_NAME;
+    if (strcasecmp(base, name) == 0) return BINARY_SCORE_NAME_CASE;
+
+    // rg-x86_64, fd.bin and the like
+    if (strncasecmp(base, name, len) == 0 && base[len] && strchr("-_.", base[len])) return BINARY_SCORE_NAME_PREFIX;
+    return 0;
+}
+
+static int binary_consider(const char *path, const struct stat *st, void *ctx) {
+    BinarySearch *search = ctx;
+    if (!(st->st_mode & 0111)) return 0;
+
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    int name_score = binary_name_score(base, search->name);
+    if (search->exact_only && name_score != BINARY_SCORE_EXACT_NAME) return 0;
+
+    int kind = binary_kind(path);
+    if (kind == BINARY_FOREIGN_ELF) {
+        search->rejected_machine++;
+        return 0;
+    }
+
+    int score = name_score;
+    if (kind == BINARY_ELF) score += BINARY_SCORE_ELF;
+    if (kind == BINARY_SCRIPT) score += BINARY_SCORE_SCRIPT;
+    const char *so = strstr(base, ".so");
+    if (so && (so[3] == '\0' || so[3] == '.')) score += BINARY_SCORE_LIBRARY;
+    if (base - path >= 5 && strncmp(base - 5, "/bin/", 5) == 0) score += BINARY_SCORE_BIN_DIR;
+
+    // Bigger wins a tie: the real tool over a small launcher
+    if (score > search->best_score || (score == search->best_score && st->st_size > search->best_size)) {
+        snprintf(search->path_out, search->size, "%s", path);
+        search->best_score = score;
+        search->best_size = st->st_size;
+    }
+
+    return kind == BINARY_ELF && name_score == BINARY_SCORE_EXACT_NAME;
+}
+
+// Best executable under dir for name. With exact_only, only files called
+// exactly name count (extra binaries of a package). Returns 1 if one was found.
+int binary_find(const char *dir, const char *name, int exact_only, char *path_out, size_t size) {
+    BinarySearch search = { name, exact_only, path_out, size, INT_MIN, -1, 0 };
+    fs_walk(dir, binary_consider, &search);
+
+    if (search.best_score == INT_MIN) {
+        if (search.rejected_machine > 0) {
+            printf("Error: The archive's binaries are built for another architecture\n");
+        }
+        return 0;
+    }
+    return 1;
+}
+
+// Check a --bin list: comma-separated file names, none of them the package itself
+int binary_list_valid(char *package_name, char *binaries) {
+    char copy[1024];
+    snprintf(copy, sizeof(copy), "%s", binaries);
+
+    int count = 0;
+    char *save = NULL;
+    for (char *name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        if (strchr(name, '/') || strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+            strcmp(name, package_name) == 0) {
+            return 0;
+        }
+        count++;
+    }
+    return count > 0 && count <= LYRA_MAX_BINARIES;
+}
+
+typedef struct {
+    char (*names)[256];
+    int name_count;
+    CompanionFile *out;
+    int max;
+    int count;
+} CompanionSearch;
+
+static void companion_add(CompanionSearch *search, const char *path, const char *dest) {
+    for (int i = 0; i < search->count; i++) {
+        if (strcmp(search->out[i].dest, dest) == 0) return;
+    }
+    if (search->count == search->max) return;
+    snprintf(search->out[search->count].source, sizeof(search->out[0].source), "%s", path);
+    snprintf(search->out[search->count].dest, sizeof(search->out[0].dest), "%s", dest);
+    search->count++;
+}
+
+static int companion_consider(const char *path, const struct stat *st, void *ctx) {
+    (void)st;
+    CompanionSearch *search = ctx;
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    char dest[512];
+    for (int i = 0; i < search->name_count; i++) {
+        const char *name = search->names[i];
+        size_t len = strlen(name);
+
+        if (base[0] == '_' && strcmp(base + 1, name) == 0) {
+            snprintf(dest, sizeof(dest), "%s/%s", LYRA_ZSH_COMPLETION_DIR, base);
+        } else if (strncmp(base, name, len) != 0 || base[len] != '.') {
+            continue;
+        } else if (strcmp(base + len, ".bash") == 0) {
+            snprintf(dest, sizeof(dest), "%s/%s", LYRA_BASH_COMPLETION_DIR, name);
+        } else if (strcmp(base + len, ".fish") == 0) {
+            snprintf(dest, sizeof(dest), "%s/%s", LYRA_FISH_COMPLETION_DIR, base);
+        } else if (base[len + 1] >= '1' && base[len + 1] <= '8' &&
+                   (base[len + 2] == '\0' || strcmp(base + len + 2, ".gz") == 0)) {
+            snprintf(dest, sizeof(dest), "%s/man%c/%s", LYRA_MAN_DIR, base[len + 1], base);
+        } else {
+            continue;
+        }
+        companion_add(search, path, dest);
+    }
+    return 0;
+}
+
+// Man pages and shell completions for the given executables: <name>.1 to
+// <name>.8 (optionally .gz), <name>.bash, _<name> and <name>.fish. Returns
+// how many were found, each with the path it installs to.
+int companion_find(const char *dir, char names[][256], int name_count, CompanionFile *out, int max) {
+    CompanionSearch search = { names, name_count, out, max, 0 };
+    fs_walk(dir, companion_consider, &search);
+    return search.count;
+}
@@ -27,14 +27,19 @@ fi
 
 # Compile lyra.c
 echo "[*] Compiling lyra..."
-gcc lyra.c -o lyra -lcjson
+gcc lyra.c catalog.c hash.c pool.c crypto.c vaultkey.c config.c freeze.c chunkstore.c verify.c gc.c vaultcopy.c du.c batch.c daemon.c output.c trace.c metrics.c fsutil.c binfind.c manifest.c bundle.c -o lyra -lcjson -lcrypto -lzstd -lpthread
+
+echo "[*] Compiling lyrad..."
+gcc -DLYRA_NO_MAIN lyra.c catalog.c hash.c pool.c crypto.c vaultkey.c config.c freeze.c chunkstore.c verify.c gc.c vaultcopy.c du.c batch.c daemon.c output.c trace.c metrics.c fsutil.c binfind.c manifest.c bundle.c lyrad.c -o lyrad -lcjson -lcrypto -lzstd -lpthread
 
 # Copy binary to /usr/local/bin
 echo "[*] Copying lyra to /usr/local/bin requires sudo"
 sudo cp lyra /usr/local/bin/lyra
+sudo cp lyrad /usr/local/bin/lyrad
 
 # Restrict permissions but keep it executable by everyone, maybe should change this but idk about perms too well.
 sudo chmod 755 /usr/local/bin/lyra
+sudo chmod 755 /usr/local/bin/lyrad
 
 echo "[✓] Lyra installed successfully and ready to use."
 echo "[!] Use: sudo lyra, to see all commands."
@@ -0,0 +1,261 @@
+#include "lyra.h"
+
+// Bundles: many packages installed in one go
+//
+// A bundle file names each package with its URL and what it needs:
+//   { "packages": {
+//       "rg": { "url": "https://..." },
+//       "delta": { "url": "https://...", "sha256": "...", "bin": "a,b", "depends": ["rg"] } } }
+// Dependencies may also name packages that are already installed. The
+// packages and their edges form a DAG that pool_run_graph() works through:
+// downloads and extraction run side by side, a package starts only once
+// everything it depends on is in, and a failure skips its dependents.
+
+#define BUNDLE_MIN_JOBS 8  // installs mostly wait on the network
+
+typedef struct {
+    char name[256];
+    char url[1024];
+    char sha256[SHA256_HEX_LEN];
+    char binaries[1024];
+    char depends[1024];
+} BundleItem;
+
+static int bundle_index(BundleItem *items, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(items[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int bundle_install_task(void *arg) {
+    BundleItem *item = arg;
+    return install_package(item->name, item->url, item->sha256[0] ? item->sha256 : NULL,
+                           item->binaries[0] ? item->binaries : NULL,
+                           item->depends[0] ? item->depends : NULL);
+}
+
+// Read one package entry; returns 0 (after saying why) if it is malformed
+static int bundle_parse_item(cJSON *entry, BundleItem *item) {
+    snprintf(item->name, sizeof(item->name), "%s", entry->string);
+
+    cJSON *url = cJSON_GetObjectItem(entry, "url");
+    if (!cJSON_IsString(url) || !url->valuestring[0]) {
+        printf("✗ Error: Package '%s' has no url\n", item->name);
+        return 0;
+    }
+    snprintf(item->url, sizeof(item->url), "%s", url->valuestring);
+
+    cJSON *sha256 = cJSON_GetObjectItem(entry, "sha256");
+    if (sha256 && (!cJSON_IsString(sha256) || !sha256_hex_parse(sha256->valuestring, item->sha256))) {
+        printf("✗ Error: Package '%s' has a sha256 that isn't 64 hex digits\n", item->name);
+        return 0;
+    }
+
+    cJSON *bin = cJSON_GetObjectItem(entry, "bin");
+    if (bin) {
+        if (!cJSON_IsString(bin) || !binary_list_valid(item->name, bin->valuestring)) {
+            printf("✗ Error: Package '%s' has a bad bin list\n", item->name);
+            return 0;
+        }
+        snprintf(item->binaries, sizeof(item->binaries), "%s", bin->valuestring);
+    }
+
+    size_t len = 0;
+    cJSON *dep = NULL;
+    cJSON_ArrayForEach(dep, cJSON_GetObjectItem(entry, "depends")) {
+        if (!cJSON_IsString(dep) || !dep->valuestring[0] || strchr(dep->valuestring, ',')) {
+            printf("✗ Error: Package '%s' has a bad entry in depends\n", item->name);
+            return 0;
+        }
+        if (len < sizeof(item->depends)) {
+            len += snprintf(item->depends + len, sizeof(item->depends) - len, "%s%s",
+                            len ? "," : "", dep->valuestring);
+        }
+    }
+    return 1;
+}
+
+// Turn depends into edges (dependency first). Installed packages satisfy a
+// dependency without an edge. Returns the edge count, or -1 on a dependency
+// nobody provides.
+static int bundle_edges(BundleItem *items, int count, int **edges_out) {
+    int capacity = 16;
+    int edge_count = 0;
+    int *edges = malloc(capacity * 2 * sizeof(int));
+    cJSON *db = db_read();
+    int ok = edges != NULL;
+
+    for (int i = 0; ok && i < count; i++) {
+        char copy[1024];
+        snprintf(copy, sizeof(copy), "%s", items[i].depends);
+        char *save = NULL;
+        for (char *name = strtok_r(copy, ",", &save); ok && name; name = strtok_r(NULL, ",", &save)) {
+            int from = bundle_index(items, count, name);
+            if (from < 0) {
+                if (!cJSON_GetObjectItem(db, name)) {
+                    printf("✗ Error: %s depends on %s, which is neither in the bundle nor installed\n",
+                           items[i].name, name);
+                    ok = 0;
+                }
+                continue;
+            }
+            if (from == i) {
+                printf("✗ Error: %s depends on itself\n", items[i].name);
+                ok = 0;
+                continue;
+            }
+            if (edge_count == capacity) {
+                capacity *= 2;
+                int *grown = realloc(edges, capacity * 2 * sizeof(int));
+                if (!grown) {
+                    ok = 0;
+                    break;
+                }
+                edges = grown;
+            }
+            edges[2 * edge_count] = from;
+            edges[2 * edge_count + 1] = i;
+            edge_count++;
+        }
+    }
+
+    cJSON_Delete(db);
+    if (!ok) {
+        free(edges);
+        return -1;
+    }
+    *edges_out = edges;
+    return edge_count;
+}
+
+// Kahn's algorithm: print any cycle's members and return 0, or return 1 and
+// the number of levels (the longest dependency chain) in depth_out
+static int bundle_check_acyclic(BundleItem *items, int count, int *edges, int edge_count, int *depth_out) {
+    int *waiting = calloc(count, sizeof(int));
+    int *level = calloc(count, sizeof(int));
+    int *queue = malloc(count * sizeof(int));
+    if (!waiting || !level || !queue) {
+        free(waiting);
+        free(level);
+        free(queue);
+        return 0;
+    }
+
+    for (int e = 0; e < edge_count; e++) waiting[edges[2 * e + 1]]++;
+
+    int head = 0, tail = 0, depth = 0;
+    for (int i = 0; i < count; i++) {
+        if (waiting[i] == 0) queue[tail++] = i;
+    }
+    while (head < tail) {
+        int done = queue[head++];
+        if (level[done] + 1 > depth) depth = level[done] + 1;
+        for (int e = 0; e < edge_count; e++) {
+            if (edges[2 * e] != done) continue;
+            int next = edges[2 * e + 1];
+            if (level[done] + 1 > level[next]) level[next] = level[done] + 1;
+            if (--waiting[next] == 0) queue[tail++] = next;
+        }
+    }
+
+    int acyclic = tail == count;
+    if (!acyclic) {
+        printf("✗ Error: Dependency cycle among (or behind):");
+        for (int i = 0; i < count; i++) {
+            if (waiting[i] > 0) printf(" %s", items[i].name);
+        }
+        printf("\n");
+    }
+    *depth_out = depth;
+
+    free(waiting);
+    free(level);
+    free(queue);
+    return acyclic;
+}
+
+// lyra bundle <file.json>
+int bundle_install(char *path) {
+    cJSON *bundle = json_read_file(path);
+    if (!bundle) {
+        printf("✗ Error: Could not read bundle %s\n", path);
+        return 1;
+    }
+    cJSON *packages = cJSON_GetObjectItem(bundle, "packages");
+    if (!cJSON_IsObject(packages) || cJSON_GetArraySize(packages) == 0) {
+        printf("✗ Error: %s has no \"packages\" object\n", path);
+        cJSON_Delete(bundle);
+        return 1;
+    }
+
+    int count = cJSON_GetArraySize(packages);
+    BundleItem *items = calloc(count, sizeof(BundleItem));
+    int *status = calloc(count, sizeof(int));
+    if (!items || !status) {
+        printf("✗ Error: Out of memory\n");
+        free(items);
+        free(status);
+        cJSON_Delete(bundle);
+        return 1;
+    }
+
+    int ok = 1;
+    int parsed = 0;
+    cJSON *entry = NULL;
+    cJSON_ArrayForEach(entry, packages) {
+        if (!bundle_parse_item(entry, &items[parsed])) ok = 0;
+        else if (bundle_index(items, parsed, items[parsed].name) >= 0) {
+            printf("✗ Error: %s is listed twice\n", items[parsed].name);
+            ok = 0;
+        }
+        parsed++;
+    }
+    cJSON_Delete(bundle);
+
+    int *edges = NULL;
+    int edge_count = ok ? bundle_edges(items, count, &edges) : -1;
+    int depth = 0;
+    if (edge_count < 0 || !bundle_check_acyclic(items, count, edges, edge_count, &depth)) {
+        printf("Nothing was installed\n");
+        free(edges);
+        free(items);
+        free(status);
+        return 1;
+    }
+
+    int threads = pool_default_threads();
+    if (!getenv("LYRA_JOBS") && threads < BUNDLE_MIN_JOBS) threads = BUNDLE_MIN_JOBS;
+    if (threads > count) threads = count;
+
+    printf("→ Installing %d package%s (%d dependency edge%s, %d level%s) on %d worker%s\n",
+           count, count == 1 ? "" : "s", edge_count, edge_count == 1 ? "" : "s",
+           depth, depth == 1 ? "" : "s", threads, threads == 1 ? "" : "s");
+    fflush(stdout);
+
+    db_init();
+    if (!pool_run_graph(bundle_install_task, items, sizeof(BundleItem), count, edges, edge_count,
+                        threads, status)) {
+        printf("✗ Error: Out of memory\n");
+        free(edges);
+        free(items);
+        free(status);
+        return 1;
+    }
+
+    int counts[POOL_TASK_SKIPPED + 1] = { 0 };
+    for (int i = 0; i < count; i++) counts[status[i]]++;
+
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Installed: %d  Failed: %d  Skipped: %d\n",
+           counts[POOL_TASK_DONE], counts[POOL_TASK_FAILED], counts[POOL_TASK_SKIPPED]);
+    for (int i = 0; i < count; i++) {
+        if (status[i] == POOL_TASK_FAILED) printf("  ✗ %s failed\n", items[i].name);
+        if (status[i] == POOL_TASK_SKIPPED) printf("  ✗ %s skipped (a dependency failed)\n", items[i].name);
+    }
+
+    free(edges);
+    free(items);
+    free(status);
+    return counts[POOL_TASK_DONE] == count ? 0 : 1;
+}
@@ -0,0 +1,510 @@
+#include "lyra.h"
+#include <sys/file.h>
+#include <fcntl.h>
+
+// Read a whole JSON file, returns NULL if missing or invalid
+cJSON* json_read_file(char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (size <= 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    char *content = malloc(size + 1);
+    if (!content) {
+        fclose(fp);
+        return NULL;
+    }
+
+    size_t got = fread(content, 1, size, fp);
+    content[got] = '\0';
+    fclose(fp);
+
+    cJSON *root = cJSON_Parse(content);
+    free(content);
+
+    return root;
+}
+
+// Write JSON to <path>.tmp then rename over path, so readers never see a half-written file
+int json_write_file_atomic(char *path, cJSON *root) {
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+
+    char *json_str = cJSON_Print(root);
+    if (!json_str) return 0;
+
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        free(json_str);
+        return 0;
+    }
+
+    int ok = fprintf(fp, "%s\n", json_str) >= 0;
+    ok = fflush(fp) == 0 && ok;
+    ok = fsync(fileno(fp)) == 0 && ok;
+    fclose(fp);
+    free(json_str);
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Exclusive lock on <path>.lock, serializes catalog read-modify-write between processes
+int catalog_lock(char *path) {
+    char lock_path[1024];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void catalog_unlock(int fd) {
+    if (fd < 0) return;
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+void snapshot_catalog_path(char *path_out, size_t size) {
+    char *home = get_user_home();
+    snprintf(path_out, size, "%s/.lyra/vault/snapshots/catalog.json", home);
+}
+
+static int compare_snapshot_entries(const void *a, const void *b) {
+    cJSON *ea = *(cJSON **)a;
+    cJSON *eb = *(cJSON **)b;
+
+    cJSON *ta = cJSON_GetObjectItem(ea, "timestamp");
+    cJSON *tb = cJSON_GetObjectItem(eb, "timestamp");
+    const char *sa = ta && ta->valuestring ? ta->valuestring : "";
+    const char *sb = tb && tb->valuestring ? tb->valuestring : "";
+
+    int cmp = strcmp(sa, sb);
+    if (cmp != 0) return cmp;
+
+    cJSON *na = cJSON_GetObjectItem(ea, "number");
+    cJSON *nb = cJSON_GetObjectItem(eb, "number");
+    return (na ? na->valueint : 0) - (nb ? nb->valueint : 0);
+}
+
+// One-time migration: scan every snapshot file and build the catalog from it
+cJSON* snapshot_catalog_rebuild() {
+    char *home = get_user_home();
+    char snapshot_dir[512];
+    snprintf(snapshot_dir, sizeof(snapshot_dir), "%s/.lyra/vault/snapshots", home);
+
+    cJSON *catalog = cJSON_CreateObject();
+    cJSON_AddNumberToObject(catalog, "version", SNAPSHOT_CATALOG_VERSION);
+    cJSON *entries = cJSON_CreateArray();
+    cJSON_AddItemToObject(catalog, "snapshots", entries);
+
+    DIR *dir = opendir(snapshot_dir);
+    if (!dir) return catalog;
+
+    int count = 0;
+    int capacity = 64;
+    cJSON **found = malloc(capacity * sizeof(cJSON *));
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && found) {
+        if (entry->d_name[0] == '.') continue;
+
+        char *ext = strstr(entry->d_name, ".json");
+        if (!ext || strcmp(ext, ".json") != 0) continue;
+        if (strcmp(entry->d_name, "catalog.json") == 0) continue;
+
+        char snapshot_path[1024];
+        snprintf(snapshot_path, sizeof(snapshot_path), "%s/%s", snapshot_dir, entry->d_name);
+
+        cJSON *snapshot = json_read_file(snapshot_path);
+        if (!snapshot) continue;
+
+        char name[256];
+        int len = ext - entry->d_name;
+        if (len >= (int)sizeof(name)) len = sizeof(name) - 1;
+        strncpy(name, entry->d_name, len);
+        name[len] = '\0';
+
+        cJSON *timestamp = cJSON_GetObjectItem(snapshot, "timestamp");
+        cJSON *date = cJSON_GetObjectItem(snapshot, "date");
+        cJSON *number = cJSON_GetObjectItem(snapshot, "snapshotNumber");
+        cJSON *packages = cJSON_GetObjectItem(snapshot, "packages");
+
+        struct stat st;
+        long size = stat(snapshot_path, &st) == 0 ? (long)st.st_size : 0;
+
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", name);
+        cJSON_AddStringToObject(item, "timestamp", timestamp && timestamp->valuestring ? timestamp->valuestring : "");
+
+        if (date && date->valuestring) {
+            cJSON_AddStringToObject(item, "date", date->valuestring);
+        } else {
+            char *underscore = strrchr(name, '_');
+            char date_str[32] = "";
+            if (underscore && underscore - name < (int)sizeof(date_str)) {
+                strncpy(date_str, name, underscore - name);
+                date_str[underscore - name] = '\0';
+            }
+            cJSON_AddStringToObject(item, "date", date_str);
+        }
+
+        int snapshot_num = number ? number->valueint : 0;
+        if (!number) {
+            char *underscore = strrchr(name, '_');
+            if (underscore) snapshot_num = atoi(underscore + 1);
+        }
+        cJSON_AddNumberToObject(item, "number", snapshot_num);
+        cJSON_AddNumberToObject(item, "packages", packages ? cJSON_GetArraySize(packages) : 0);
+        cJSON_AddNumberToObject(item, "sizeBytes", size);
+
+        cJSON_Delete(snapshot);
+
+        if (count == capacity) {
+            capacity *= 2;
+            cJSON **grown = realloc(found, capacity * sizeof(cJSON *));
+            if (!grown) {
+                cJSON_Delete(item);
+                break;
+            }
+            found = grown;
+        }
+        found[count++] = item;
+    }
+    closedir(dir);
+
+    if (!found) return catalog;
+
+    qsort(found, count, sizeof(cJSON *), compare_snapshot_entries);
+
+    for (int i = 0; i < count; i++) {
+        cJSON *parent = i > 0 ? cJSON_GetObjectItem(found[i - 1], "name") : NULL;
+        if (parent) {
+            cJSON_AddStringToObject(found[i], "parent", parent->valuestring);
+        } else {
+            cJSON_AddNullToObject(found[i], "parent");
+        }
+        cJSON_AddItemToArray(entries, found[i]);
+    }
+    free(found);
+
+    return catalog;
+}
+
+// Load the catalog, building it from the snapshot files if it doesn't exist yet
+// lyrad keeps the parsed catalog between requests and drops it when its
+// inotify watch sees catalog.json change
+static int snapshot_catalog_resident_on = 0;
+static cJSON *snapshot_catalog_resident = NULL;
+
+void snapshot_catalog_keep_resident() {
+    snapshot_catalog_resident_on = 1;
+}
+
+void snapshot_catalog_invalidate() {
+    cJSON_Delete(snapshot_catalog_resident);
+    snapshot_catalog_resident = NULL;
+}
+
+static cJSON* snapshot_catalog_read() {
+    char catalog_path[512];
+    snapshot_catalog_path(catalog_path, sizeof(catalog_path));
+
+    cJSON *catalog = json_read_file(catalog_path);
+    if (catalog && cJSON_IsArray(cJSON_GetObjectItem(catalog, "snapshots"))) {
+        return catalog;
+    }
+    cJSON_Delete(catalog);
+
+    catalog = snapshot_catalog_rebuild();
+
+    char snapshot_dir[512];
+    snprintf(snapshot_dir, sizeof(snapshot_dir), "%s/.lyra/vault/snapshots", get_user_home());
+    if (access(snapshot_dir, W_OK) == 0) {
+        json_write_file_atomic(catalog_path, catalog);
+    }
+
+    return catalog;
+}
+
+cJSON* snapshot_catalog_load() {
+    if (!snapshot_catalog_resident_on) return snapshot_catalog_read();
+
+    if (!snapshot_catalog_resident) snapshot_catalog_resident = snapshot_catalog_read();
+    return cJSON_Duplicate(snapshot_catalog_resident, 1);
+}
+
+// Next per-day snapshot number, taken from the catalog instead of a directory scan
+int snapshot_catalog_next_number(cJSON *catalog, char *date) {
+    int highest = 0;
+    cJSON *entries = cJSON_GetObjectItem(catalog, "snapshots");
+
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, entries) {
+        cJSON *item_date = cJSON_GetObjectItem(item, "date");
+        cJSON *number = cJSON_GetObjectItem(item, "number");
+
+        if (item_date && item_date->valuestring && number &&
+            strcmp(item_date->valuestring, date) == 0 && number->valueint > highest) {
+            highest = number->valueint;
+        }
+    }
+
+    return highest + 1;
+}
+
+// Append a snapshot to the catalog; its parent is the previously taken snapshot
+void snapshot_catalog_add(cJSON *catalog, char *name, char *date, int number,
+                          char *timestamp, int package_count, long size_bytes) {
+    cJSON *entries = cJSON_GetObjectItem(catalog, "snapshots");
+    if (!entries) {
+        entries = cJSON_CreateArray();
+        cJSON_AddItemToObject(catalog, "snapshots", entries);
+    }
+
+    int total = cJSON_GetArraySize(entries);
+    cJSON *last = total > 0 ? cJSON_GetArrayItem(entries, total - 1) : NULL;
+    cJSON *parent = last ? cJSON_GetObjectItem(last, "name") : NULL;
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "name", name);
+    cJSON_AddStringToObject(item, "timestamp", timestamp);
+    cJSON_AddStringToObject(item, "date", date);
+    cJSON_AddNumberToObject(item, "number", number);
+    cJSON_AddNumberToObject(item, "packages", package_count);
+    cJSON_AddNumberToObject(item, "sizeBytes", size_bytes);
+    if (parent && parent->valuestring) {
+        cJSON_AddStringToObject(item, "parent", parent->valuestring);
+    } else {
+        cJSON_AddNullToObject(item, "parent");
+    }
+
+    cJSON_AddItemToArray(entries, item);
+}
+
+// Frozen copy catalog: one entry per package@version, kept sorted by package
+// and then creation time, so -fl and -frm never walk the frozen/ tree
+
+void frozen_catalog_path(char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/.lyra/vault/frozen/catalog.json", get_user_home());
+}
+
+static int compare_frozen_entries(const void *a, const void *b) {
+    cJSON *ea = *(cJSON **)a;
+    cJSON *eb = *(cJSON **)b;
+
+    cJSON *pa = cJSON_GetObjectItem(ea, "package");
+    cJSON *pb = cJSON_GetObjectItem(eb, "package");
+    int cmp = strcmp(pa && pa->valuestring ? pa->valuestring : "",
+                     pb && pb->valuestring ? pb->valuestring : "");
+    if (cmp != 0) return cmp;
+
+    cJSON *ca = cJSON_GetObjectItem(ea, "createdAt");
+    cJSON *cb = cJSON_GetObjectItem(eb, "createdAt");
+    return strcmp(ca && ca->valuestring ? ca->valuestring : "",
+                  cb && cb->valuestring ? cb->valuestring : "");
+}
+
+static void frozen_catalog_sort(cJSON *catalog) {
+    cJSON *entries = cJSON_DetachItemFromObject(catalog, "copies");
+    int count = cJSON_GetArraySize(entries);
+    cJSON **items = count > 0 ? malloc(count * sizeof(cJSON *)) : NULL;
+
+    cJSON *sorted = cJSON_CreateArray();
+    if (items) {
+        for (int i = count - 1; i >= 0; i--) {
+            items[i] = cJSON_DetachItemFromArray(entries, i);
+        }
+        // Insertion sort: stable, so copies made in the same second keep the
+        // order they were added in, and cheap since only the new entry is out of place
+        for (int i = 1; i < count; i++) {
+            cJSON *moving = items[i];
+            int j = i - 1;
+            while (j >= 0 && compare_frozen_entries(&items[j], &moving) > 0) {
+                items[j + 1] = items[j];
+                j--;
+            }
+            items[j + 1] = moving;
+        }
+        for (int i = 0; i < count; i++) {
+            cJSON_AddItemToArray(sorted, items[i]);
+        }
+        free(items);
+    }
+    cJSON_Delete(entries);
+    cJSON_AddItemToObject(catalog, "copies", sorted);
+}
+
+static void frozen_describe_chunked(cJSON *entry, int chunk_count) {
+    cJSON_AddStringToObject(entry, "cipher", "aes-256-gcm");
+    cJSON_AddStringToObject(entry, "kdf", "vault-hmac-sha256");
+    cJSON_AddNumberToObject(entry, "chunks", chunk_count);
+}
+
+static cJSON* frozen_entry_from_manifest(char *version_dir, char *package, char *version) {
+    char manifest_path[1024];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/manifest.json", version_dir);
+
+    char frozen_path[1024];
+    int kind = frozen_copy_path(package, version, frozen_path, sizeof(frozen_path));
+    if (!kind) return NULL;
+
+    cJSON *manifest = json_read_file(manifest_path);
+    cJSON *created = cJSON_GetObjectItem(manifest, "createdAt");
+    cJSON *size = cJSON_GetObjectItem(manifest, "sizeBytes");
+    cJSON *sha256 = cJSON_GetObjectItem(manifest, "sha256");
+    cJSON *format = cJSON_GetObjectItem(manifest, "format");
+
+    struct stat st = { 0 };
+    stat(frozen_path, &st);
+
+    cJSON *entry = cJSON_CreateObject();
+    cJSON_AddStringToObject(entry, "package", package);
+    cJSON_AddStringToObject(entry, "version", version);
+    cJSON_AddStringToObject(entry, "createdAt", created && created->valuestring ? created->valuestring : "");
+    cJSON_AddNumberToObject(entry, "sizeBytes", size ? size->valuedouble : (double)st.st_size);
+    if (sha256 && sha256->valuestring) {
+        cJSON_AddStringToObject(entry, "sha256", sha256->valuestring);
+    }
+    if (kind == FROZEN_CHUNKED) {
+        cJSON_AddStringToObject(entry, "format", LYRA_CHUNKED_FORMAT);
+        frozen_describe_chunked(entry, cJSON_GetArraySize(cJSON_GetObjectItem(manifest, "chunks")));
+    } else {
+        cJSON_AddStringToObject(entry, "file", strrchr(frozen_path, '/') + 1);
+        cJSON_AddStringToObject(entry, "format", format && format->valuestring ? format->valuestring : "tar+gzip");
+        enc_describe_file(frozen_path, entry);
+    }
+
+    cJSON_Delete(manifest);
+    return entry;
+}
+
+// One-time migration: walk frozen/<pkg>/<version>/ and build the catalog
+cJSON* frozen_catalog_rebuild() {
+    char frozen_dir[512];
+    snprintf(frozen_dir, sizeof(frozen_dir), "%s/.lyra/vault/frozen", get_user_home());
+
+    cJSON *catalog = cJSON_CreateObject();
+    cJSON_AddNumberToObject(catalog, "version", FROZEN_CATALOG_VERSION);
+    cJSON *entries = cJSON_CreateArray();
+    cJSON_AddItemToObject(catalog, "copies", entries);
+
+    DIR *dir = opendir(frozen_dir);
+    if (!dir) return catalog;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        char pkg_dir[1024];
+        snprintf(pkg_dir, sizeof(pkg_dir), "%s/%s", frozen_dir, entry->d_name);
+
+        DIR *ver_dir = opendir(pkg_dir);
+        if (!ver_dir) continue;
+
+        struct dirent *ver_entry;
+        while ((ver_entry = readdir(ver_dir)) != NULL) {
+            if (ver_entry->d_name[0] == '.') continue;
+
+            char version_dir[1536];
+            snprintf(version_dir, sizeof(version_dir), "%s/%s", pkg_dir, ver_entry->d_name);
+
+            cJSON *item = frozen_entry_from_manifest(version_dir, entry->d_name, ver_entry->d_name);
+            if (item) cJSON_AddItemToArray(entries, item);
+        }
+        closedir(ver_dir);
+    }
+    closedir(dir);
+
+    frozen_catalog_sort(catalog);
+    return catalog;
+}
+
+// Load the catalog, building it from the frozen tree if it doesn't exist yet
+cJSON* frozen_catalog_load() {
+    char catalog_path[512];
+    frozen_catalog_path(catalog_path, sizeof(catalog_path));
+
+    cJSON *catalog = json_read_file(catalog_path);
+    if (catalog && cJSON_IsArray(cJSON_GetObjectItem(catalog, "copies"))) {
+        return catalog;
+    }
+    cJSON_Delete(catalog);
+
+    catalog = frozen_catalog_rebuild();
+
+    char frozen_dir[512];
+    snprintf(frozen_dir, sizeof(frozen_dir), "%s/.lyra/vault/frozen", get_user_home());
+    if (access(frozen_dir, W_OK) == 0) {
+        json_write_file_atomic(catalog_path, catalog);
+    }
+
+    return catalog;
+}
+
+// Drop package@version from the catalog, or every version when version is NULL
+void frozen_catalog_remove(cJSON *catalog, char *package, char *version) {
+    cJSON *entries = cJSON_GetObjectItem(catalog, "copies");
+
+    for (int i = cJSON_GetArraySize(entries) - 1; i >= 0; i--) {
+        cJSON *item = cJSON_GetArrayItem(entries, i);
+        cJSON *item_pkg = cJSON_GetObjectItem(item, "package");
+        cJSON *item_ver = cJSON_GetObjectItem(item, "version");
+
+        if (!item_pkg || !item_pkg->valuestring || strcmp(item_pkg->valuestring, package) != 0) continue;
+        if (version && (!item_ver || !item_ver->valuestring || strcmp(item_ver->valuestring, version) != 0)) continue;
+
+        cJSON_DeleteItemFromArray(entries, i);
+    }
+}
+
+// Record a fresh freeze, replacing any older entry for the same package@version
+void frozen_catalog_put(cJSON *catalog, char *package, char *version, char *frozen_path,
+                        FreezeResult *result) {
+    frozen_catalog_remove(catalog, package, version);
+
+    cJSON *entries = cJSON_GetObjectItem(catalog, "copies");
+    if (!entries) {
+        entries = cJSON_CreateArray();
+        cJSON_AddItemToObject(catalog, "copies", entries);
+    }
+
+    char *slash = strrchr(frozen_path, '/');
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "package", package);
+    cJSON_AddStringToObject(item, "version", version);
+    cJSON_AddStringToObject(item, "createdAt", result->created_at);
+    cJSON_AddNumberToObject(item, "sizeBytes", (double)result->size_bytes);
+
+    if (result->chunked) {
+        cJSON_AddNumberToObject(item, "newBytes", (double)result->new_bytes);
+        cJSON_AddStringToObject(item, "format", LYRA_CHUNKED_FORMAT);
+        frozen_describe_chunked(item, result->chunk_count);
+    } else {
+        cJSON_AddStringToObject(item, "sha256", result->sha256);
+        cJSON_AddStringToObject(item, "file", slash ? slash + 1 : frozen_path);
+        cJSON_AddStringToObject(item, "format", LYRA_FROZEN_FORMAT);
+        enc_describe_file(frozen_path, item);
+    }
+
+    cJSON_AddItemToArray(entries, item);
+    frozen_catalog_sort(catalog);
+}
@@ -0,0 +1,811 @@
+#define _GNU_SOURCE  // syncfs
+#include "lyra.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <zstd.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+// Content-defined chunk store for frozen copies
+//
+// Binaries are cut into chunks with FastCDC (gear rolling hash, normalized
+// chunking), so an insertion early in a file only changes the chunks around
+// it. Each chunk is named by HMAC-SHA256(id key, plaintext) and stored once
+// under vault/frozen/chunks/<2 hex>/<id>, zstd-compressed and then sealed
+// with AES-256-GCM. Both keys come from the vault key, so chunk names don't
+// reveal anything about the content without it.
+//
+// chunks/index has one line per chunk: id, plain size, stored size, refs.
+// A frozen copy's manifest lists its chunk ids in order; refs count how
+// many manifests point at a chunk, and the chunk file goes when it hits 0.
+//
+// Chunk file: magic "LYRACHK\0", version, flags (1 = zstd), reserved[2],
+// plain length (u32 le), nonce[12], ciphertext, tag[16]. The header and the
+// chunk id are the GCM AAD, so a chunk can't be swapped for another one.
+
+#define CHUNK_MAGIC "LYRACHK"
+#define CHUNK_VERSION 1
+#define CHUNK_FLAG_ZSTD 1
+#define CHUNK_HEADER_SIZE 28
+#define CHUNK_NONCE_SIZE 12
+#define CHUNK_TAG_SIZE 16
+
+#define CDC_MIN_SIZE (16 * 1024)
+#define CDC_AVG_SIZE (64 * 1024)
+#define CDC_MAX_SIZE (256 * 1024)
+
+// Normalized chunking: harder to cut before the average size, easier after
+#define CDC_MASK_SMALL (((1ULL << 18) - 1) << 46)
+#define CDC_MASK_LARGE (((1ULL << 14) - 1) << 50)
+
+#define CHUNK_BATCH 64
+
+// Where an entry's file stands; entries read from the index are stored
+enum { CHUNK_STORED, CHUNK_WRITING, CHUNK_WRITE_FAILED };
+
+typedef struct {
+    unsigned char id[CHUNK_ID_SIZE];
+    uint32_t size;
+    uint32_t stored;
+    int refs;
+    int used;
+    int fresh;
+    int state;
+    char sha256[SHA256_HEX_LEN];  // of the chunk file, for the integrity log
+} ChunkEntry;
+
+struct ChunkStore {
+    char dir[512];
+    int lock_fd;
+    int has_key;
+    unsigned char id_key[LYRA_KEY_SIZE];
+    unsigned char enc_key[LYRA_KEY_SIZE];
+    int zstd_level;
+    ChunkEntry *table;
+    size_t capacity;
+    size_t count;
+    int dirty;
+    pthread_mutex_t lock;
+    pthread_cond_t written;  // an entry left CHUNK_WRITING
+};
+
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+// Fixed-seed splitmix64: the table must never change, or chunk boundaries
+// (and with them dedup against older freezes) would shift
+static void gear_init() {
+    uint64_t state = 0x6c7972612d636463ULL;
+    for (int i = 0; i < 256; i++) {
+        state += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+// Length of the next chunk starting at data
+static size_t cdc_next_cut(const unsigned char *data, size_t len) {
+    if (len <= CDC_MIN_SIZE) return len;
+    if (len > CDC_MAX_SIZE) len = CDC_MAX_SIZE;
+
+    size_t normal = len < CDC_AVG_SIZE ? len : CDC_AVG_SIZE;
+    uint64_t hash = 0;
+    size_t i = CDC_MIN_SIZE;
+
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & CDC_MASK_SMALL)) return i + 1;
+    }
+    for (; i < len; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & CDC_MASK_LARGE)) return i + 1;
+    }
+
+    return len;
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void chunk_id_to_hex(const unsigned char *id, char *hex_out) {
+    sha256_to_hex(id, hex_out);
+}
+
+int chunk_id_from_hex(const char *hex, unsigned char *id_out) {
+    if (!hex || strlen(hex) != CHUNK_ID_SIZE * 2) return 0;
+
+    for (int i = 0; i < CHUNK_ID_SIZE; i++) {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) return 0;
+        id_out[i] = (unsigned char)byte;
+    }
+    return 1;
+}
+
+static void chunk_path(ChunkStore *store, const unsigned char *id, char *path_out, size_t size) {
+    char hex[SHA256_HEX_LEN];
+    chunk_id_to_hex(id, hex);
+    snprintf(path_out, size, "%s/%.2s/%s", store->dir, hex, hex);
+}
+
+// Index hash table, open addressing; ids are already uniformly distributed
+static ChunkEntry *index_slot(ChunkStore *store, const unsigned char *id) {
+    uint64_t h;
+    memcpy(&h, id, sizeof(h));
+    size_t mask = store->capacity - 1;
+
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        ChunkEntry *slot = &store->table[i];
+        if (!slot->used || memcmp(slot->id, id, CHUNK_ID_SIZE) == 0) return slot;
+    }
+}
+
+static int index_grow(ChunkStore *store) {
+    size_t old_capacity = store->capacity;
+    ChunkEntry *old_table = store->table;
+
+    store->capacity = old_capacity ? old_capacity * 2 : 1024;
+    store->table = calloc(store->capacity, sizeof(ChunkEntry));
+    if (!store->table) {
+        store->table = old_table;
+        store->capacity = old_capacity;
+        return 0;
+    }
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_table[i].used) *index_slot(store, old_table[i].id) = old_table[i];
+    }
+    free(old_table);
+    return 1;
+}
+
+// Find or add an entry; returns NULL only on allocation failure
+static ChunkEntry *index_get(ChunkStore *store, const unsigned char *id, int create) {
+    if (create && (store->count + 1) * 10 >= store->capacity * 7 && !index_grow(store)) {
+        return NULL;
+    }
+
+    ChunkEntry *slot = index_slot(store, id);
+    if (slot->used || !create) return slot->used ? slot : NULL;
+
+    memcpy(slot->id, id, CHUNK_ID_SIZE);
+    slot->used = 1;
+    store->count++;
+    return slot;
+}
+
+// Delete an entry, re-placing the rest of its probe run
+static void index_delete(ChunkStore *store, ChunkEntry *slot) {
+    size_t mask = store->capacity - 1;
+    size_t i = slot - store->table;
+
+    slot->used = 0;
+    store->count--;
+
+    for (i = (i + 1) & mask; store->table[i].used; i = (i + 1) & mask) {
+        ChunkEntry moved = store->table[i];
+        store->table[i].used = 0;
+        *index_slot(store, moved.id) = moved;
+    }
+}
+
+static void index_path(ChunkStore *store, char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/index", store->dir);
+}
+
+static void index_load(ChunkStore *store) {
+    char path[600];
+    index_path(store, path, sizeof(path));
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char hex[SHA256_HEX_LEN];
+        unsigned long size, stored;
+        int refs;
+        unsigned char id[CHUNK_ID_SIZE];
+
+        if (sscanf(line, "%64s %lu %lu %d", hex, &size, &stored, &refs) != 4) continue;
+        if (!chunk_id_from_hex(hex, id)) continue;
+
+        ChunkEntry *entry = index_get(store, id, 1);
+        if (!entry) break;
+        entry->size = size;
+        entry->stored = stored;
+        entry->refs = refs;
+    }
+    fclose(fp);
+}
+
+static int index_save(ChunkStore *store) {
+    char path[600];
+    char tmp_path[700];
+    index_path(store, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) return 0;
+
+    int ok = 1;
+    for (size_t i = 0; i < store->capacity && ok; i++) {
+        ChunkEntry *entry = &store->table[i];
+        if (!entry->used) continue;
+
+        char hex[SHA256_HEX_LEN];
+        chunk_id_to_hex(entry->id, hex);
+        ok = fprintf(fp, "%s %u %u %d\n", hex, entry->size, entry->stored, entry->refs) > 0;
+    }
+
+    ok = fflush(fp) == 0 && ok;
+    ok = fsync(fileno(fp)) == 0 && ok;
+    fclose(fp);
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Open the store and take its lock. vk may be NULL when only releasing chunks.
+ChunkStore *chunk_store_open(VaultKey *vk) {
+    pthread_once(&gear_once, gear_init);
+
+    ChunkStore *store = calloc(1, sizeof(ChunkStore));
+    if (!store) return NULL;
+
+    snprintf(store->dir, sizeof(store->dir), "%s/.lyra/vault/frozen/chunks", get_user_home());
+    mkdir(store->dir, 0700);
+
+    char path[600];
+    index_path(store, path, sizeof(path));
+    store->lock_fd = catalog_lock(path);
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_cond_init(&store->written, NULL);
+
+    if (vk) {
+        unsigned int len = 0;
+        store->has_key =
+            HMAC(EVP_sha256(), vk->key, LYRA_KEY_SIZE, (unsigned char *)"lyra-chunk-id", 13, store->id_key, &len) != NULL &&
+            HMAC(EVP_sha256(), vk->key, LYRA_KEY_SIZE, (unsigned char *)"lyra-chunk-key", 14, store->enc_key, &len) != NULL;
+    }
+
+    store->zstd_level = (int)config_get_long("freeze_zstd_level", LYRA_FREEZE_ZSTD_LEVEL);
+
+    if (!index_grow(store)) {
+        chunk_store_close(store);
+        return NULL;
+    }
+    index_load(store);
+
+    return store;
+}
+
+// Drop chunks nothing refers to (left behind by failed freezes), save the
+// index and release the lock
+int chunk_store_close(ChunkStore *store) {
+    if (!store) return 0;
+
+    for (size_t i = 0; i < store->capacity; i++) {
+        ChunkEntry *entry = &store->table[i];
+        if (!entry->used || entry->refs > 0) continue;
+
+        char path[700];
+        chunk_path(store, entry->id, path, sizeof(path));
+        remove(path);
+        index_delete(store, entry);
+        store->dirty = 1;
+        i--;  // the slot may now hold a moved entry
+    }
+
+    int ok = 1;
+    IntegrityLog *log = NULL;
+    if (store->dirty) {
+        // Chunk files are written without per-file fsync; flush them in one go
+        // before the index starts pointing at them
+        int dir_fd = open(store->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            syncfs(dir_fd);
+            close(dir_fd);
+        }
+        ok = index_save(store);
+
+        for (size_t i = 0; i < store->capacity; i++) {
+            ChunkEntry *entry = &store->table[i];
+            if (!entry->used || !entry->fresh) continue;
+            if (!log) log = integrity_log_open();
+
+            char path[700];
+            chunk_path(store, entry->id, path, sizeof(path));
+            integrity_log_add(log, path, entry->sha256);
+        }
+        integrity_log_close(log);
+    }
+
+    catalog_unlock(store->lock_fd);
+    pthread_mutex_destroy(&store->lock);
+    pthread_cond_destroy(&store->written);
+    OPENSSL_cleanse(store->id_key, sizeof(store->id_key));
+    OPENSSL_cleanse(store->enc_key, sizeof(store->enc_key));
+    free(store->table);
+    free(store);
+
+    return ok;
+}
+
+typedef struct {
+    ChunkStore *store;
+    const unsigned char *data;
+    size_t len;
+    ChunkRef *ref;
+    uint64_t written;
+    int ok;
+} ChunkPutTask;
+
+static int chunk_write(ChunkStore *store, const unsigned char *id, const unsigned char *data, size_t len,
+                       uint32_t *stored_out, char *sha256_out) {
+    size_t bound = ZSTD_compressBound(len);
+    unsigned char *packed = malloc(bound);
+    unsigned char *file = malloc(CHUNK_HEADER_SIZE + (bound > len ? bound : len) + CHUNK_TAG_SIZE);
+    if (!packed || !file) {
+        free(packed);
+        free(file);
+        return 0;
+    }
+
+    // Keep the chunk raw if zstd doesn't make it smaller
+    size_t packed_len = ZSTD_compress(packed, bound, data, len, store->zstd_level);
+    int compressed = !ZSTD_isError(packed_len) && packed_len < len;
+    const unsigned char *payload = compressed ? packed : data;
+    size_t payload_len = compressed ? packed_len : len;
+
+    unsigned char *h = file;
+    memcpy(h, CHUNK_MAGIC, 8);
+    h[8] = CHUNK_VERSION;
+    h[9] = compressed ? CHUNK_FLAG_ZSTD : 0;
+    h[10] = h[11] = 0;
+    put_u32(h + 12, (uint32_t)len);
+
+    unsigned char aad[CHUNK_HEADER_SIZE + CHUNK_ID_SIZE];
+    int out_len = 0;
+    int ok = RAND_bytes(h + 16, CHUNK_NONCE_SIZE) == 1;
+    memcpy(aad, h, CHUNK_HEADER_SIZE);
+    memcpy(aad + CHUNK_HEADER_SIZE, id, CHUNK_ID_SIZE);
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    unsigned char *tag = file + CHUNK_HEADER_SIZE + payload_len;
+    ok = ok && ctx &&
+         EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, store->enc_key, h + 16) == 1 &&
+         EVP_EncryptUpdate(ctx, NULL, &out_len, aad, sizeof(aad)) == 1 &&
+         EVP_EncryptUpdate(ctx, file + CHUNK_HEADER_SIZE, &out_len, payload, payload_len) == 1 &&
+         EVP_EncryptFinal_ex(ctx, file + CHUNK_HEADER_SIZE + out_len, &out_len) == 1 &&
+         EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, CHUNK_TAG_SIZE, tag) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+
+    size_t file_len = CHUNK_HEADER_SIZE + payload_len + CHUNK_TAG_SIZE;
+
+    unsigned char digest[SHA256_DIGEST_LEN];
+    unsigned int digest_len = 0;
+    ok = ok && EVP_Digest(file, file_len, digest, &digest_len, EVP_sha256(), NULL) == 1;
+    sha256_to_hex(digest, sha256_out);
+
+    char path[700];
+    char tmp_path[800];
+    chunk_path(store, id, path, sizeof(path));
+
+    char *slash = strrchr(path, '/');
+    *slash = '\0';
+    mkdir(path, 0700);
+    *slash = '/';
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d.%lu", path, (int)getpid(), (unsigned long)pthread_self());
+
+    if (ok) {
+        int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0400);
+        ok = fd >= 0 && write(fd, file, file_len) == (ssize_t)file_len;
+        if (fd >= 0) close(fd);
+        ok = ok && rename(tmp_path, path) == 0;
+        if (!ok) remove(tmp_path);
+    }
+
+    free(packed);
+    free(file);
+
+    *stored_out = (uint32_t)file_len;
+    return ok;
+}
+
+static void chunk_put_task(void *arg) {
+    ChunkPutTask *task = arg;
+    ChunkStore *store = task->store;
+    unsigned int len = 0;
+
+    task->ok = HMAC(EVP_sha256(), store->id_key, LYRA_KEY_SIZE, task->data, task->len,
+                    task->ref->id, &len) != NULL;
+    task->ref->size = (uint32_t)task->len;
+    if (!task->ok) return;
+
+    // Claim the chunk; whoever adds the entry writes the file. A task that
+    // finds it being written waits for the outcome and takes over a failed
+    // write, so no freeze ends up pointing at a chunk that never landed.
+    pthread_mutex_lock(&store->lock);
+    ChunkEntry *entry = index_get(store, task->ref->id, 0);
+    while (entry && entry->state == CHUNK_WRITING) {
+        pthread_cond_wait(&store->written, &store->lock);
+        entry = index_get(store, task->ref->id, 0);  // the table may have grown
+    }
+    int is_new = entry == NULL || entry->state == CHUNK_WRITE_FAILED;
+    if (entry == NULL) {
+        entry = index_get(store, task->ref->id, 1);
+        if (entry) entry->refs = 0;
+    }
+    if (entry && is_new) {
+        entry->size = (uint32_t)task->len;
+        entry->state = CHUNK_WRITING;
+        store->dirty = 1;
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    if (!entry) {
+        task->ok = 0;
+        return;
+    }
+    if (!is_new) return;
+
+    uint32_t stored = 0;
+    char sha256[SHA256_HEX_LEN] = "";
+    task->ok = chunk_write(store, task->ref->id, task->data, task->len, &stored, sha256);
+    task->written = stored;
+
+    pthread_mutex_lock(&store->lock);
+    entry = index_get(store, task->ref->id, 0);
+    if (entry) {
+        entry->stored = stored;
+        entry->fresh = task->ok;
+        entry->state = task->ok ? CHUNK_STORED : CHUNK_WRITE_FAILED;
+        memcpy(entry->sha256, sha256, SHA256_HEX_LEN);
+    }
+    pthread_cond_broadcast(&store->written);
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Chunk, dedup and store one file. Fills result->chunks (caller frees with
+// freeze_result_free); the new chunks have no refs until chunk_store_ref().
+int chunk_store_put_file(ChunkStore *store, char *source_path, FreezeResult *result) {
+    if (!store || !store->has_key) return 0;
+
+    int fd = open(source_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("✗ Error: Could not read %s\n", source_path);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        printf("✗ Error: %s is not a regular file\n", source_path);
+        close(fd);
+        return 0;
+    }
+
+    size_t file_len = (size_t)st.st_size;
+    unsigned char *data = NULL;
+    if (file_len > 0) {
+        data = mmap(NULL, file_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            printf("✗ Error: Could not map %s\n", source_path);
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);
+
+    // Cut points first (serial by nature), then hash/compress/encrypt in parallel
+    int capacity = (int)(file_len / CDC_MIN_SIZE) + 1;
+    ChunkRef *refs = malloc(capacity * sizeof(ChunkRef));
+    ChunkPutTask *tasks = malloc(capacity * sizeof(ChunkPutTask));
+    int count = 0;
+    int ok = refs && tasks;
+
+    for (size_t offset = 0; ok && offset < file_len; count++) {
+        size_t cut = cdc_next_cut(data + offset, file_len - offset);
+        tasks[count].store = store;
+        tasks[count].data = data + offset;
+        tasks[count].len = cut;
+        tasks[count].ref = &refs[count];
+        tasks[count].written = 0;
+        tasks[count].ok = 0;
+        offset += cut;
+    }
+
+    if (ok) {
+        pool_run(chunk_put_task, tasks, sizeof(ChunkPutTask), count, 0);
+    }
+
+    uint64_t stored_total = 0;
+    for (int i = 0; ok && i < count; i++) {
+        if (!tasks[i].ok) {
+            ok = 0;
+            break;
+        }
+        result->new_bytes += tasks[i].written;
+    }
+
+    if (ok) {
+        pthread_mutex_lock(&store->lock);
+        for (int i = 0; i < count; i++) {
+            ChunkEntry *entry = index_get(store, refs[i].id, 0);
+            stored_total += entry ? entry->stored : 0;
+        }
+        pthread_mutex_unlock(&store->lock);
+
+        unsigned char digest[SHA256_DIGEST_LEN];
+        unsigned int len = 0;
+        ok = EVP_Digest(data ? data : (unsigned char *)"", file_len, digest, &len, EVP_sha256(), NULL) == 1;
+        sha256_to_hex(digest, result->binary_sha256);
+    }
+
+    if (data) munmap(data, file_len);
+    free(tasks);
+
+    if (!ok) {
+        printf("✗ Error: Failed to store chunks for %s\n", source_path);
+        free(refs);
+        return 0;
+    }
+
+    result->chunks = refs;
+    result->chunk_count = count;
+    result->input_bytes = file_len;
+    result->size_bytes = stored_total;
+    result->chunked = 1;
+    result->mode = st.st_mode & 07777;
+    return 1;
+}
+
+// Add (delta > 0) or drop references; chunks left with none are removed on close
+void chunk_store_ref(ChunkStore *store, ChunkRef *refs, int count, int delta) {
+    pthread_mutex_lock(&store->lock);
+    for (int i = 0; i < count; i++) {
+        ChunkEntry *entry = index_get(store, refs[i].id, 0);
+        if (!entry) continue;
+        entry->refs += delta;
+        if (entry->refs < 0) entry->refs = 0;
+        store->dirty = 1;
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Read the chunk list out of a frozen copy manifest
+int chunk_refs_from_manifest(cJSON *manifest, ChunkRef **refs_out, int *count_out) {
+    cJSON *chunks = cJSON_GetObjectItem(manifest, "chunks");
+    int count = cJSON_GetArraySize(chunks);
+    *refs_out = NULL;
+    *count_out = 0;
+    if (!cJSON_IsArray(chunks)) return 0;
+
+    ChunkRef *refs = malloc((count > 0 ? count : 1) * sizeof(ChunkRef));
+    if (!refs) return 0;
+
+    int i = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, chunks) {
+        cJSON *id = cJSON_GetObjectItem(item, "id");
+        cJSON *size = cJSON_GetObjectItem(item, "size");
+        if (!id || !size || !chunk_id_from_hex(id->valuestring, refs[i].id)) {
+            free(refs);
+            return 0;
+        }
+        refs[i].size = (uint32_t)size->valuedouble;
+        i++;
+    }
+
+    *refs_out = refs;
+    *count_out = count;
+    return 1;
+}
+
+// Drop the references held by the manifest in version_dir, if it's chunked
+void chunk_store_release_manifest(ChunkStore *store, char *version_dir) {
+    char manifest_path[1024];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/manifest.json", version_dir);
+
+    cJSON *manifest = json_read_file(manifest_path);
+    ChunkRef *refs = NULL;
+    int count = 0;
+
+    if (manifest && chunk_refs_from_manifest(manifest, &refs, &count)) {
+        chunk_store_ref(store, refs, count, -1);
+    }
+
+    free(refs);
+    cJSON_Delete(manifest);
+}
+
+typedef struct {
+    ChunkStore *store;
+    ChunkRef *ref;
+    unsigned char *out;
+    int ok;
+} ChunkGetTask;
+
+static void chunk_get_task(void *arg) {
+    ChunkGetTask *task = arg;
+    ChunkStore *store = task->store;
+    task->ok = 0;
+
+    char path[700];
+    chunk_path(store, task->ref->id, path, sizeof(path));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return;
+
+    fseek(fp, 0, SEEK_END);
+    long file_len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    size_t max_len = CHUNK_HEADER_SIZE + ZSTD_compressBound(CDC_MAX_SIZE) + CHUNK_TAG_SIZE;
+    if (file_len < CHUNK_HEADER_SIZE + CHUNK_TAG_SIZE || (size_t)file_len > max_len) {
+        fclose(fp);
+        return;
+    }
+
+    unsigned char *file = malloc(file_len);
+    unsigned char *payload = malloc(file_len);
+    int ok = file && payload && fread(file, 1, file_len, fp) == (size_t)file_len;
+    fclose(fp);
+
+    unsigned char *h = file;
+    size_t payload_len = file_len - CHUNK_HEADER_SIZE - CHUNK_TAG_SIZE;
+    ok = ok && memcmp(h, CHUNK_MAGIC, 8) == 0 && h[8] == CHUNK_VERSION &&
+         get_u32(h + 12) == task->ref->size;
+
+    unsigned char aad[CHUNK_HEADER_SIZE + CHUNK_ID_SIZE];
+    int out_len = 0;
+    EVP_CIPHER_CTX *ctx = ok ? EVP_CIPHER_CTX_new() : NULL;
+    if (ok) {
+        memcpy(aad, h, CHUNK_HEADER_SIZE);
+        memcpy(aad + CHUNK_HEADER_SIZE, task->ref->id, CHUNK_ID_SIZE);
+    }
+    ok = ok && ctx &&
+         EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, store->enc_key, h + 16) == 1 &&
+         EVP_DecryptUpdate(ctx, NULL, &out_len, aad, sizeof(aad)) == 1 &&
+         EVP_DecryptUpdate(ctx, payload, &out_len, file + CHUNK_HEADER_SIZE, payload_len) == 1 &&
+         EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, CHUNK_TAG_SIZE, file + file_len - CHUNK_TAG_SIZE) == 1 &&
+         EVP_DecryptFinal_ex(ctx, payload + out_len, &out_len) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+
+    if (ok && (h[9] & CHUNK_FLAG_ZSTD)) {
+        size_t got = ZSTD_decompress(task->out, task->ref->size, payload, payload_len);
+        ok = !ZSTD_isError(got) && got == task->ref->size;
+    } else if (ok) {
+        ok = payload_len == task->ref->size;
+        if (ok) memcpy(task->out, payload, payload_len);
+    }
+
+    free(file);
+    free(payload);
+    task->ok = ok;
+}
+
+// Reassemble a chunked copy into out, decrypting batches of chunks in
+// parallel and writing them in order. Checks the result against sha256_hex.
+int chunk_store_restore(VaultKey *vk, ChunkRef *refs, int count, FILE *out, char *sha256_hex) {
+    ChunkStore store;
+    memset(&store, 0, sizeof(store));
+    snprintf(store.dir, sizeof(store.dir), "%s/.lyra/vault/frozen/chunks", get_user_home());
+
+    unsigned int len = 0;
+    if (!HMAC(EVP_sha256(), vk->key, LYRA_KEY_SIZE, (unsigned char *)"lyra-chunk-key", 14, store.enc_key, &len)) {
+        return 0;
+    }
+
+    int batch = count < CHUNK_BATCH ? count : CHUNK_BATCH;
+    ChunkGetTask *tasks = malloc((batch > 0 ? batch : 1) * sizeof(ChunkGetTask));
+    unsigned char *buffer = malloc((size_t)(batch > 0 ? batch : 1) * CDC_MAX_SIZE);
+    EVP_MD_CTX *digest = EVP_MD_CTX_new();
+    int ok = tasks && buffer && digest && EVP_DigestInit_ex(digest, EVP_sha256(), NULL) == 1;
+
+    for (int start = 0; ok && start < count; start += batch) {
+        int n = count - start < batch ? count - start : batch;
+        for (int i = 0; i < n; i++) {
+            tasks[i].store = &store;
+            tasks[i].ref = &refs[start + i];
+            tasks[i].out = buffer + (size_t)i * CDC_MAX_SIZE;
+            tasks[i].ok = 0;
+            if (refs[start + i].size > CDC_MAX_SIZE) ok = 0;
+        }
+        if (!ok) break;
+
+        pool_run(chunk_get_task, tasks, sizeof(ChunkGetTask), n, 0);
+
+        for (int i = 0; ok && i < n; i++) {
+            ok = tasks[i].ok &&
+                 fwrite(tasks[i].out, 1, tasks[i].ref->size, out) == tasks[i].ref->size &&
+                 EVP_DigestUpdate(digest, tasks[i].out, tasks[i].ref->size) == 1;
+        }
+    }
+
+    if (ok && sha256_hex && sha256_hex[0]) {
+        unsigned char hash[SHA256_DIGEST_LEN];
+        char hex[SHA256_HEX_LEN];
+        ok = EVP_DigestFinal_ex(digest, hash, &len) == 1;
+        sha256_to_hex(hash, hex);
+        ok = ok && strcmp(hex, sha256_hex) == 0;
+    }
+
+    EVP_MD_CTX_free(digest);
+    free(tasks);
+    free(buffer);
+    OPENSSL_cleanse(store.enc_key, sizeof(store.enc_key));
+
+    return ok;
+}
+
+// Call fn with the path of every chunk file in the index
+void chunk_store_each_file(void (*fn)(char *path, void *ctx), void *ctx) {
+    char dir[512];
+    char path[600];
+    snprintf(dir, sizeof(dir), "%s/.lyra/vault/frozen/chunks", get_user_home());
+    snprintf(path, sizeof(path), "%s/index", dir);
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char hex[SHA256_HEX_LEN];
+        unsigned char id[CHUNK_ID_SIZE];
+        if (sscanf(line, "%64s", hex) != 1 || !chunk_id_from_hex(hex, id)) continue;
+
+        char chunk_file[700];
+        snprintf(chunk_file, sizeof(chunk_file), "%s/%.2s/%s", dir, hex, hex);
+        fn(chunk_file, ctx);
+    }
+    fclose(fp);
+}
+
+// Bytes the chunk store takes on disk, from the stored sizes in the index
+uint64_t chunk_store_bytes() {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/.lyra/vault/frozen/chunks/index", get_user_home());
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    uint64_t total = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char hex[SHA256_HEX_LEN];
+        unsigned long size, stored;
+        if (sscanf(line, "%64s %lu %lu", hex, &size, &stored) == 3) total += stored;
+    }
+    fclose(fp);
+    return total;
+}
+
+// New freezes go to the chunk store unless lyra.conf says frozen_store = archive
+int frozen_store_chunked() {
+    char value[32];
+    return !config_get("frozen_store", value, sizeof(value)) || strcmp(value, "archive") != 0;
+}
+
+void freeze_result_free(FreezeResult *result) {
+    free(result->chunks);
+    result->chunks = NULL;
+    result->chunk_count = 0;
+}
@@ -0,0 +1,99 @@
+#include "lyra.h"
+#include <ctype.h>
+
+// ~/.lyra/config/lyra.conf holds "key = value" settings, '#' starts a comment
+
+static char* trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+int config_get(char *key, char *value_out, size_t size) {
+    char *home = get_user_home();
+    char conf_path[512];
+    snprintf(conf_path, sizeof(conf_path), "%s/.lyra/config/lyra.conf", home);
+
+    FILE *fp = fopen(conf_path, "r");
+    if (!fp) return 0;
+
+    char line[1024];
+    int found = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *eq = strchr(line, '=');
+        if (!eq) continue;
+        *eq = '\0';
+
+        char *name = trim(line);
+        char *value = trim(eq + 1);
+
+        // Later lines win, so a key can be overridden by appending to the file
+        if (strcmp(name, key) == 0) {
+            strncpy(value_out, value, size - 1);
+            value_out[size - 1] = '\0';
+            found = 1;
+        }
+    }
+
+    fclose(fp);
+    return found;
+}
+
+long config_get_long(char *key, long default_value) {
+    char value[64];
+    if (!config_get(key, value, sizeof(value)) || value[0] == '\0') {
+        return default_value;
+    }
+
+    char *end;
+    long parsed = strtol(value, &end, 10);
+    return end == value ? default_value : parsed;
+}
+
+// key.<package> if set, else key, else default_value
+long config_get_long_for(char *key, char *package_name, long default_value) {
+    char package_key[512];
+    snprintf(package_key, sizeof(package_key), "%s.%s", key, package_name);
+    return config_get_long(package_key, config_get_long(key, default_value));
+}
+
+void config_write_defaults(char *conf_path) {
+    FILE *fp = fopen(conf_path, "w");
+    if (!fp) return;
+
+    fprintf(fp, "# Lyra Configuration\n");
+    fprintf(fp, "# key = value, later lines override earlier ones\n\n");
+    fprintf(fp, "# Vault password key derivation (scrypt). Applied when the password is set.\n");
+    fprintf(fp, "# kdf_n must be a power of two; memory use is 128 * kdf_n * kdf_r bytes.\n");
+    fprintf(fp, "kdf_n = %d\n", VAULT_KDF_DEFAULT_N);
+    fprintf(fp, "kdf_r = %d\n", VAULT_KDF_DEFAULT_R);
+    fprintf(fp, "kdf_p = %d\n\n", VAULT_KDF_DEFAULT_P);
+    fprintf(fp, "# Seconds to keep the derived vault key in the kernel keyring after\n");
+    fprintf(fp, "# unlocking, so batch -fc/-r runs only prompt once. 0 disables caching.\n");
+    fprintf(fp, "key_agent_ttl = 0\n\n");
+    fprintf(fp, "# zstd level for frozen copies (1-19)\n");
+    fprintf(fp, "freeze_zstd_level = %d\n", LYRA_FREEZE_ZSTD_LEVEL);
+    fprintf(fp, "\n# Frozen copy store: chunked (deduplicated across versions) or archive\n");
+    fprintf(fp, "frozen_store = chunked\n");
+    fprintf(fp, "\n# lyra gc: muted versions kept per package (gc_keep_last.<pkg> overrides),\n");
+    fprintf(fp, "# max days since a version was last active, and a vault size budget in MB.\n");
+    fprintf(fp, "# 0 turns a rule off.\n");
+    fprintf(fp, "gc_keep_last = %d\n", LYRA_GC_KEEP_LAST);
+    fprintf(fp, "gc_max_age_days = 0\n");
+    fprintf(fp, "gc_max_vault_mb = 0\n");
+    fprintf(fp, "\n# Keep muted versions in the vault zstd-compressed. Set\n");
+    fprintf(fp, "# vault_compress.<pkg> = 0 for tools that must roll back instantly.\n");
+    fprintf(fp, "vault_compress = 1\n");
+    fprintf(fp, "vault_zstd_level = %d\n", LYRA_VAULT_ZSTD_LEVEL);
+    fprintf(fp, "\n# Prometheus textfile (e.g. /var/lib/node_exporter/textfile_collector/lyra.prom)\n");
+    fprintf(fp, "# rewritten after every run that installs, updates, verifies or changes the\n");
+    fprintf(fp, "# database. Empty turns it off.\n");
+    fprintf(fp, "metrics_textfile =\n");
+    fclose(fp);
+}
@@ -0,0 +1,528 @@
+#include "lyra.h"
+#include <stdint.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+
+// Frozen copy encryption format (v1)
+//
+//   header (LYRA_ENC_HEADER_SIZE bytes)
+//     magic "LYRAENC\0", format version, cipher id, kdf id, reserved byte,
+//     chunk size (u32 le), kdf iterations (u32 le), salt[16], nonce prefix[4]
+//   kdf 1: file key = PBKDF2-SHA256(password, salt)  (written before the vault key)
+//   kdf 2: file key = HMAC-SHA256(vault key, salt || "lyra-frozen")
+//   chunk records, in order
+//     plaintext length (u32 le, top bit set on the final chunk)
+//     ciphertext[length], GCM tag[16]
+//
+// Each chunk is sealed on its own with AES-256-GCM. The IV is the nonce prefix
+// followed by the chunk index, and the header plus the index and final flag go
+// in as AAD. Chunks can't be reordered, dropped or cut off without failing auth,
+// and independent chunks can be sealed or opened in parallel.
+
+#define ENC_MAGIC "LYRAENC"
+#define ENC_FORMAT_VERSION 1
+#define ENC_CIPHER_AES256GCM 1
+#define ENC_KDF_PBKDF2_SHA256 1
+#define ENC_KDF_VAULT_HMAC 2
+#define ENC_PBKDF2_ITERATIONS 200000
+#define ENC_FINAL_FLAG 0x80000000u
+#define ENC_MAX_CHUNK (64u << 20)
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+typedef struct {
+    const unsigned char *key;
+    const unsigned char *header;
+    const unsigned char *nonce_prefix;
+    uint64_t index;
+    int final;
+    const unsigned char *in;
+    unsigned char *out;
+    unsigned char *tag;
+    uint32_t len;
+    int decrypt;
+    int ok;
+} ChunkTask;
+
+static void chunk_iv_aad(ChunkTask *task, unsigned char *iv, unsigned char *aad) {
+    memcpy(iv, task->nonce_prefix, 4);
+    for (int i = 0; i < 8; i++) {
+        iv[4 + i] = (task->index >> (8 * i)) & 0xff;
+    }
+
+    memcpy(aad, task->header, LYRA_ENC_HEADER_SIZE);
+    memcpy(aad + LYRA_ENC_HEADER_SIZE, iv + 4, 8);
+    aad[LYRA_ENC_HEADER_SIZE + 8] = task->final ? 1 : 0;
+}
+
+static void chunk_crypt(void *arg) {
+    ChunkTask *task = arg;
+    unsigned char iv[12];
+    unsigned char aad[LYRA_ENC_HEADER_SIZE + 9];
+    int len = 0;
+
+    chunk_iv_aad(task, iv, aad);
+    task->ok = 0;
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) return;
+
+    if (task->decrypt) {
+        if (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, task->key, iv) == 1 &&
+            EVP_DecryptUpdate(ctx, NULL, &len, aad, sizeof(aad)) == 1 &&
+            EVP_DecryptUpdate(ctx, task->out, &len, task->in, task->len) == 1 &&
+            EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, LYRA_ENC_TAG_SIZE, task->tag) == 1 &&
+            EVP_DecryptFinal_ex(ctx, task->out + len, &len) == 1) {
+            task->ok = 1;
+        }
+    } else {
+        if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, task->key, iv) == 1 &&
+            EVP_EncryptUpdate(ctx, NULL, &len, aad, sizeof(aad)) == 1 &&
+            EVP_EncryptUpdate(ctx, task->out, &len, task->in, task->len) == 1 &&
+            EVP_EncryptFinal_ex(ctx, task->out + len, &len) == 1 &&
+            EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, LYRA_ENC_TAG_SIZE, task->tag) == 1) {
+            task->ok = 1;
+        }
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+static int derive_file_key(VaultKey *vk, int kdf, const unsigned char *salt,
+                           uint32_t iterations, unsigned char *key_out) {
+    if (kdf == ENC_KDF_PBKDF2_SHA256) {
+        // Older copies need the password itself, which a cached agent key can't provide
+        if (!vk->password[0]) return 0;
+        return PKCS5_PBKDF2_HMAC(vk->password, strlen(vk->password), salt, LYRA_ENC_SALT_SIZE,
+                                 iterations, EVP_sha256(), LYRA_KEY_SIZE, key_out) == 1;
+    }
+
+    if (kdf == ENC_KDF_VAULT_HMAC) {
+        unsigned char input[LYRA_ENC_SALT_SIZE + 11];
+        unsigned int len = 0;
+        memcpy(input, salt, LYRA_ENC_SALT_SIZE);
+        memcpy(input + LYRA_ENC_SALT_SIZE, "lyra-frozen", 11);
+        return HMAC(EVP_sha256(), vk->key, LYRA_KEY_SIZE, input, sizeof(input), key_out, &len) != NULL &&
+               len == LYRA_KEY_SIZE;
+    }
+
+    return 0;
+}
+
+static int enc_batch_chunks() {
+    int threads = pool_default_threads();
+    return threads * 2 < 4 ? 4 : threads * 2;
+}
+
+int enc_writer_open(EncWriter *w, FILE *out, VaultKey *vk) {
+    memset(w, 0, sizeof(*w));
+    w->error = 1;  // cleared once the writer is fully set up
+    w->fp = out;
+    w->chunk_size = LYRA_ENC_CHUNK_SIZE;
+    w->batch_chunks = enc_batch_chunks();
+
+    unsigned char salt[LYRA_ENC_SALT_SIZE];
+    if (RAND_bytes(salt, sizeof(salt)) != 1 || RAND_bytes(w->nonce_prefix, 4) != 1) {
+        return 0;
+    }
+
+    unsigned char *h = w->header;
+    memcpy(h, ENC_MAGIC, 8);
+    h[8] = ENC_FORMAT_VERSION;
+    h[9] = ENC_CIPHER_AES256GCM;
+    h[10] = ENC_KDF_VAULT_HMAC;
+    h[11] = 0;
+    put_u32(h + 12, w->chunk_size);
+    put_u32(h + 16, 0);
+    memcpy(h + 20, salt, LYRA_ENC_SALT_SIZE);
+    memcpy(h + 36, w->nonce_prefix, 4);
+
+    if (!derive_file_key(vk, ENC_KDF_VAULT_HMAC, salt, 0, w->key)) {
+        return 0;
+    }
+
+    // One spare chunk stays buffered so the last chunk can be flagged as final
+    w->capacity = (size_t)(w->batch_chunks + 1) * w->chunk_size;
+    w->pending = malloc(w->capacity);
+    w->sealed = malloc((size_t)w->batch_chunks * (w->chunk_size + LYRA_ENC_TAG_SIZE + 4));
+    if (!w->pending || !w->sealed) {
+        free(w->pending);
+        free(w->sealed);
+        w->pending = w->sealed = NULL;
+        return 0;
+    }
+
+    // Hash the output as it's written so callers get the file's digest for free
+    w->digest = EVP_MD_CTX_new();
+    if (!w->digest || EVP_DigestInit_ex(w->digest, EVP_sha256(), NULL) != 1) {
+        return 0;
+    }
+
+    if (fwrite(w->header, 1, LYRA_ENC_HEADER_SIZE, out) != LYRA_ENC_HEADER_SIZE) {
+        return 0;
+    }
+    EVP_DigestUpdate(w->digest, w->header, LYRA_ENC_HEADER_SIZE);
+    w->bytes_out = LYRA_ENC_HEADER_SIZE;
+
+    w->error = 0;
+    return 1;
+}
+
+// Seal the first chunk_count chunks of the pending buffer in parallel and write them in order
+static int enc_writer_seal(EncWriter *w, int chunk_count, size_t bytes, int last_is_final) {
+    ChunkTask tasks[chunk_count > 0 ? chunk_count : 1];
+    size_t record_size = w->chunk_size + LYRA_ENC_TAG_SIZE + 4;
+
+    for (int i = 0; i < chunk_count; i++) {
+        size_t offset = (size_t)i * w->chunk_size;
+        size_t len = bytes - offset < w->chunk_size ? bytes - offset : w->chunk_size;
+        unsigned char *record = w->sealed + (size_t)i * record_size;
+
+        tasks[i].key = w->key;
+        tasks[i].header = w->header;
+        tasks[i].nonce_prefix = w->nonce_prefix;
+        tasks[i].index = w->chunk_index + i;
+        tasks[i].final = last_is_final && i == chunk_count - 1;
+        tasks[i].in = w->pending + offset;
+        tasks[i].len = (uint32_t)len;
+        tasks[i].out = record + 4;
+        tasks[i].tag = record + 4 + len;
+        tasks[i].decrypt = 0;
+        tasks[i].ok = 0;
+
+        put_u32(record, (uint32_t)len | (tasks[i].final ? ENC_FINAL_FLAG : 0));
+    }
+
+    pool_run(chunk_crypt, tasks, sizeof(ChunkTask), chunk_count, 0);
+
+    for (int i = 0; i < chunk_count; i++) {
+        if (!tasks[i].ok) return 0;
+
+        unsigned char *record = w->sealed + (size_t)i * record_size;
+        size_t record_len = 4 + tasks[i].len + LYRA_ENC_TAG_SIZE;
+        if (fwrite(record, 1, record_len, w->fp) != record_len) return 0;
+        EVP_DigestUpdate(w->digest, record, record_len);
+        w->bytes_out += record_len;
+    }
+
+    w->chunk_index += chunk_count;
+    return 1;
+}
+
+int enc_writer_write(EncWriter *w, const void *data, size_t len) {
+    const unsigned char *src = data;
+
+    while (len > 0 && !w->error) {
+        size_t room = w->capacity - w->pending_len;
+        size_t take = len < room ? len : room;
+
+        memcpy(w->pending + w->pending_len, src, take);
+        w->pending_len += take;
+        src += take;
+        len -= take;
+
+        if (w->pending_len == w->capacity) {
+            size_t batch_bytes = (size_t)w->batch_chunks * w->chunk_size;
+            if (!enc_writer_seal(w, w->batch_chunks, batch_bytes, 0)) {
+                w->error = 1;
+                break;
+            }
+            memmove(w->pending, w->pending + batch_bytes, w->pending_len - batch_bytes);
+            w->pending_len -= batch_bytes;
+        }
+    }
+
+    return !w->error;
+}
+
+int enc_writer_close(EncWriter *w) {
+    if (!w->error) {
+        int chunks = (int)((w->pending_len + w->chunk_size - 1) / w->chunk_size);
+        if (chunks == 0) chunks = 1;  // empty input still gets a final chunk
+        if (!enc_writer_seal(w, chunks, w->pending_len, 1)) {
+            w->error = 1;
+        }
+    }
+
+    if (w->digest) {
+        unsigned char digest[SHA256_DIGEST_LEN];
+        unsigned int len = 0;
+        if (!w->error && EVP_DigestFinal_ex(w->digest, digest, &len) == 1) {
+            sha256_to_hex(digest, w->sha256);
+        }
+        EVP_MD_CTX_free(w->digest);
+        w->digest = NULL;
+    }
+
+    OPENSSL_cleanse(w->key, sizeof(w->key));
+    free(w->pending);
+    free(w->sealed);
+    w->pending = w->sealed = NULL;
+
+    return !w->error;
+}
+
+int dec_reader_open(DecReader *r, FILE *in, VaultKey *vk) {
+    memset(r, 0, sizeof(*r));
+    r->fp = in;
+
+    if (fread(r->header, 1, LYRA_ENC_HEADER_SIZE, in) != LYRA_ENC_HEADER_SIZE ||
+        memcmp(r->header, ENC_MAGIC, 8) != 0) {
+        return 0;
+    }
+
+    if (r->header[8] != ENC_FORMAT_VERSION || r->header[9] != ENC_CIPHER_AES256GCM) {
+        return 0;
+    }
+
+    r->chunk_size = get_u32(r->header + 12);
+    uint32_t iterations = get_u32(r->header + 16);
+    memcpy(r->nonce_prefix, r->header + 36, 4);
+
+    if (r->chunk_size == 0 || r->chunk_size > ENC_MAX_CHUNK) return 0;
+    if (!derive_file_key(vk, r->header[10], r->header + 20, iterations, r->key)) return 0;
+
+    r->batch_chunks = enc_batch_chunks();
+    size_t record_size = r->chunk_size + LYRA_ENC_TAG_SIZE;
+    r->sealed = malloc((size_t)r->batch_chunks * record_size);
+    r->plain = malloc((size_t)r->batch_chunks * r->chunk_size);
+    if (!r->sealed || !r->plain) {
+        free(r->sealed);
+        free(r->plain);
+        r->sealed = r->plain = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+// Read up to batch_chunks records and open them in parallel
+static int dec_reader_fill(DecReader *r) {
+    ChunkTask tasks[r->batch_chunks];
+    size_t record_size = r->chunk_size + LYRA_ENC_TAG_SIZE;
+    int count = 0;
+
+    while (count < r->batch_chunks && !r->saw_final) {
+        unsigned char len_buf[4];
+        if (fread(len_buf, 1, 4, r->fp) != 4) {
+            return 0;  // truncated: ran out of data before the final chunk
+        }
+
+        uint32_t raw = get_u32(len_buf);
+        uint32_t len = raw & ~ENC_FINAL_FLAG;
+        int final = (raw & ENC_FINAL_FLAG) != 0;
+        if (len > r->chunk_size) return 0;
+
+        unsigned char *record = r->sealed + (size_t)count * record_size;
+        if (fread(record, 1, len + LYRA_ENC_TAG_SIZE, r->fp) != len + LYRA_ENC_TAG_SIZE) {
+            return 0;
+        }
+
+        tasks[count].key = r->key;
+        tasks[count].header = r->header;
+        tasks[count].nonce_prefix = r->nonce_prefix;
+        tasks[count].index = r->chunk_index + count;
+        tasks[count].final = final;
+        tasks[count].in = record;
+        tasks[count].len = len;
+        tasks[count].tag = record + len;
+        tasks[count].out = r->plain + (size_t)count * r->chunk_size;
+        tasks[count].decrypt = 1;
+        tasks[count].ok = 0;
+
+        count++;
+        if (final) r->saw_final = 1;
+    }
+
+    pool_run(chunk_crypt, tasks, sizeof(ChunkTask), count, 0);
+
+    // Compact the opened chunks so callers see one contiguous buffer
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (!tasks[i].ok) return 0;
+        if (tasks[i].out != r->plain + total) {
+            memmove(r->plain + total, tasks[i].out, tasks[i].len);
+        }
+        total += tasks[i].len;
+    }
+
+    r->chunk_index += count;
+    r->plain_len = total;
+    r->plain_pos = 0;
+
+    if (r->saw_final && fgetc(r->fp) != EOF) {
+        return 0;  // trailing data after the final chunk
+    }
+
+    return 1;
+}
+
+ssize_t dec_reader_read(DecReader *r, void *buf, size_t len) {
+    if (r->error) return -1;
+
+    while (r->plain_pos == r->plain_len) {
+        if (r->saw_final) return 0;
+        if (!dec_reader_fill(r)) {
+            r->error = 1;
+            return -1;
+        }
+    }
+
+    size_t avail = r->plain_len - r->plain_pos;
+    size_t take = len < avail ? len : avail;
+    memcpy(buf, r->plain + r->plain_pos, take);
+    r->plain_pos += take;
+
+    return (ssize_t)take;
+}
+
+void dec_reader_close(DecReader *r) {
+    OPENSSL_cleanse(r->key, sizeof(r->key));
+    free(r->sealed);
+    free(r->plain);
+    r->sealed = r->plain = NULL;
+}
+
+int is_encrypted_format(char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    char magic[8];
+    int match = fread(magic, 1, 8, fp) == 8 && memcmp(magic, ENC_MAGIC, 8) == 0;
+    fclose(fp);
+
+    return match;
+}
+
+// Frozen copies made before the AEAD format were XORed with the raw password
+static int xor_decrypt_legacy(FILE *in, FILE *out, char *password) {
+    size_t key_len = strlen(password);
+    if (key_len == 0) return 0;
+
+    unsigned char buffer[65536];
+    size_t key_pos = 0;
+    size_t got;
+
+    while ((got = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        for (size_t i = 0; i < got; i++) {
+            buffer[i] ^= (unsigned char)password[key_pos];
+            key_pos = (key_pos + 1) % key_len;
+        }
+        if (fwrite(buffer, 1, got, out) != got) return 0;
+    }
+
+    return 1;
+}
+
+int encrypt_file(char *input_path, char *output_path, VaultKey *vk) {
+    FILE *in = fopen(input_path, "rb");
+    FILE *out = fopen(output_path, "wb");
+
+    if (!in || !out) {
+        printf("✗ Error: Could not open files for encryption\n");
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return 0;
+    }
+
+    EncWriter writer;
+    int ok = enc_writer_open(&writer, out, vk);
+
+    if (ok) {
+        unsigned char *buffer = malloc(LYRA_ENC_CHUNK_SIZE);
+        size_t got;
+        ok = buffer != NULL;
+        while (ok && (got = fread(buffer, 1, LYRA_ENC_CHUNK_SIZE, in)) > 0) {
+            ok = enc_writer_write(&writer, buffer, got);
+        }
+        ok = ok && !ferror(in);
+        free(buffer);
+    }
+    ok = enc_writer_close(&writer) && ok;
+
+    fclose(in);
+    if (fclose(out) != 0) ok = 0;
+
+    if (!ok) {
+        printf("✗ Error: Encryption failed\n");
+        remove(output_path);
+    }
+
+    return ok;
+}
+
+int decrypt_file(char *input_path, char *output_path, VaultKey *vk) {
+    FILE *in = fopen(input_path, "rb");
+    FILE *out = fopen(output_path, "wb");
+
+    if (!in || !out) {
+        printf("✗ Error: Could not open files for decryption\n");
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return 0;
+    }
+
+    int ok;
+    if (!is_encrypted_format(input_path)) {
+        ok = xor_decrypt_legacy(in, out, vk->password);
+    } else {
+        DecReader reader;
+        ok = dec_reader_open(&reader, in, vk);
+
+        unsigned char *buffer = malloc(LYRA_ENC_CHUNK_SIZE);
+        ssize_t got = 0;
+        ok = ok && buffer != NULL;
+        while (ok && (got = dec_reader_read(&reader, buffer, LYRA_ENC_CHUNK_SIZE)) > 0) {
+            ok = fwrite(buffer, 1, got, out) == (size_t)got;
+        }
+        ok = ok && got == 0;
+        free(buffer);
+        dec_reader_close(&reader);
+    }
+
+    fclose(in);
+    if (fclose(out) != 0) ok = 0;
+
+    if (!ok) {
+        printf("✗ Error: Frozen copy is corrupt or was not encrypted with this vault key\n");
+        if (!vk->password[0]) {
+            printf("  Copies made by older Lyra versions need the password: run 'lyra -lock' and retry\n");
+        }
+        remove(output_path);
+    }
+
+    return ok;
+}
+
+// Add the encryption parameters from a frozen file's header to a catalog entry
+void enc_describe_file(char *path, cJSON *entry) {
+    unsigned char header[LYRA_ENC_HEADER_SIZE];
+    FILE *fp = fopen(path, "rb");
+    int ok = fp && fread(header, 1, sizeof(header), fp) == sizeof(header) &&
+             memcmp(header, ENC_MAGIC, 8) == 0;
+    if (fp) fclose(fp);
+
+    if (!ok) {
+        cJSON_AddStringToObject(entry, "cipher", "xor-legacy");
+        return;
+    }
+
+    cJSON_AddStringToObject(entry, "cipher", header[9] == ENC_CIPHER_AES256GCM ? "aes-256-gcm" : "unknown");
+    cJSON_AddStringToObject(entry, "kdf", header[10] == ENC_KDF_VAULT_HMAC ? "vault-hmac-sha256" :
+                                          header[10] == ENC_KDF_PBKDF2_SHA256 ? "pbkdf2-sha256" : "unknown");
+    cJSON_AddNumberToObject(entry, "chunkSize", get_u32(header + 12));
+    if (header[10] == ENC_KDF_PBKDF2_SHA256) {
+        cJSON_AddNumberToObject(entry, "kdfIterations", get_u32(header + 16));
+    }
+}
@@ -0,0 +1,454 @@
+#define _GNU_SOURCE  // SO_PEERCRED, accept4, pipe2
+#include "lyra.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Resident daemon
+//
+// lyrad keeps the DB, the rules.conf policy table and the snapshot catalog
+// parsed in memory, watches ~/.lyra with inotify for edits made behind its
+// back, and serves a handful of commands over ~/.lyra/lyrad.sock. The lyra
+// CLI sends those commands there when the socket answers and runs them
+// itself otherwise (or always, with LYRA_NO_DAEMON=1).
+//
+// One request per connection: the client sends argv[1..] as NUL-terminated
+// strings followed by an empty one. lyrad streams the command's output
+// back, then a NUL byte and the exit status in decimal.
+
+#define LYRAD_MAX_ARGS 64
+#define LYRAD_MAX_REQUEST 16384
+
+typedef struct {
+    const char *name;
+    int needs_root;
+} DaemonCommand;
+
+static const DaemonCommand daemon_commands[] = {
+    { "-list", 0 },
+    { "-lv", 0 },
+    { "-q", 0 },
+    { "owns", 0 },
+    { "-ssl", 0 },
+    { "-i", 1 },
+    { "-m", 1 },
+    { "-um", 1 },
+};
+
+typedef struct {
+    cJSON *db;
+    struct stat db_stat;  // of the file db was parsed from
+    int inotify_fd;
+    int wd_lyra;
+    int wd_config;
+    int wd_snapshots;
+} DaemonState;
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+void lyrad_socket_path(char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/.lyra/lyrad.sock", get_user_home());
+}
+
+static const DaemonCommand *daemon_command(const char *name) {
+    for (size_t i = 0; i < sizeof(daemon_commands) / sizeof(daemon_commands[0]); i++) {
+        if (strcmp(name, daemon_commands[i].name) == 0) return &daemon_commands[i];
+    }
+    return NULL;
+}
+
+static int daemon_connect() {
+    char path[512];
+    lyrad_socket_path(path, sizeof(path));
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        data += n;
+        len -= n;
+    }
+    return 1;
+}
+
+// Client side: returns 1 when lyrad ran the command (*status_out is set),
+// 0 when the caller should run it locally
+int daemon_call(int argc, char *argv[], int *status_out) {
+    if (argc < 2 || !daemon_command(argv[1])) return 0;
+
+    // Timings describe this process, so those runs stay local
+    if (trace_requested(argc, argv)) return 0;
+
+    char *no_daemon = getenv("LYRA_NO_DAEMON");
+    if (no_daemon && strcmp(no_daemon, "0") != 0) return 0;
+
+    int fd = daemon_connect();
+    if (fd < 0) return 0;
+
+    int ok = 1;
+    for (int i = 1; ok && i < argc; i++) {
+        ok = write_all(fd, argv[i], strlen(argv[i]) + 1);
+    }
+    ok = ok && write_all(fd, "", 1);
+    if (!ok) {
+        // Nothing was run yet
+        close(fd);
+        return 0;
+    }
+    shutdown(fd, SHUT_WR);
+
+    char buffer[8192];
+    char status[16] = "";
+    size_t status_len = 0;
+    int in_status = 0;
+    ssize_t n;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        ssize_t start = 0;
+        if (!in_status) {
+            char *nul = memchr(buffer, '\0', n);
+            ssize_t out_len = nul ? nul - buffer : n;
+            fwrite(buffer, 1, out_len, stdout);
+            if (!nul) continue;
+            in_status = 1;
+            start = out_len + 1;
+        }
+        for (ssize_t i = start; i < n && status_len < sizeof(status) - 1; i++) {
+            status[status_len++] = buffer[i];
+        }
+    }
+    close(fd);
+    fflush(stdout);
+
+    if (!in_status || status_len == 0) {
+        printf("✗ Error: lyrad closed the connection before the command finished\n");
+        *status_out = 1;
+    } else {
+        status[status_len] = '\0';
+        *status_out = atoi(status);
+    }
+    return 1;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+static int same_file_state(struct stat *a, struct stat *b) {
+    return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static void db_file_state(struct stat *st) {
+    char db_path[512];
+    snprintf(db_path, sizeof(db_path), "%s/.lyra/active_packages.json", get_user_home());
+    if (stat(db_path, st) != 0) memset(st, 0, sizeof(*st));
+}
+
+// Re-parse the DB only if the file is not the one we hold
+static void daemon_refresh_db(DaemonState *state) {
+    struct stat st;
+    db_file_state(&st);
+    if (state->db && same_file_state(&st, &state->db_stat)) return;
+
+    cJSON_Delete(state->db);
+    state->db = db_read();
+    state->db_stat = st;
+    // stdout may be a client's socket right now
+    fprintf(stderr, "lyrad: loaded database (%d packages)\n", cJSON_GetArraySize(state->db));
+}
+
+static void daemon_watch(DaemonState *state) {
+    char path[512];
+    char *home = get_user_home();
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE;
+
+    snprintf(path, sizeof(path), "%s/.lyra", home);
+    state->wd_lyra = inotify_add_watch(state->inotify_fd, path, mask);
+    snprintf(path, sizeof(path), "%s/.lyra/config", home);
+    state->wd_config = inotify_add_watch(state->inotify_fd, path, mask);
+    snprintf(path, sizeof(path), "%s/.lyra/vault/snapshots", home);
+    state->wd_snapshots = inotify_add_watch(state->inotify_fd, path, mask);
+}
+
+// Apply whatever changed on disk since the last call
+static void daemon_drain_events(DaemonState *state) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int db_changed = 0;
+    int rewatch = 0;
+    ssize_t n;
+
+    while ((n = read(state->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + n;) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+                // Lost events, or a watched directory went away (lyra -clean)
+                db_changed = 1;
+                rewatch = 1;
+                policy_table_reset();
+                snapshot_catalog_invalidate();
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            if (event->wd == state->wd_lyra && strcmp(event->name, "active_packages.json") == 0) {
+                db_changed = 1;
+            } else if (event->wd == state->wd_config && strcmp(event->name, "rules.conf") == 0) {
+                policy_table_reset();
+            } else if (event->wd == state->wd_snapshots && strcmp(event->name, "catalog.json") == 0) {
+                snapshot_catalog_invalidate();
+            }
+        }
+    }
+
+    if (rewatch) daemon_watch(state);
+    if (db_changed) daemon_refresh_db(state);
+}
+
+static int read_request(int fd, char *request, size_t size, char **args, int max_args) {
+    size_t len = 0;
+    ssize_t n;
+    while (len < size && (n = read(fd, request + len, size - len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        len += n;
+        if (len >= 2 && request[len - 1] == '\0' && request[len - 2] == '\0') break;
+        if (len == 1 && request[0] == '\0') break;
+    }
+
+    int argc = 0;
+    size_t pos = 0;
+    while (pos < len && request[pos] != '\0' && argc < max_args) {
+        char *arg = request + pos;
+        size_t arg_len = strnlen(arg, len - pos);
+        if (pos + arg_len >= len) return -1;  // not NUL-terminated
+        args[argc++] = arg;
+        pos += arg_len + 1;
+    }
+    return argc;
+}
+
+typedef struct {
+    int from;
+    int to;
+    int ok;
+} DaemonRelay;
+
+// Copy command output to the client. Once a write to it times out the
+// client is taken as gone and the rest is drained and dropped, so a client
+// that stops reading costs one send timeout, not one per buffer.
+static void *daemon_relay(void *arg) {
+    DaemonRelay *relay = arg;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(relay->from, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (relay->ok) relay->ok = write_all(relay->to, buffer, n);
+    }
+    return NULL;
+}
+
+static void daemon_handle(DaemonState *state, int client_fd) {
+    char request[LYRAD_MAX_REQUEST];
+    char *argv[LYRAD_MAX_ARGS + 2];
+    argv[0] = "lyra";
+
+    // A client that connects and never finishes its request, or never reads
+    // the answer, must not wedge us
+    struct timeval timeout = { .tv_sec = 5, .tv_usec = 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    int count = read_request(client_fd, request, sizeof(request), &argv[1], LYRAD_MAX_ARGS);
+    if (count <= 0) return;
+    int argc = count + 1;
+    argv[argc] = NULL;
+
+    struct ucred peer;
+    socklen_t peer_len = sizeof(peer);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) != 0) return;
+
+    // Everything the command prints, including child processes, goes
+    // through the relay to the client
+    int out_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) return;
+    DaemonRelay relay = { .from = out_pipe[0], .to = client_fd, .ok = 1 };
+    pthread_t relay_thread;
+    if (pthread_create(&relay_thread, NULL, daemon_relay, &relay) != 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return;
+    }
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(out_pipe[1], STDOUT_FILENO);
+    close(out_pipe[1]);
+
+    int status = 1;
+    const DaemonCommand *command = daemon_command(argv[1]);
+    if (!command) {
+        printf("Error: lyrad does not serve %s\n", argv[1]);
+    } else if (command->needs_root && peer.uid != 0) {
+        printf("Error: This operation requires sudo privileges\n");
+    } else {
+        daemon_drain_events(state);
+
+        // Writers take the DB lock and re-check the file under it
+        int lock_fd = -1;
+        if (command->needs_root) {
+            lock_fd = db_lock();
+            daemon_refresh_db(state);
+        }
+
+        db_session_adopt(state->db, lock_fd);
+        status = lyra_command(argc, argv);
+        if (db_session_commit()) db_file_state(&state->db_stat);
+        state->db = db_session_release();
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);  // drops the last write end; the relay sees EOF
+    close(saved_stdout);
+    pthread_join(relay_thread, NULL);
+    close(out_pipe[0]);
+
+    char trailer[16];
+    int trailer_len = snprintf(trailer, sizeof(trailer), "%c%d", '\0', status);
+    if (relay.ok) write_all(client_fd, trailer, trailer_len);
+
+    fprintf(stderr, "lyrad: %s%s%s (uid %d) → %d\n", argv[1], argc > 2 ? " " : "", argc > 2 ? argv[2] : "",
+            (int)peer.uid, status);
+}
+
+int daemon_serve() {
+    db_init();
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/.lyra/vault/snapshots", get_user_home());
+    mkdir(path, 0755);
+
+    int probe = daemon_connect();
+    if (probe >= 0) {
+        close(probe);
+        printf("Error: lyrad is already running\n");
+        return 1;
+    }
+
+    char socket_path[512];
+    lyrad_socket_path(socket_path, sizeof(socket_path));
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("✗ Error: Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // A socket file nobody answers on is left over from a crash
+    unlink(socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 16) != 0) {
+        printf("✗ Error: Could not listen on %s: %s\n", socket_path, strerror(errno));
+        if (listen_fd >= 0) close(listen_fd);
+        return 1;
+    }
+    // Anyone may query; installs and mutes are checked against the peer uid
+    chmod(socket_path, 0666);
+
+    DaemonState state;
+    memset(&state, 0, sizeof(state));
+    state.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (state.inotify_fd < 0) {
+        printf("✗ Error: inotify unavailable: %s\n", strerror(errno));
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    daemon_watch(&state);
+
+    snapshot_catalog_keep_resident();
+    daemon_refresh_db(&state);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Commands must never wait on a terminal
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+
+    printf("✓ lyrad listening on %s\n", socket_path);
+    fflush(stdout);
+
+    while (!daemon_stop) {
+        struct pollfd fds[2] = {
+            { .fd = listen_fd, .events = POLLIN },
+            { .fd = state.inotify_fd, .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) daemon_drain_events(&state);
+
+        if (fds[0].revents & POLLIN) {
+            int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client_fd < 0) continue;
+            daemon_handle(&state, client_fd);
+            close(client_fd);
+        }
+    }
+
+    printf("→ lyrad stopping\n");
+    close(listen_fd);
+    unlink(socket_path);
+    close(state.inotify_fd);
+    cJSON_Delete(state.db);
+    return 0;
+}
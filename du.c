@@ -0,0 +1,205 @@
+#include "lyra.h"
+
+// Space accounting
+//
+// `lyra du` reads sizes that were cached when things were written instead
+// of walking the vault: "vault_bytes" on DB package and muted-version
+// entries, sizeBytes in the frozen and snapshot catalogs, and the stored
+// sizes in the chunk index. --recompute refreshes all of them from disk.
+
+typedef struct {
+    uint64_t vault;
+    uint64_t frozen;
+    int versions;
+} DuTotals;
+
+static double mb(uint64_t bytes) {
+    return bytes / 1048576.0;
+}
+
+static uint64_t cached_or_stat(cJSON *entry, char *package_name, char *version) {
+    cJSON *cached = cJSON_GetObjectItem(entry, "vault_bytes");
+    if (cJSON_IsNumber(cached)) return (uint64_t)cached->valuedouble;
+    return vault_copy_bytes(package_name, version);
+}
+
+static uint64_t frozen_bytes(cJSON *copies, char *package_name, char *version) {
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, copies) {
+        cJSON *package = cJSON_GetObjectItem(item, "package");
+        cJSON *ver = cJSON_GetObjectItem(item, "version");
+        cJSON *size = cJSON_GetObjectItem(item, "sizeBytes");
+        if (package && ver && package->valuestring && ver->valuestring &&
+            strcmp(package->valuestring, package_name) == 0 && strcmp(ver->valuestring, version) == 0) {
+            return size ? (uint64_t)size->valuedouble : 0;
+        }
+    }
+    return 0;
+}
+
+static void print_row(char *label, uint64_t vault, uint64_t frozen) {
+    printf("  %-30s %10.2f MB %10.2f MB\n", label, mb(vault), mb(frozen));
+}
+
+// Returns 0 if a catalog could not be rewritten
+static int recompute(void) {
+    int ok = 1;
+    printf("→ Recomputing sizes from disk...\n");
+
+    int lock_fd = db_lock();
+    cJSON *root = db_read();
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, root) {
+        cJSON *active = cJSON_GetObjectItem(pkg, "version");
+        if (active && active->valuestring) {
+            db_set_vault_bytes(pkg, pkg->string, active->valuestring);
+        }
+
+        cJSON *ver = NULL;
+        cJSON_ArrayForEach(ver, cJSON_GetObjectItem(pkg, "versions")) {
+            cJSON *number = cJSON_GetObjectItem(ver, "version");
+            if (number && number->valuestring) {
+                db_set_vault_bytes(ver, pkg->string, number->valuestring);
+            }
+        }
+    }
+    db_write(root);
+    cJSON_Delete(root);
+    db_unlock(lock_fd);
+
+    char catalog_path[512];
+    frozen_catalog_path(catalog_path, sizeof(catalog_path));
+    lock_fd = catalog_lock(catalog_path);
+    cJSON *catalog = frozen_catalog_rebuild();
+    if (!json_write_file_atomic(catalog_path, catalog)) {
+        printf("Warning: Could not update frozen catalog\n");
+        ok = 0;
+    }
+    cJSON_Delete(catalog);
+    catalog_unlock(lock_fd);
+
+    snapshot_catalog_path(catalog_path, sizeof(catalog_path));
+    lock_fd = catalog_lock(catalog_path);
+    catalog = snapshot_catalog_rebuild();
+    if (!json_write_file_atomic(catalog_path, catalog)) {
+        printf("Warning: Could not update snapshot catalog\n");
+        ok = 0;
+    }
+    cJSON_Delete(catalog);
+    catalog_unlock(lock_fd);
+    return ok;
+}
+
+int disk_usage(int recompute_sizes) {
+    int ok = !recompute_sizes || recompute();
+
+    cJSON *root = db_read();
+    cJSON *frozen = frozen_catalog_load();
+    cJSON *snapshots = snapshot_catalog_load();
+    cJSON *copies = cJSON_GetObjectItem(frozen, "copies");
+
+    DuTotals totals = { 0 };
+    uint64_t frozen_logical = 0;
+    uint64_t frozen_archives = 0;
+
+    printf("%-32s %13s %13s\n", "Package / version", "Vault", "Frozen");
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, root) {
+        cJSON *active = cJSON_GetObjectItem(pkg, "version");
+        cJSON *versions = cJSON_GetObjectItem(pkg, "versions");
+
+        DuTotals package = { 0 };
+        if (active && active->valuestring) {
+            package.vault += cached_or_stat(pkg, pkg->string, active->valuestring);
+            package.frozen += frozen_bytes(copies, pkg->string, active->valuestring);
+        }
+        cJSON *ver = NULL;
+        cJSON_ArrayForEach(ver, versions) {
+            cJSON *number = cJSON_GetObjectItem(ver, "version");
+            if (!number || !number->valuestring) continue;
+            package.vault += cached_or_stat(ver, pkg->string, number->valuestring);
+            package.frozen += frozen_bytes(copies, pkg->string, number->valuestring);
+        }
+
+        printf("%-32s %10.2f MB %10.2f MB\n", pkg->string, mb(package.vault), mb(package.frozen));
+
+        char label[300];
+        if (active && active->valuestring) {
+            snprintf(label, sizeof(label), "%s [active]", active->valuestring);
+            print_row(label, cached_or_stat(pkg, pkg->string, active->valuestring),
+                      frozen_bytes(copies, pkg->string, active->valuestring));
+            totals.versions++;
+        }
+        cJSON_ArrayForEach(ver, versions) {
+            cJSON *number = cJSON_GetObjectItem(ver, "version");
+            if (!number || !number->valuestring) continue;
+            print_row(number->valuestring, cached_or_stat(ver, pkg->string, number->valuestring),
+                      frozen_bytes(copies, pkg->string, number->valuestring));
+            totals.versions++;
+        }
+
+        totals.vault += package.vault;
+    }
+
+    // Frozen copies, including those of versions the DB has let go of
+    int orphans = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, copies) {
+        cJSON *package = cJSON_GetObjectItem(item, "package");
+        cJSON *version = cJSON_GetObjectItem(item, "version");
+        cJSON *size = cJSON_GetObjectItem(item, "sizeBytes");
+        cJSON *format = cJSON_GetObjectItem(item, "format");
+        uint64_t bytes = size ? (uint64_t)size->valuedouble : 0;
+
+        frozen_logical += bytes;
+        if (!format || !format->valuestring || strcmp(format->valuestring, LYRA_CHUNKED_FORMAT) != 0) {
+            frozen_archives += bytes;
+        }
+
+        if (!package || !version || !package->valuestring || !version->valuestring) continue;
+
+        cJSON *db_pkg = cJSON_GetObjectItem(root, package->valuestring);
+        int known = 0;
+        cJSON *active = cJSON_GetObjectItem(db_pkg, "version");
+        if (active && active->valuestring && strcmp(active->valuestring, version->valuestring) == 0) known = 1;
+
+        cJSON *ver = NULL;
+        cJSON_ArrayForEach(ver, cJSON_GetObjectItem(db_pkg, "versions")) {
+            cJSON *number = cJSON_GetObjectItem(ver, "version");
+            if (number && number->valuestring && strcmp(number->valuestring, version->valuestring) == 0) known = 1;
+        }
+        if (known) continue;
+
+        if (orphans++ == 0) printf("\nFrozen only:\n");
+        char label[600];
+        snprintf(label, sizeof(label), "%s@%s", package->valuestring, version->valuestring);
+        print_row(label, 0, bytes);
+    }
+
+    uint64_t chunk_bytes = chunk_store_bytes();
+    totals.frozen = frozen_archives + chunk_bytes;
+
+    uint64_t snapshot_bytes = 0;
+    int snapshot_count = 0;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(snapshots, "snapshots")) {
+        cJSON *size = cJSON_GetObjectItem(item, "sizeBytes");
+        snapshot_bytes += size ? (uint64_t)size->valuedouble : 0;
+        snapshot_count++;
+    }
+
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Vault:     %10.2f MB in %d version%s\n", mb(totals.vault), totals.versions,
+           totals.versions == 1 ? "" : "s");
+    printf("Frozen:    %10.2f MB on disk (%.2f MB across %d copies before dedup)\n",
+           mb(totals.frozen), mb(frozen_logical), cJSON_GetArraySize(copies));
+    printf("Snapshots: %10.2f MB in %d snapshot%s\n", mb(snapshot_bytes), snapshot_count,
+           snapshot_count == 1 ? "" : "s");
+    printf("Total:     %10.2f MB\n", mb(totals.vault + totals.frozen + snapshot_bytes));
+
+    cJSON_Delete(snapshots);
+    cJSON_Delete(frozen);
+    cJSON_Delete(root);
+    return ok;
+}
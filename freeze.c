@@ -0,0 +1,418 @@
+#include "lyra.h"
+#include <fcntl.h>
+#include <zstd.h>
+#include <openssl/evp.h>
+
+// Single-pass freeze: the binary is read once and streamed through
+// tar -> zstd -> AES-256-GCM straight into the frozen file. Nothing plaintext
+// touches disk, and the manifest's size and hash come out of the same pass.
+
+#define FREEZE_READ_SIZE (1 << 20)
+#define TAR_BLOCK 512
+
+static void tar_octal(char *field, size_t width, unsigned long long value) {
+    snprintf(field, width, "%0*llo", (int)(width - 1), value);
+}
+
+// ustar header for one regular file
+static void tar_header(unsigned char *block, char *name, struct stat *st) {
+    memset(block, 0, TAR_BLOCK);
+
+    strncpy((char *)block, name, 99);
+    tar_octal((char *)block + 100, 8, st->st_mode & 07777);
+    tar_octal((char *)block + 108, 8, 0);
+    tar_octal((char *)block + 116, 8, 0);
+    tar_octal((char *)block + 124, 12, (unsigned long long)st->st_size);
+    tar_octal((char *)block + 136, 12, (unsigned long long)st->st_mtime);
+    block[156] = '0';
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+    strcpy((char *)block + 265, "root");
+    strcpy((char *)block + 297, "root");
+
+    memset(block + 148, ' ', 8);
+    unsigned int sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) sum += block[i];
+    snprintf((char *)block + 148, 8, "%06o", sum);
+    block[155] = ' ';
+}
+
+typedef struct {
+    ZSTD_CCtx *cctx;
+    EncWriter *writer;
+    unsigned char *out_buf;
+    size_t out_size;
+    int error;
+} FreezeSink;
+
+// Feed bytes through zstd; whatever comes out goes to the encryptor
+static void sink_push(FreezeSink *sink, const void *data, size_t len, ZSTD_EndDirective mode) {
+    ZSTD_inBuffer input = { data, len, 0 };
+    int finished = 0;
+
+    while (!sink->error && !finished) {
+        ZSTD_outBuffer output = { sink->out_buf, sink->out_size, 0 };
+        size_t remaining = ZSTD_compressStream2(sink->cctx, &output, &input, mode);
+
+        if (ZSTD_isError(remaining)) {
+            sink->error = 1;
+            break;
+        }
+
+        if (output.pos > 0 && !enc_writer_write(sink->writer, sink->out_buf, output.pos)) {
+            sink->error = 1;
+            break;
+        }
+
+        finished = mode == ZSTD_e_end ? remaining == 0 : input.pos == input.size;
+    }
+}
+
+int freeze_stream_package(char *source_path, char *entry_name, char *frozen_path,
+                          VaultKey *vk, FreezeResult *result) {
+    memset(result, 0, sizeof(*result));
+
+    int fd = open(source_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("✗ Error: Could not read %s\n", source_path);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        printf("✗ Error: %s is not a regular file\n", source_path);
+        close(fd);
+        return 0;
+    }
+
+    // Stage next to the destination and rename once complete
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.partial", frozen_path);
+
+    int out_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "wb") : NULL;
+    if (!out) {
+        printf("✗ Error: Could not create %s\n", temp_path);
+        if (out_fd >= 0) close(out_fd);
+        close(fd);
+        return 0;
+    }
+
+    EncWriter writer;
+    FreezeSink sink = { 0 };
+    sink.writer = &writer;
+    sink.out_size = ZSTD_CStreamOutSize();
+    sink.out_buf = malloc(sink.out_size);
+    sink.cctx = ZSTD_createCCtx();
+
+    unsigned char *buffer = malloc(FREEZE_READ_SIZE);
+    EVP_MD_CTX *binary_digest = EVP_MD_CTX_new();
+
+    int ok = enc_writer_open(&writer, out, vk) && sink.out_buf && sink.cctx && buffer &&
+             binary_digest && EVP_DigestInit_ex(binary_digest, EVP_sha256(), NULL) == 1;
+
+    if (ok) {
+        int level = (int)config_get_long("freeze_zstd_level", LYRA_FREEZE_ZSTD_LEVEL);
+        ZSTD_CCtx_setParameter(sink.cctx, ZSTD_c_compressionLevel, level);
+        ZSTD_CCtx_setParameter(sink.cctx, ZSTD_c_checksumFlag, 1);
+        // Ignored (returns an error) when libzstd was built without threads. Bulk
+        // freezes already run one package per worker, so stay single-threaded there.
+        int workers = pool_in_worker() ? 0 : pool_default_threads();
+        ZSTD_CCtx_setParameter(sink.cctx, ZSTD_c_nbWorkers, workers);
+
+        unsigned char block[TAR_BLOCK];
+        tar_header(block, entry_name, &st);
+        sink_push(&sink, block, TAR_BLOCK, ZSTD_e_continue);
+
+        ssize_t got = 0;
+        unsigned long long total = 0;
+        while (!sink.error && (got = read(fd, buffer, FREEZE_READ_SIZE)) > 0) {
+            EVP_DigestUpdate(binary_digest, buffer, got);
+            sink_push(&sink, buffer, got, ZSTD_e_continue);
+            total += got;
+        }
+
+        if (got < 0 || total != (unsigned long long)st.st_size) {
+            ok = 0;  // file changed size underneath us
+        }
+
+        // Pad the entry to a block boundary, then the two-block end-of-archive marker
+        memset(block, 0, TAR_BLOCK);
+        size_t pad = (TAR_BLOCK - (total % TAR_BLOCK)) % TAR_BLOCK;
+        if (pad > 0) sink_push(&sink, block, pad, ZSTD_e_continue);
+        sink_push(&sink, block, TAR_BLOCK, ZSTD_e_continue);
+        sink_push(&sink, block, TAR_BLOCK, ZSTD_e_end);
+
+        result->input_bytes = total;
+    }
+
+    ok = ok && !sink.error;
+    ok = enc_writer_close(&writer) && ok;
+
+    if (ok) {
+        unsigned char digest[SHA256_DIGEST_LEN];
+        unsigned int len = 0;
+        EVP_DigestFinal_ex(binary_digest, digest, &len);
+        sha256_to_hex(digest, result->binary_sha256);
+
+        memcpy(result->sha256, writer.sha256, SHA256_HEX_LEN);
+        result->size_bytes = writer.bytes_out;
+    }
+
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0) ok = 0;
+    if (fclose(out) != 0) ok = 0;
+    close(fd);
+
+    EVP_MD_CTX_free(binary_digest);
+    ZSTD_freeCCtx(sink.cctx);
+    free(sink.out_buf);
+    free(buffer);
+
+    if (!ok || rename(temp_path, frozen_path) != 0) {
+        printf("✗ Error: Failed to write frozen copy\n");
+        remove(temp_path);
+        return 0;
+    }
+
+    chmod(frozen_path, 0400);
+    return 1;
+}
+
+// Find a frozen copy: FROZEN_ARCHIVE with the .tar.zst.enc (or older
+// .tar.gz.enc) path, FROZEN_CHUNKED with the manifest path, or 0
+int frozen_copy_path(char *package_name, char *version, char *path_out, size_t size) {
+    char *home = get_user_home();
+
+    snprintf(path_out, size, "%s/.lyra/vault/frozen/%s/%s/%s-%s.tar.zst.enc",
+             home, package_name, version, package_name, version);
+    if (access(path_out, F_OK) == 0) return FROZEN_ARCHIVE;
+
+    snprintf(path_out, size, "%s/.lyra/vault/frozen/%s/%s/%s-%s.tar.gz.enc",
+             home, package_name, version, package_name, version);
+    if (access(path_out, F_OK) == 0) return FROZEN_ARCHIVE;
+
+    snprintf(path_out, size, "%s/.lyra/vault/frozen/%s/%s/manifest.json",
+             home, package_name, version);
+    cJSON *manifest = json_read_file(path_out);
+    int chunked = cJSON_IsArray(cJSON_GetObjectItem(manifest, "chunks"));
+    cJSON_Delete(manifest);
+
+    return chunked ? FROZEN_CHUNKED : 0;
+}
+
+// Staged writes: the file is built next to its destination and renamed over
+// it only once complete, so a failed restore never leaves a broken binary
+FILE *staged_open(char *dest_path, char *staged_out, size_t size) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", dest_path);
+    char *slash = strrchr(dir, '/');
+    char *base = slash ? slash + 1 : dir;
+
+    if (slash) {
+        *slash = '\0';
+        snprintf(staged_out, size, "%s/.%s.lyra-restore.%d", dir, base, (int)getpid());
+    } else {
+        snprintf(staged_out, size, ".%s.lyra-restore.%d", base, (int)getpid());
+    }
+
+    int fd = open(staged_out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0700);
+    FILE *fp = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!fp && fd >= 0) close(fd);
+    return fp;
+}
+
+int staged_commit(FILE *fp, char *staged_path, char *dest_path, mode_t mode, int ok) {
+    if (fp) {
+        ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0 && ok;
+        ok = fclose(fp) == 0 && ok;
+    }
+
+    ok = ok && chmod(staged_path, mode) == 0 && rename(staged_path, dest_path) == 0;
+    if (!ok) remove(staged_path);
+
+    return ok;
+}
+
+// Pulls one named regular file out of a tar stream fed in arbitrary pieces
+typedef struct {
+    char *entry_name;
+    FILE *out;
+    EVP_MD_CTX *digest;
+    unsigned char header[TAR_BLOCK];
+    size_t header_fill;
+    unsigned long long remaining;
+    size_t skip;
+    size_t pad;
+    int writing;
+    int found;
+    int done;
+    int error;
+    mode_t mode;
+} TarReader;
+
+static unsigned long long tar_parse_octal(const unsigned char *field, size_t width) {
+    unsigned long long value = 0;
+    for (size_t i = 0; i < width && field[i]; i++) {
+        if (field[i] == ' ') continue;
+        if (field[i] < '0' || field[i] > '7') break;
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+static void tar_reader_header(TarReader *tar) {
+    unsigned char *h = tar->header;
+
+    int empty = 1;
+    for (int i = 0; i < TAR_BLOCK && empty; i++) {
+        if (h[i]) empty = 0;
+    }
+    if (empty) {
+        tar->done = 1;
+        return;
+    }
+
+    unsigned int sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : h[i];
+    }
+    if (sum != tar_parse_octal(h + 148, 8)) {
+        tar->error = 1;
+        return;
+    }
+
+    char name[101];
+    memcpy(name, h, 100);
+    name[100] = '\0';
+    char *short_name = strncmp(name, "./", 2) == 0 ? name + 2 : name;
+
+    tar->remaining = tar_parse_octal(h + 124, 12);
+    tar->pad = (TAR_BLOCK - (tar->remaining % TAR_BLOCK)) % TAR_BLOCK;
+    tar->writing = !tar->found && (h[156] == '0' || h[156] == '\0') &&
+                   strcmp(short_name, tar->entry_name) == 0;
+
+    if (tar->writing) {
+        tar->found = 1;
+        tar->mode = (mode_t)(tar_parse_octal(h + 100, 8) & 0777);
+    }
+    if (tar->remaining == 0) {
+        tar->writing = 0;
+        tar->skip = tar->pad;
+    }
+}
+
+static void tar_reader_feed(TarReader *tar, const unsigned char *data, size_t len) {
+    while (len > 0 && !tar->done && !tar->error) {
+        size_t n;
+
+        if (tar->remaining > 0) {
+            n = len < tar->remaining ? len : (size_t)tar->remaining;
+            if (tar->writing && (fwrite(data, 1, n, tar->out) != n ||
+                                 EVP_DigestUpdate(tar->digest, data, n) != 1)) {
+                tar->error = 1;
+                return;
+            }
+            tar->remaining -= n;
+            if (tar->remaining == 0) {
+                tar->writing = 0;
+                tar->skip = tar->pad;
+            }
+        } else if (tar->skip > 0) {
+            n = len < tar->skip ? len : tar->skip;
+            tar->skip -= n;
+        } else {
+            n = TAR_BLOCK - tar->header_fill;
+            if (n > len) n = len;
+            memcpy(tar->header + tar->header_fill, data, n);
+            tar->header_fill += n;
+            if (tar->header_fill == TAR_BLOCK) {
+                tar->header_fill = 0;
+                tar_reader_header(tar);
+            }
+        }
+
+        data += n;
+        len -= n;
+    }
+}
+
+// Inverse of freeze_stream_package: read the frozen file once and stream it
+// through AES-GCM -> zstd -> tar into a staged copy of dest_path, checked
+// against expected_sha256 (when given) before it's renamed into place
+int freeze_extract_package(char *frozen_path, char *entry_name, char *dest_path,
+                           VaultKey *vk, char *expected_sha256) {
+    FILE *in = fopen(frozen_path, "rb");
+    if (!in) {
+        printf("✗ Error: Could not read %s\n", frozen_path);
+        return 0;
+    }
+
+    char staged_path[1024];
+    FILE *out = staged_open(dest_path, staged_path, sizeof(staged_path));
+    if (!out) {
+        printf("✗ Error: Could not write to %s\n", dest_path);
+        fclose(in);
+        return 0;
+    }
+
+    DecReader reader;
+    TarReader tar;
+    memset(&tar, 0, sizeof(tar));
+    tar.entry_name = entry_name;
+    tar.out = out;
+    tar.digest = EVP_MD_CTX_new();
+
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    size_t out_size = ZSTD_DStreamOutSize();
+    unsigned char *plain = malloc(FREEZE_READ_SIZE);
+    unsigned char *unpacked = malloc(out_size);
+
+    int reader_open = dec_reader_open(&reader, in, vk);
+    int ok = reader_open && dctx && plain && unpacked && tar.digest &&
+             EVP_DigestInit_ex(tar.digest, EVP_sha256(), NULL) == 1;
+
+    ssize_t got = 0;
+    size_t last = 0;
+    while (ok && (got = dec_reader_read(&reader, plain, FREEZE_READ_SIZE)) > 0) {
+        ZSTD_inBuffer input = { plain, (size_t)got, 0 };
+        while (ok && input.pos < input.size) {
+            ZSTD_outBuffer output = { unpacked, out_size, 0 };
+            last = ZSTD_decompressStream(dctx, &output, &input);
+            if (ZSTD_isError(last)) {
+                ok = 0;
+                break;
+            }
+            tar_reader_feed(&tar, unpacked, output.pos);
+            ok = !tar.error;
+        }
+    }
+    // Read to the end even after the entry is out, so the last GCM chunk and
+    // the zstd frame checksum are both verified
+    ok = ok && got == 0 && last == 0 && tar.found && tar.remaining == 0;
+
+    if (ok && expected_sha256 && expected_sha256[0]) {
+        unsigned char digest[SHA256_DIGEST_LEN];
+        char hex[SHA256_HEX_LEN];
+        unsigned int len = 0;
+        ok = EVP_DigestFinal_ex(tar.digest, digest, &len) == 1;
+        sha256_to_hex(digest, hex);
+        ok = ok && strcmp(hex, expected_sha256) == 0;
+    }
+
+    if (reader_open) dec_reader_close(&reader);
+    fclose(in);
+    EVP_MD_CTX_free(tar.digest);
+    ZSTD_freeDCtx(dctx);
+    free(plain);
+    free(unpacked);
+
+    if (!staged_commit(out, staged_path, dest_path, tar.mode ? tar.mode : 0755, ok)) {
+        printf("✗ Error: Frozen copy is corrupt or was not encrypted with this vault key\n");
+        if (!vk->password[0]) {
+            printf("  Copies made by older Lyra versions need the password: run 'lyra -lock' and retry\n");
+        }
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include "lyra.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+
+// Filesystem helpers
+//
+// Native versions of the mkdir -p, rm -rf, cp + chmod +x and find calls
+// lyra used to shell out for. What still needs an external program (curl, tar)
+// goes through lyra_system() and lyra_popen(), which count each spawn;
+// LYRA_DEBUG_SPAWNS=1 prints the count for every command on stderr.
+
+static int spawns = 0;
+
+int lyra_system(const char *command) {
+    __atomic_fetch_add(&spawns, 1, __ATOMIC_RELAXED);
+    return system(command);
+}
+
+FILE *lyra_popen(const char *command, const char *mode) {
+    __atomic_fetch_add(&spawns, 1, __ATOMIC_RELAXED);
+    return popen(command, mode);
+}
+
+int spawn_count() {
+    return __atomic_load_n(&spawns, __ATOMIC_RELAXED);
+}
+
+// Print and reset the count after each command
+void spawn_report() {
+    char *debug = getenv("LYRA_DEBUG_SPAWNS");
+    int count = __atomic_exchange_n(&spawns, 0, __ATOMIC_RELAXED);
+    if (debug && debug[0] && strcmp(debug, "0") != 0) {
+        fflush(stdout);
+        fprintf(stderr, "lyra: %d external process%s spawned\n", count, count == 1 ? "" : "es");
+    }
+}
+
+// mkdir -p; existing directories are fine
+int fs_mkdirs(const char *path, mode_t mode) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", path);
+
+    for (char *p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(buf, mode) != 0 && errno != EEXIST) return 0;
+        *p = '/';
+    }
+    return mkdir(buf, mode) == 0 || errno == EEXIST;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+// rm -rf; a missing path counts as removed
+int fs_remove_tree(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return errno == ENOENT;
+    return nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+// Copy src over dest with the given mode. dest is staged next to itself and
+// renamed into place, so a running binary can be replaced.
+int fs_copy_file(const char *src, const char *dest, mode_t mode) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return 0;
+
+    char staged_path[1100];
+    FILE *out = staged_open((char *)dest, staged_path, sizeof(staged_path));
+    int ok = out != NULL;
+    int out_fd = out ? fileno(out) : -1;
+
+    // copy_file_range stays in the kernel; fall back to read/write across
+    // filesystems that don't support it
+    int native = 1;
+    while (ok) {
+        ssize_t n = native ? copy_file_range(in, NULL, out_fd, NULL, 1 << 20, 0) : -1;
+        if (n < 0 && native && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+            native = 0;
+            continue;
+        }
+        if (native) {
+            if (n < 0) ok = 0;
+            if (n <= 0) break;
+            continue;
+        }
+
+        char buffer[65536];
+        n = read(in, buffer, sizeof(buffer));
+        if (n < 0) ok = 0;
+        if (n <= 0) break;
+        for (ssize_t done = 0; ok && done < n;) {
+            ssize_t written = write(out_fd, buffer + done, n - done);
+            if (written <= 0) ok = 0;
+            else done += written;
+        }
+    }
+    close(in);
+
+    return staged_commit(out, staged_path, (char *)dest, mode, ok);
+}
+
+// Call fn on every regular file under root, depth first in directory order,
+// without following symlinks. Stops at and returns fn's first nonzero result.
+int fs_walk(const char *root, fs_walk_fn fn, void *ctx) {
+    DIR *dir = opendir(root);
+    if (!dir) return 0;
+
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+
+        struct stat st;
+        if (lstat(path, &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            result = fs_walk(path, fn, ctx);
+        } else if (S_ISREG(st.st_mode)) {
+            result = fn(path, &st, ctx);
+        }
+    }
+
+    closedir(dir);
+    return result;
+}
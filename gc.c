@@ -0,0 +1,301 @@
+#include "lyra.h"
+
+// Vault garbage collection
+//
+// Muted versions pile up under vault/<pkg>/<ver>/. `lyra gc` drops them by
+// three rules, applied in order:
+//   keep-last N  per package, by last activation (gc_keep_last[.<pkg>])
+//   max age      last activated more than D days ago (gc_max_age_days)
+//   byte budget  whole vault, evicting the least recently active version
+//                first until it fits (gc_max_vault_mb)
+// The active version is never touched. The DB `versions` arrays are kept in
+// step with the disk: vault dirs of an installed package that no version
+// points to are removed, and muted entries whose vault copy is gone are
+// dropped.
+
+typedef struct {
+    char package[256];
+    char version[256];
+    char dir[1024];
+    time_t last_active;
+    uint64_t bytes;
+    int in_db;
+    int on_disk;
+    const char *reason;  // set when the item is evicted
+} GcItem;
+
+typedef struct {
+    GcItem *items;
+    int count;
+    int capacity;
+} GcList;
+
+static GcItem *gc_add(GcList *list, const char *package, const char *version) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        GcItem *grown = realloc(list->items, capacity * sizeof(GcItem));
+        if (!grown) return NULL;
+        list->items = grown;
+        list->capacity = capacity;
+    }
+
+    GcItem *item = &list->items[list->count++];
+    memset(item, 0, sizeof(*item));
+    snprintf(item->package, sizeof(item->package), "%s", package);
+    snprintf(item->version, sizeof(item->version), "%s", version);
+    snprintf(item->dir, sizeof(item->dir), "%s/.lyra/vault/%s/%s", get_user_home(), package, version);
+    return item;
+}
+
+static GcItem *gc_find(GcList *list, const char *package, const char *version) {
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].package, package) == 0 && strcmp(list->items[i].version, version) == 0) {
+            return &list->items[i];
+        }
+    }
+    return NULL;
+}
+
+// DB timestamps are local "%Y-%m-%dT%H:%M:%S"
+static time_t parse_timestamp(cJSON *value) {
+    if (!value || !value->valuestring) return 0;
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(value->valuestring, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+static uint64_t dir_bytes(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+
+    uint64_t total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char file_path[1536];
+        struct stat st;
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+        if (lstat(file_path, &st) == 0 && S_ISREG(st.st_mode)) total += st.st_size;
+    }
+    closedir(dir);
+    return total;
+}
+
+static int by_recent_first(const void *a, const void *b) {
+    const GcItem *x = *(GcItem * const *)a;
+    const GcItem *y = *(GcItem * const *)b;
+    return (y->last_active > x->last_active) - (y->last_active < x->last_active);
+}
+
+static long keep_last_for(const char *package, long keep_last) {
+    char key[300];
+    snprintf(key, sizeof(key), "gc_keep_last.%s", package);
+    return config_get_long(key, keep_last);
+}
+
+// keep_last, max_age_days and max_bytes < 0 mean "use lyra.conf"; 0 disables
+// that rule
+int vault_gc(long keep_last, long max_age_days, long long max_bytes, int dry_run) {
+    if (keep_last < 0) keep_last = config_get_long("gc_keep_last", LYRA_GC_KEEP_LAST);
+    if (max_age_days < 0) max_age_days = config_get_long("gc_max_age_days", 0);
+    if (max_bytes < 0) max_bytes = config_get_long("gc_max_vault_mb", 0) * 1048576LL;
+
+    char *home = get_user_home();
+    time_t now = time(NULL);
+
+    int lock_fd = db_lock();
+    cJSON *root = db_read();
+    GcList list = { 0 };
+    uint64_t active_bytes = 0;
+
+    // Muted versions the DB knows about
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, root) {
+        cJSON *active = cJSON_GetObjectItem(pkg, "version");
+        cJSON *version = NULL;
+        cJSON_ArrayForEach(version, cJSON_GetObjectItem(pkg, "versions")) {
+            cJSON *number = cJSON_GetObjectItem(version, "version");
+            if (!number || !number->valuestring || gc_find(&list, pkg->string, number->valuestring)) continue;
+
+            GcItem *item = gc_add(&list, pkg->string, number->valuestring);
+            if (!item) break;
+            item->in_db = 1;
+            if (active && active->valuestring && strcmp(active->valuestring, item->version) == 0) {
+                item->reason = "same as active version";
+            }
+            item->last_active = parse_timestamp(cJSON_GetObjectItem(version, "last_active"));
+            if (!item->last_active) {
+                item->last_active = parse_timestamp(cJSON_GetObjectItem(version, "installed_date"));
+            }
+        }
+    }
+
+    // What is actually in the vault
+    char vault_dir[512];
+    snprintf(vault_dir, sizeof(vault_dir), "%s/.lyra/vault", home);
+    DIR *dir = opendir(vault_dir);
+    struct dirent *pkg_entry;
+    while (dir && (pkg_entry = readdir(dir)) != NULL) {
+        if (pkg_entry->d_name[0] == '.') continue;
+        if (strcmp(pkg_entry->d_name, "frozen") == 0 || strcmp(pkg_entry->d_name, "snapshots") == 0) continue;
+
+        char pkg_dir[1024];
+        snprintf(pkg_dir, sizeof(pkg_dir), "%s/%s", vault_dir, pkg_entry->d_name);
+        DIR *versions = opendir(pkg_dir);
+        if (!versions) continue;
+
+        // -rmpkg keeps the vault copies of removed packages on purpose
+        cJSON *db_pkg = cJSON_GetObjectItem(root, pkg_entry->d_name);
+        cJSON *active = cJSON_GetObjectItem(db_pkg, "version");
+        if (!db_pkg) {
+            closedir(versions);
+            continue;
+        }
+
+        struct dirent *ver_entry;
+        while ((ver_entry = readdir(versions)) != NULL) {
+            if (ver_entry->d_name[0] == '.') continue;
+
+            char ver_dir[1536];
+            struct stat st;
+            snprintf(ver_dir, sizeof(ver_dir), "%s/%s", pkg_dir, ver_entry->d_name);
+            if (stat(ver_dir, &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+
+            if (active && active->valuestring && strcmp(active->valuestring, ver_entry->d_name) == 0) {
+                active_bytes += dir_bytes(ver_dir);
+                continue;
+            }
+
+            GcItem *item = gc_find(&list, pkg_entry->d_name, ver_entry->d_name);
+            if (!item) {
+                item = gc_add(&list, pkg_entry->d_name, ver_entry->d_name);
+                if (!item) continue;
+                item->last_active = st.st_mtime;
+                item->reason = "not in database";
+            }
+            item->on_disk = 1;
+            item->bytes = dir_bytes(ver_dir);
+            if (!item->last_active) item->last_active = st.st_mtime;
+        }
+        closedir(versions);
+    }
+    if (dir) closedir(dir);
+
+    GcItem **order = malloc((list.count > 0 ? list.count : 1) * sizeof(GcItem *));
+    int candidates = 0;
+    for (int i = 0; i < list.count; i++) {
+        GcItem *item = &list.items[i];
+        if (item->in_db && !item->on_disk && !item->reason) {
+            item->reason = "vault copy missing";
+        } else if (!item->reason) {
+            order[candidates++] = item;
+        }
+    }
+    qsort(order, candidates, sizeof(GcItem *), by_recent_first);
+
+    // Keep-last-N and max age
+    for (int i = 0; i < candidates; i++) {
+        GcItem *item = order[i];
+        long keep = keep_last_for(item->package, keep_last);
+
+        int newer = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(order[j]->package, item->package) == 0) newer++;
+        }
+
+        if (keep > 0 && newer >= keep) {
+            item->reason = "beyond keep-last";
+        } else if (max_age_days > 0 && now - item->last_active > max_age_days * 86400L) {
+            item->reason = "past max age";
+        }
+    }
+
+    // Byte budget, oldest activation first
+    uint64_t kept_bytes = active_bytes;
+    for (int i = 0; i < candidates; i++) {
+        if (!order[i]->reason) kept_bytes += order[i]->bytes;
+    }
+    for (int i = candidates - 1; i >= 0 && max_bytes > 0 && kept_bytes > (uint64_t)max_bytes; i--) {
+        if (order[i]->reason) continue;
+        order[i]->reason = "over size budget";
+        kept_bytes -= order[i]->bytes;
+    }
+    free(order);
+
+    // Report, then apply: DB first so it never points at a removed copy
+    char age[32] = "off";
+    char budget[32] = "off";
+    if (max_age_days > 0) snprintf(age, sizeof(age), "%ld days", max_age_days);
+    if (max_bytes > 0) snprintf(budget, sizeof(budget), "%.2f MB", max_bytes / 1048576.0);
+    printf("→ %sVault garbage collection (keep-last %ld, max age %s, budget %s)\n",
+           dry_run ? "Dry run: " : "", keep_last, age, budget);
+
+    int evicted = 0;
+    int failed = 0;
+    uint64_t freed = 0;
+    for (int i = 0; i < list.count; i++) {
+        GcItem *item = &list.items[i];
+        if (!item->reason) continue;
+
+        char date[32] = "unknown";
+        if (item->last_active) {
+            strftime(date, sizeof(date), "%Y-%m-%d", localtime(&item->last_active));
+        }
+        printf("  %s %s@%s  %.2f MB, last active %s  (%s)\n", dry_run ? "would remove" : "✗",
+               item->package, item->version, item->bytes / 1048576.0, date, item->reason);
+        evicted++;
+        freed += item->bytes;
+
+        cJSON *versions = cJSON_GetObjectItem(cJSON_GetObjectItem(root, item->package), "versions");
+        for (int j = cJSON_GetArraySize(versions) - 1; !dry_run && j >= 0; j--) {
+            cJSON *number = cJSON_GetObjectItem(cJSON_GetArrayItem(versions, j), "version");
+            if (number && number->valuestring && strcmp(number->valuestring, item->version) == 0) {
+                cJSON_DeleteItemFromArray(versions, j);
+            }
+        }
+    }
+
+    if (!dry_run && evicted > 0) {
+        db_write(root);
+
+        for (int i = 0; i < list.count; i++) {
+            if (!list.items[i].reason || !list.items[i].on_disk) continue;
+
+            if (!fs_remove_tree(list.items[i].dir)) {
+                printf("Warning: Could not remove %s\n", list.items[i].dir);
+                failed++;
+            }
+        }
+
+        // Drop package dirs left empty
+        for (int i = 0; i < list.count; i++) {
+            if (!list.items[i].reason) continue;
+
+            char pkg_dir[1024];
+            snprintf(pkg_dir, sizeof(pkg_dir), "%s/%s", vault_dir, list.items[i].package);
+            rmdir(pkg_dir);
+        }
+    }
+
+    cJSON_Delete(root);
+    db_unlock(lock_fd);
+    free(list.items);
+
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    if (evicted == 0) {
+        printf("✓ Nothing to collect (vault: %.2f MB)\n", kept_bytes / 1048576.0);
+    } else {
+        printf("%s %d version%s, %.2f MB (vault after: %.2f MB)\n", dry_run ? "Would remove" : "✓ Removed",
+               evicted, evicted == 1 ? "" : "s", freed / 1048576.0, kept_bytes / 1048576.0);
+    }
+    return failed == 0;
+}
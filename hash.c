@@ -0,0 +1,128 @@
+#include "lyra.h"
+#include <fcntl.h>
+#include <openssl/evp.h>
+
+#define HASH_BUFFER_SIZE (1 << 20)
+
+void sha256_to_hex(const unsigned char *digest, char *hex_out) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        hex_out[i * 2] = digits[digest[i] >> 4];
+        hex_out[i * 2 + 1] = digits[digest[i] & 0x0f];
+    }
+    hex_out[SHA256_DIGEST_LEN * 2] = '\0';
+}
+
+// SHA-256 of a whole file. OpenSSL picks the SHA-NI / AVX2 kernel at runtime.
+int sha256_file(const char *path, char *hex_out) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    unsigned char *buffer = malloc(HASH_BUFFER_SIZE);
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (!buffer || !ctx || EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
+        free(buffer);
+        EVP_MD_CTX_free(ctx);
+        close(fd);
+        return 0;
+    }
+
+    int ok = 1;
+    ssize_t got;
+    while ((got = read(fd, buffer, HASH_BUFFER_SIZE)) > 0) {
+        if (EVP_DigestUpdate(ctx, buffer, got) != 1) {
+            ok = 0;
+            break;
+        }
+    }
+    if (got < 0) ok = 0;
+
+    unsigned char digest[SHA256_DIGEST_LEN];
+    unsigned int digest_len = 0;
+    if (ok && EVP_DigestFinal_ex(ctx, digest, &digest_len) == 1) {
+        sha256_to_hex(digest, hex_out);
+    } else {
+        ok = 0;
+    }
+
+    EVP_MD_CTX_free(ctx);
+    free(buffer);
+    close(fd);
+
+    return ok;
+}
+
+// Copy in to out while hashing, so a download is checked in the same pass
+// that writes it
+int sha256_copy_stream(FILE *in, FILE *out, char *hex_out) {
+    unsigned char *buffer = malloc(HASH_BUFFER_SIZE);
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    int ok = buffer && ctx && EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1;
+
+    size_t got;
+    while (ok && (got = fread(buffer, 1, HASH_BUFFER_SIZE, in)) > 0) {
+        ok = EVP_DigestUpdate(ctx, buffer, got) == 1 && fwrite(buffer, 1, got, out) == got;
+    }
+    ok = ok && !ferror(in);
+
+    unsigned char digest[SHA256_DIGEST_LEN];
+    unsigned int digest_len = 0;
+    ok = ok && EVP_DigestFinal_ex(ctx, digest, &digest_len) == 1;
+    if (ok) sha256_to_hex(digest, hex_out);
+
+    EVP_MD_CTX_free(ctx);
+    free(buffer);
+    return ok;
+}
+
+// Accept a 64-digit hex SHA-256 in either case; hex_out gets it lowercased
+int sha256_hex_parse(const char *text, char *hex_out) {
+    if (!text || strlen(text) != SHA256_DIGEST_LEN * 2) return 0;
+
+    for (int i = 0; i < SHA256_DIGEST_LEN * 2; i++) {
+        char c = text[i];
+        if (c >= 'A' && c <= 'F') c += 'a' - 'A';
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return 0;
+        hex_out[i] = c;
+    }
+    hex_out[SHA256_DIGEST_LEN * 2] = '\0';
+    return 1;
+}
+
+// Byte-compare two files, bailing out on the first size or content difference
+int files_identical(const char *path_a, const char *path_b) {
+    struct stat st_a, st_b;
+    if (stat(path_a, &st_a) != 0 || stat(path_b, &st_b) != 0) return 0;
+    if (st_a.st_size != st_b.st_size) return 0;
+    if (st_a.st_dev == st_b.st_dev && st_a.st_ino == st_b.st_ino) return 1;
+
+    int fd_a = open(path_a, O_RDONLY | O_CLOEXEC);
+    int fd_b = open(path_b, O_RDONLY | O_CLOEXEC);
+    unsigned char *buf_a = malloc(HASH_BUFFER_SIZE);
+    unsigned char *buf_b = malloc(HASH_BUFFER_SIZE);
+
+    int same = fd_a >= 0 && fd_b >= 0 && buf_a && buf_b;
+    while (same) {
+        ssize_t got_a = read(fd_a, buf_a, HASH_BUFFER_SIZE);
+        if (got_a <= 0) {
+            same = got_a == 0;
+            break;
+        }
+
+        ssize_t got_b = 0;
+        while (got_b < got_a) {
+            ssize_t n = read(fd_b, buf_b + got_b, got_a - got_b);
+            if (n <= 0) break;
+            got_b += n;
+        }
+
+        same = got_b == got_a && memcmp(buf_a, buf_b, got_a) == 0;
+    }
+
+    if (fd_a >= 0) close(fd_a);
+    if (fd_b >= 0) close(fd_b);
+    free(buf_a);
+    free(buf_b);
+
+    return same;
+}
@@ -17,53 +17,70 @@
 #include <pwd.h>
 #include <termios.h>
 #include <libgen.h>
+#include <pthread.h>
+#include "lyra.h"
 
 // Forward declarations
-void install_package(char *package_name, char *url);
-void remove_package(char *package_name);
+static void db_get_list(cJSON *package, const char *key, char *out, size_t size);
+static int db_has_extra_binaries(cJSON *package);
+int install_package(char *package_name, char *url, char *expected_sha256, char *binaries, char *depends);
+int remove_package(char *package_name);
 int extract_github_repo(char *url, char *owner, char *repo);
 int get_latest_github_release(char *owner, char *repo, char *url_out, char *version_out);
 void extract_version_from_url(char *url, char *version_out);
 void backup_to_vault(char *package_name, char *version);
-void find_and_install_binary(char *extract_dir, char *package_name);
+int find_and_install_binary(char *extract_dir, char *package_name, char *binaries, cJSON *files);
 void uninstall_lyra();
-void take_snapshot();
+int take_snapshot();
 void list_snapshots();
-void restore_snapshot(char *date, int number);
-void mute_package(char *arg);
-void unmute_package(char *package_name);
+int restore_snapshot(char *date, int number);
+int mute_package(char *arg);
+int unmute_package(char *package_name);
 void clean_everything();
-void update_packages();
+int update_packages();
 
 // Database functions
 void db_init();
 cJSON* db_read();
 void db_write(cJSON *root);
-void db_add_package(char *name, char *version, char *url);
+void db_add_package(char *name, char *version, char *url, char *sha256, char *binaries, char *depends,
+                    cJSON *files);
 void db_remove_package(char *name);
 void db_list_packages();
-void list_versions(char *package_name);
+int list_versions(char *package_name);
 
 // NEW: Freeze-copy and encryption functions
 void vault_password_setup();
 int vault_password_verify(char *password);
 void vault_password_prompt(char *password, int is_setup);
-void freeze_copy_package(char *package_name);
+int freeze_copy_package(char *package_name);
 void list_frozen_copies();
-void restore_frozen_copy(char *package_spec);
-void cleanup_old_frozen_copies();
-void encrypt_file(char *input_path, char *output_path, char *password);
-void decrypt_file(char *input_path, char *output_path, char *password);
-void create_manifest(char *package_name, char *version, char *binary_path, char *frozen_path);
+int restore_frozen_copy(char *package_spec);
+int freeze_copy_packages(char **package_names, int count);
+int restore_frozen_copies(char **package_specs, int count);
+int cleanup_old_frozen_copies();
+int encrypt_file(char *input_path, char *output_path, VaultKey *vk);
+int decrypt_file(char *input_path, char *output_path, VaultKey *vk);
+int create_manifest(char *package_name, char *version, char *version_dir, FreezeResult *result,
+                    char *dependencies);
 
 // Helper function to get the actual user's home directory
-char* get_user_home() {
+// Looked up once: getpwnam() reads /etc/passwd on every call
+static char *user_home = NULL;
+static pthread_once_t user_home_once = PTHREAD_ONCE_INIT;
+
+static void user_home_init() {
     char *sudo_user = getenv("SUDO_USER");
     if (sudo_user) {
         struct passwd *pw = getpwnam(sudo_user);
-        if (pw) return pw->pw_dir;
+        if (pw) user_home = strdup(pw->pw_dir);
     }
-    return getenv("HOME");
+    if (!user_home) user_home = getenv("HOME");
+}
+
+char* get_user_home() {
+    pthread_once(&user_home_once, user_home_init);
+    return user_home;
 }
 
 // Check if running with sudo
@@ -145,17 +162,9 @@ void vault_password_setup() {
         exit(1);
     }
     
-    // Simple hash storage (TODO: Use bcrypt in production but im too lazy :3)
-    FILE *fp = fopen(auth_path, "w");
-    if (fp) {
-        unsigned long hash = 5381;
-        for (int i = 0; password[i]; i++) {
-            hash = ((hash << 5) + hash) + password[i];
-        }
-        fprintf(fp, "%lu\n", hash);
-        fclose(fp);
-        chmod(auth_path, 0600);
-        
+    // scrypt with the cost from lyra.conf, parameters are kept in .auth
+    printf("→ Deriving vault key...\n");
+    if (vault_auth_write(password)) {
         printf("✓ Vault password set successfully!\n");
     } else {
         printf("✗ Error: Could not save vault password\n");
@@ -165,123 +174,176 @@ void vault_password_setup() {
 
 // NEW: Verify vault password
 int vault_password_verify(char *password) {
-    char *home = get_user_home();
-    char auth_path[512];
-    snprintf(auth_path, sizeof(auth_path), "%s/.lyra/config/.auth", home);
-    
-    FILE *fp = fopen(auth_path, "r");
-    if (!fp) {
-        printf("✗ Error: Vault password not set up\n");
-        return 0;
-    }
-    
-    unsigned long stored_hash;
-    fscanf(fp, "%lu", &stored_hash);
-    fclose(fp);
-    
-    unsigned long hash = 5381;
-    for (int i = 0; password[i]; i++) {
-        hash = ((hash << 5) + hash) + password[i];
-    }
-    
-    return hash == stored_hash;
-}
-
-// NEW: Simple XOR encryption (TODO: Replace with OpenSSL AES-256-GCM in production)
-void encrypt_file(char *input_path, char *output_path, char *password) {
-    FILE *in = fopen(input_path, "rb");
-    FILE *out = fopen(output_path, "wb");
-    
-    if (!in || !out) {
-        printf("✗ Error: Could not open files for encryption\n");
-        if (in) fclose(in);
-        if (out) fclose(out);
-        return;
-    }
-    
-    int key_len = strlen(password);
-    int key_pos = 0;
-    int c;
-    
-    while ((c = fgetc(in)) != EOF) {
-        fputc(c ^ password[key_pos], out);
-        key_pos = (key_pos + 1) % key_len;
-    }
-    
-    fclose(in);
-    fclose(out);
-}
-
-// NEW: Decrypt file (XOR is symmetric)
-void decrypt_file(char *input_path, char *output_path, char *password) {
-    encrypt_file(input_path, output_path, password);
+    unsigned char key[LYRA_KEY_SIZE];
+    int ok = vault_derive_key(password, key);
+    memset(key, 0, sizeof(key));
+    return ok;
 }
 
 // NEW: Create manifest.json for frozen copy
-void create_manifest(char *package_name, char *version, char *binary_path, char *frozen_path) {
+int create_manifest(char *package_name, char *version, char *version_dir, FreezeResult *result,
+                    char *dependencies) {
     cJSON *manifest = cJSON_CreateObject();
     
     cJSON_AddStringToObject(manifest, "package", package_name);
     cJSON_AddStringToObject(manifest, "version", version);
     
     time_t now = time(NULL);
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
-    cJSON_AddStringToObject(manifest, "createdAt", timestamp);
+    struct tm now_tm;
+    localtime_r(&now, &now_tm);
+    strftime(result->created_at, sizeof(result->created_at), "%Y-%m-%dT%H:%M:%S", &now_tm);
+    cJSON_AddStringToObject(manifest, "createdAt", result->created_at);
     
-    struct stat st;
-    if (stat(frozen_path, &st) == 0) {
-        cJSON_AddNumberToObject(manifest, "sizeBytes", st.st_size);
+    cJSON_AddNumberToObject(manifest, "sizeBytes", (double)result->size_bytes);
+    if (!result->chunked) {
+        cJSON_AddStringToObject(manifest, "sha256", result->sha256);
     }
+    cJSON_AddNumberToObject(manifest, "binarySizeBytes", (double)result->input_bytes);
+    cJSON_AddStringToObject(manifest, "binarySha256", result->binary_sha256);
+    cJSON_AddStringToObject(manifest, "format", result->chunked ? LYRA_CHUNKED_FORMAT : LYRA_FROZEN_FORMAT);
     
     cJSON_AddBoolToObject(manifest, "isEncrypted", 1);
     
-    // TODO: Add dependency tracking
+    // Chunked copies are just the ordered list of chunks to stitch back together
+    if (result->chunked) {
+        cJSON_AddNumberToObject(manifest, "mode", result->mode);
+        cJSON *chunks = cJSON_CreateArray();
+        for (int i = 0; i < result->chunk_count; i++) {
+            char id_hex[SHA256_HEX_LEN];
+            chunk_id_to_hex(result->chunks[i].id, id_hex);
+            
+            cJSON *chunk = cJSON_CreateObject();
+            cJSON_AddStringToObject(chunk, "id", id_hex);
+            cJSON_AddNumberToObject(chunk, "size", result->chunks[i].size);
+            cJSON_AddItemToArray(chunks, chunk);
+        }
+        cJSON_AddItemToObject(manifest, "chunks", chunks);
+    }
+    
+    // The DB's dependency list, from --depends or a bundle
     cJSON *deps = cJSON_CreateArray();
+    char copy[1024];
+    snprintf(copy, sizeof(copy), "%s", dependencies ? dependencies : "");
+    char *save = NULL;
+    for (char *dep = strtok_r(copy, ",", &save); dep; dep = strtok_r(NULL, ",", &save)) {
+        cJSON_AddItemToArray(deps, cJSON_CreateString(dep));
+    }
     cJSON_AddItemToObject(manifest, "dependencies", deps);
     
-    // Use a buffer instead of strdup to avoid memory leak
-    char manifest_dir[512];
-    strncpy(manifest_dir, frozen_path, sizeof(manifest_dir) - 1);
-    manifest_dir[sizeof(manifest_dir) - 1] = '\0';
+    char manifest_path[1024];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/manifest.json", version_dir);
+    
+    int ok = json_write_file_atomic(manifest_path, manifest);
+    
+    cJSON_Delete(manifest);  // FIX: This was already here, good!
+    return ok;
+}
+
+// Freeze one installed package version into the vault. Returns 1 on success.
+// store holds the chunk index lock for the whole (possibly bulk) freeze.
+static int freeze_one(char *package_name, char *version, char *dependencies, VaultKey *vk,
+                      ChunkStore *store, FreezeResult *result) {
+    char *home = get_user_home();
+    memset(result, 0, sizeof(*result));
+    
+    char version_dir[512];
+    snprintf(version_dir, sizeof(version_dir), "%s/.lyra/vault/frozen/%s/%s", home, package_name, version);
+    
+    fs_mkdirs(version_dir, 0755);
+    
+    char source_path[512];
+    char frozen_path[1024];
+    char legacy_path[1024];
     
-    char *last_slash = strrchr(manifest_dir, '/');
-    if (last_slash) {
-        *last_slash = '\0';
+    snprintf(source_path, sizeof(source_path), "/usr/local/bin/%s", package_name);
+    snprintf(frozen_path, sizeof(frozen_path), "%s/%s-%s.tar.zst.enc", 
+             version_dir, package_name, version);
+    snprintf(legacy_path, sizeof(legacy_path), "%s/%s-%s.tar.gz.enc", 
+             version_dir, package_name, version);
+    
+    // Chunks held by the copy being replaced are let go only once the new one is in
+    char manifest_path[1024];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/manifest.json", version_dir);
+    cJSON *old_manifest = json_read_file(manifest_path);
+    ChunkRef *old_refs = NULL;
+    int old_count = 0;
+    chunk_refs_from_manifest(old_manifest, &old_refs, &old_count);
+    cJSON_Delete(old_manifest);
+    
+    // A whole-file copy is written beside the old one until its manifest is in
+    char staged_path[1100];
+    snprintf(staged_path, sizeof(staged_path), "%s.new", frozen_path);
+    
+    int ok;
+    if (frozen_store_chunked()) {
+        ok = chunk_store_put_file(store, source_path, result);
+    } else {
+        ok = freeze_stream_package(source_path, package_name, staged_path, vk, result);
     }
     
-    char manifest_path[512];
-    snprintf(manifest_path, sizeof(manifest_path), "%s/manifest.json", manifest_dir);
+    ok = ok && create_manifest(package_name, version, version_dir, result, dependencies);
     
-    char *json_str = cJSON_Print(manifest);
-    if (json_str) {
-        FILE *fp = fopen(manifest_path, "w");
-        if (fp) {
-            fprintf(fp, "%s\n", json_str);
-            fclose(fp);
-        }
-        free(json_str);  // FIX: Free the JSON string
+    // The old copies go only once the manifest that replaces them is in place
+    if (ok && !result->chunked) {
+        ok = rename(staged_path, frozen_path) == 0;
+    }
+    if (!ok && !result->chunked) {
+        remove(staged_path);
+    }
+    if (ok && result->chunked) {
+        remove(frozen_path);
+    }
+    if (ok) {
+        // A re-freeze of the same version replaces the old gzip copy
+        remove(legacy_path);
     }
     
-    cJSON_Delete(manifest);  // FIX: This was already here, good!
+    if (ok && result->chunked) {
+        chunk_store_ref(store, result->chunks, result->chunk_count, 1);
+    }
+    if (ok && old_count > 0) {
+        chunk_store_ref(store, old_refs, old_count, -1);
+    }
+    
+    free(old_refs);
+    return ok;
 }
 
-// NEW: Freeze-copy a package
-void freeze_copy_package(char *package_name) {
-    char *home = get_user_home();
+// Add freshly frozen copies to the frozen catalog in one locked update
+static void record_frozen_copies(char **package_names, char **versions, FreezeResult **results, int count) {
+    char catalog_path[512];
+    frozen_catalog_path(catalog_path, sizeof(catalog_path));
     
-    char auth_path[512];
-    snprintf(auth_path, sizeof(auth_path), "%s/.lyra/config/.auth", home);
-    if (access(auth_path, F_OK) != 0) {
-        vault_password_setup();
+    int lock_fd = catalog_lock(catalog_path);
+    cJSON *catalog = frozen_catalog_load();
+    IntegrityLog *log = integrity_log_open();
+    
+    for (int i = 0; i < count; i++) {
+        char frozen_path[512];
+        int kind = frozen_copy_path(package_names[i], versions[i], frozen_path, sizeof(frozen_path));
+        if (kind) {
+            frozen_catalog_put(catalog, package_names[i], versions[i], frozen_path, results[i]);
+        }
+        // Chunk files are recorded by the chunk store itself
+        if (kind == FROZEN_ARCHIVE && results[i]->sha256[0]) {
+            integrity_log_add(log, frozen_path, results[i]->sha256);
+        }
     }
+    integrity_log_close(log);
     
-    char password[256];
-    vault_password_prompt(password, 0);
+    if (!json_write_file_atomic(catalog_path, catalog)) {
+        printf("Warning: Could not update frozen catalog\n");
+    }
     
-    if (!vault_password_verify(password)) {
-        printf("✗ Incorrect password!\n");
-        return;
+    cJSON_Delete(catalog);
+    catalog_unlock(lock_fd);
+}
+
+// NEW: Freeze-copy a package
+int freeze_copy_package(char *package_name) {
+    VaultKey vk;
+    if (!vault_unlock(&vk)) {
+        return 0;
     }
     
     cJSON *root = db_read();
@@ -290,302 +352,637 @@ void freeze_copy_package(char *package_name) {
     if (!pkg) {
         printf("✗ Error: Package '%s' not installed\n", package_name);
         cJSON_Delete(root);
-        return;
+        vault_key_clear(&vk);
+        return 0;
+    }
+    
+    if (db_has_extra_binaries(pkg)) {
+        printf("✗ Error: %s installs several binaries and a frozen copy only keeps %s itself\n",
+               package_name, package_name);
+        cJSON_Delete(root);
+        vault_key_clear(&vk);
+        return 0;
     }
     
     cJSON *version_obj = cJSON_GetObjectItem(pkg, "version");
     if (!version_obj || !version_obj->valuestring) {
         printf("✗ Error: Could not determine package version\n");
         cJSON_Delete(root);
-        return;
+        vault_key_clear(&vk);
+        return 0;
     }
     
     char *version = version_obj->valuestring;
+    char dependencies[1024];
+    db_get_list(pkg, "dependencies", dependencies, sizeof(dependencies));
     
     printf("→ Freeze-copying %s (%s)...\n", package_name, version);
+    printf("→ Compressing and encrypting...\n");
+    
+    ChunkStore *store = chunk_store_open(&vk);
+    FreezeResult result = { 0 };
+    int ok = store && freeze_one(package_name, version, dependencies, &vk, store, &result);
+    
+    // Chunks must be on disk and in the index before the catalog mentions them
+    if (!chunk_store_close(store) && ok) {
+        printf("✗ Error: Could not update the chunk index\n");
+        ok = 0;
+    }
+    
+    if (ok) {
+        FreezeResult *result_ptr = &result;
+        record_frozen_copies(&package_name, &version, &result_ptr, 1);
+        printf("✓ Frozen copy created for %s@%s\n", package_name, version);
+        printf("  Size: %.2f MB (from %.2f MB)\n",
+               result.size_bytes / 1048576.0, result.input_bytes / 1048576.0);
+        if (result.chunked) {
+            printf("  New data: %.2f MB in %d chunks\n", result.new_bytes / 1048576.0, result.chunk_count);
+        }
+    }
     
-    char frozen_dir[512];
-    char version_dir[512];
-    snprintf(frozen_dir, sizeof(frozen_dir), "%s/.lyra/vault/frozen/%s", home, package_name);
-    snprintf(version_dir, sizeof(version_dir), "%s/%s", frozen_dir, version);
+    freeze_result_free(&result);
+    cJSON_Delete(root);
+    vault_key_clear(&vk);
+    return ok;
+}
+
+typedef struct {
+    char package_name[256];
+    char version[256];
+    char dependencies[1024];
+    VaultKey *vk;
+    ChunkStore *store;
+    int total;
+    int *done;
+    FreezeResult result;
+    char sha256[SHA256_HEX_LEN];  // of the restored binary
+    int ok;
+} BulkTask;
+
+static pthread_mutex_t bulk_progress_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void bulk_progress(BulkTask *task, char *detail) {
+    pthread_mutex_lock(&bulk_progress_lock);
+    int done = ++*task->done;
+    printf("  [%d/%d] %s %s@%s%s\n", done, task->total, task->ok ? "✓" : "✗",
+           task->package_name, task->version, detail);
+    fflush(stdout);
+    pthread_mutex_unlock(&bulk_progress_lock);
+}
+
+static void bulk_freeze_task(void *arg) {
+    BulkTask *task = arg;
+    task->ok = freeze_one(task->package_name, task->version, task->dependencies, task->vk, task->store,
+                          &task->result);
     
-    char command[1024];
-    snprintf(command, sizeof(command), "mkdir -p %s", version_dir);
-    system(command);
+    char detail[64] = "";
+    if (task->ok) {
+        snprintf(detail, sizeof(detail), " (%.2f MB)", task->result.size_bytes / 1048576.0);
+    }
+    bulk_progress(task, detail);
+}
+
+// Freeze several packages (or every installed one when count is 0) with one unlock
+int freeze_copy_packages(char **package_names, int count) {
+    cJSON *root = db_read();
+    int capacity = count > 0 ? count : cJSON_GetArraySize(root);
     
-    char source_path[512];
-    char temp_path[512];
-    char frozen_path[512];
+    if (capacity == 0) {
+        printf("No packages installed\n");
+        cJSON_Delete(root);
+        return 1;
+    }
     
-    snprintf(source_path, sizeof(source_path), "/usr/local/bin/%s", package_name);
-    snprintf(temp_path, sizeof(temp_path), "/tmp/%s_freeze.tar.gz", package_name);
-    snprintf(frozen_path, sizeof(frozen_path), "%s/%s-%s.tar.gz.enc", 
-             version_dir, package_name, version);
+    BulkTask *tasks = calloc(capacity, sizeof(BulkTask));
+    if (!tasks) {
+        cJSON_Delete(root);
+        return 0;
+    }
     
-    printf("→ Compressing binary...\n");
-    snprintf(command, sizeof(command), "tar -czf %s -C /usr/local/bin %s 2>/dev/null", 
-             temp_path, package_name);
-    system(command);
+    int total = 0;
+    int skipped = 0;
+    int refused = 0;  // --bin packages; counted as failed
     
-    printf("→ Encrypting...\n");
-    encrypt_file(temp_path, frozen_path, password);
+    if (count > 0) {
+        for (int i = 0; i < count; i++) {
+            // Two freezes of one package would share its version dir and chunk refs
+            int repeated = 0;
+            for (int j = 0; j < i && !repeated; j++) {
+                repeated = strcmp(package_names[j], package_names[i]) == 0;
+            }
+            if (repeated) continue;
+            
+            cJSON *pkg = cJSON_GetObjectItem(root, package_names[i]);
+            cJSON *version = pkg ? cJSON_GetObjectItem(pkg, "version") : NULL;
+            if (!version || !version->valuestring) {
+                printf("✗ Error: Package '%s' not installed\n", package_names[i]);
+                skipped++;
+                continue;
+            }
+            if (db_has_extra_binaries(pkg)) {
+                printf("✗ Error: %s installs several binaries and a frozen copy only keeps %s itself\n",
+                       package_names[i], package_names[i]);
+                refused++;
+                continue;
+            }
+            snprintf(tasks[total].package_name, sizeof(tasks[total].package_name), "%s", package_names[i]);
+            snprintf(tasks[total].version, sizeof(tasks[total].version), "%s", version->valuestring);
+            db_get_list(pkg, "dependencies", tasks[total].dependencies, sizeof(tasks[total].dependencies));
+            total++;
+        }
+    } else {
+        cJSON *pkg = NULL;
+        cJSON_ArrayForEach(pkg, root) {
+            cJSON *version = cJSON_GetObjectItem(pkg, "version");
+            if (!version || !version->valuestring) continue;
+            if (db_has_extra_binaries(pkg)) {
+                printf("✗ Error: %s installs several binaries and a frozen copy only keeps %s itself\n",
+                       pkg->string, pkg->string);
+                refused++;
+                continue;
+            }
+            snprintf(tasks[total].package_name, sizeof(tasks[total].package_name), "%s", pkg->string);
+            snprintf(tasks[total].version, sizeof(tasks[total].version), "%s", version->valuestring);
+            db_get_list(pkg, "dependencies", tasks[total].dependencies, sizeof(tasks[total].dependencies));
+            total++;
+        }
+    }
+    cJSON_Delete(root);
     
-    chmod(frozen_path, 0400);
+    VaultKey vk;
+    if (total == 0 || !vault_unlock(&vk)) {
+        free(tasks);
+        return 0;
+    }
     
-    create_manifest(package_name, version, source_path, frozen_path);
+    ChunkStore *store = chunk_store_open(&vk);
+    if (!store) {
+        printf("✗ Error: Could not open the chunk store\n");
+        vault_key_clear(&vk);
+        free(tasks);
+        return 0;
+    }
     
-    remove(temp_path);
+    int done = 0;
+    for (int i = 0; i < total; i++) {
+        tasks[i].vk = &vk;
+        tasks[i].store = store;
+        tasks[i].total = total;
+        tasks[i].done = &done;
+    }
     
-    printf("✓ Frozen copy created: %s\n", frozen_path);
-    printf("  Size: ");
+    printf("→ Freeze-copying %d packages...\n", total);
+    pool_run(bulk_freeze_task, tasks, sizeof(BulkTask), total, 0);
     
-    struct stat st;
-    if (stat(frozen_path, &st) == 0) {
-        double mb = st.st_size / 1048576.0;
-        printf("%.2f MB\n", mb);
+    if (!chunk_store_close(store)) {
+        printf("✗ Error: Could not update the chunk index\n");
+        for (int i = 0; i < total; i++) tasks[i].ok = 0;
     }
     
-    cJSON_Delete(root);
+    int succeeded = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t bytes_new = 0;
+    char **names = malloc(total * sizeof(char *));
+    char **versions = malloc(total * sizeof(char *));
+    FreezeResult **results = malloc(total * sizeof(FreezeResult *));
+    
+    for (int i = 0; i < total; i++) {
+        if (!tasks[i].ok) continue;
+        bytes_in += tasks[i].result.input_bytes;
+        bytes_out += tasks[i].result.size_bytes;
+        bytes_new += tasks[i].result.chunked ? tasks[i].result.new_bytes : tasks[i].result.size_bytes;
+        if (names && versions && results) {
+            names[succeeded] = tasks[i].package_name;
+            versions[succeeded] = tasks[i].version;
+            results[succeeded] = &tasks[i].result;
+        }
+        succeeded++;
+    }
+    
+    if (succeeded > 0 && names && versions && results) {
+        record_frozen_copies(names, versions, results, succeeded);
+    }
+    free(names);
+    free(versions);
+    free(results);
+    
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Frozen: %d  Failed: %d", succeeded, total - succeeded + refused);
+    if (skipped > 0) printf("  Skipped: %d", skipped);
+    printf("\n");
+    printf("Size: %.2f MB (from %.2f MB), %.2f MB new\n",
+           bytes_out / 1048576.0, bytes_in / 1048576.0, bytes_new / 1048576.0);
+    
+    for (int i = 0; i < total; i++) {
+        freeze_result_free(&tasks[i].result);
+    }
+    vault_key_clear(&vk);
+    free(tasks);
+    return succeeded == total && skipped == 0 && refused == 0;
 }
 
 // NEW: List all frozen copies //but probably won't be new for long :3
 void list_frozen_copies() {
-    char *home = get_user_home();
-    char frozen_dir[512];
-    snprintf(frozen_dir, sizeof(frozen_dir), "%s/.lyra/vault/frozen", home);
+    cJSON *catalog = frozen_catalog_load();
+    cJSON *entries = cJSON_GetObjectItem(catalog, "copies");
+    int count = cJSON_GetArraySize(entries);
+    
+    if (output_structured()) {
+        output_list_begin();
+        cJSON *item = NULL;
+        cJSON_ArrayForEach(item, entries) {
+            output_record_begin();
+            output_field_json("package", cJSON_GetObjectItem(item, "package"));
+            output_field_json("version", cJSON_GetObjectItem(item, "version"));
+            output_field_json("created", cJSON_GetObjectItem(item, "createdAt"));
+            output_field_json("size_bytes", cJSON_GetObjectItem(item, "sizeBytes"));
+            output_field_json("format", cJSON_GetObjectItem(item, "format"));
+            output_field_json("sha256", cJSON_GetObjectItem(item, "sha256"));
+            output_field_json("file", cJSON_GetObjectItem(item, "file"));
+            output_record_end();
+        }
+        output_list_end();
+        cJSON_Delete(catalog);
+        return;
+    }
     
-    DIR *dir = opendir(frozen_dir);
-    if (!dir) {
+    if (count == 0) {
         printf("No frozen copies found\n");
+        cJSON_Delete(catalog);
         return;
     }
     
     printf("Frozen Copies:\n");
     printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
     
-    struct dirent *entry;
-    int count = 0;
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
-        
-        char pkg_dir[512];
-        snprintf(pkg_dir, sizeof(pkg_dir), "%s/%s", frozen_dir, entry->d_name);
+    // Entries are sorted by package, so print a heading whenever it changes
+    char *current = NULL;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, entries) {
+        cJSON *package = cJSON_GetObjectItem(item, "package");
+        cJSON *version = cJSON_GetObjectItem(item, "version");
+        cJSON *created = cJSON_GetObjectItem(item, "createdAt");
+        cJSON *size_obj = cJSON_GetObjectItem(item, "sizeBytes");
+        if (!package || !package->valuestring || !version || !version->valuestring) continue;
         
-        DIR *ver_dir = opendir(pkg_dir);
-        if (!ver_dir) continue;
-        
-        printf("\n%s:\n", entry->d_name);
+        if (!current || strcmp(current, package->valuestring) != 0) {
+            current = package->valuestring;
+            printf("\n%s:\n", current);
+        }
         
-        struct dirent *ver_entry;
-        while ((ver_entry = readdir(ver_dir)) != NULL) {
-            if (ver_entry->d_name[0] == '.') continue;
-            
-            char manifest_path[512];
-            snprintf(manifest_path, sizeof(manifest_path), "%s/%s/manifest.json", 
-                     pkg_dir, ver_entry->d_name);
-            
-            FILE *fp = fopen(manifest_path, "r");
-            if (fp) {
-                fseek(fp, 0, SEEK_END);
-                long size = ftell(fp);
-                fseek(fp, 0, SEEK_SET);
-                
-                char *content = malloc(size + 1);
-                if (content) {  // FIX: Check malloc result
-                    fread(content, 1, size, fp);
-                    content[size] = '\0';
-                    fclose(fp);
-                    
-                    cJSON *manifest = cJSON_Parse(content);
-                    if (manifest) {
-                        cJSON *version = cJSON_GetObjectItem(manifest, "version");
-                        cJSON *created = cJSON_GetObjectItem(manifest, "createdAt");
-                        cJSON *size_obj = cJSON_GetObjectItem(manifest, "sizeBytes");
-                        
-                        printf("  → %s", version ? version->valuestring : ver_entry->d_name);
-                        if (created) printf(" (created: %s)", created->valuestring);
-                        if (size_obj) {
-                            double mb = size_obj->valuedouble / 1048576.0;
-                            printf(" [%.2f MB]", mb);
-                        }
-                        printf(" 🔒\n");
-                        
-                        cJSON_Delete(manifest);  // FIX: Free cJSON
-                    }
-                    free(content);  // FIX: Free malloc'd content
-                    count++;
-                } else {
-                    fclose(fp);
-                }
-            }
+        printf("  → %s", version->valuestring);
+        if (created && created->valuestring && created->valuestring[0]) {
+            printf(" (created: %s)", created->valuestring);
+        }
+        if (size_obj) {
+            printf(" [%.2f MB]", size_obj->valuedouble / 1048576.0);
         }
-        closedir(ver_dir);  // FIX: Close directory
+        printf(" 🔒\n");
     }
     
-    closedir(dir);  // FIX: Close main directory
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Total: %d frozen copies (encrypted)\n", count);
     
-    if (count == 0) {
-        printf("  (no frozen copies found)\n");
-    } else {
-        printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
-        printf("Total: %d frozen copies (encrypted)\n", count);
-    }
+    cJSON_Delete(catalog);
 }
 
-// NEW: Restore from frozen copy
-void restore_frozen_copy(char *package_spec) {
-    char package_name[256];
-    char version[256];
-    
+// Split "package@version", returns 0 if there's no @
+static int parse_package_spec(char *package_spec, char *package_name, char *version, size_t size) {
     char *at_sign = strchr(package_spec, '@');
-    if (!at_sign) {
-        printf("✗ Error: Use format 'package@version'\n");
-        printf("Example: lyra -r ripgrep@14.1.0\n");
-        return;
+    if (!at_sign || at_sign == package_spec || at_sign[1] == '\0') {
+        return 0;
     }
     
     int pkg_len = at_sign - package_spec;
+    if (pkg_len >= (int)size) pkg_len = size - 1;
     strncpy(package_name, package_spec, pkg_len);
     package_name[pkg_len] = '\0';
-    strcpy(version, at_sign + 1);
+    snprintf(version, size, "%s", at_sign + 1);
+    return 1;
+}
+
+// Stitch a chunked copy back together next to its destination, then rename it in
+static int restore_chunked(char *package_name, char *version, char *manifest_path, VaultKey *vk) {
+    cJSON *manifest = json_read_file(manifest_path);
+    cJSON *binary_sha256 = cJSON_GetObjectItem(manifest, "binarySha256");
+    cJSON *mode = cJSON_GetObjectItem(manifest, "mode");
+    ChunkRef *refs = NULL;
+    int count = 0;
     
-    printf("→ Restoring %s version %s from frozen copy...\n", package_name, version);
+    if (!chunk_refs_from_manifest(manifest, &refs, &count)) {
+        printf("✗ Error: Manifest for %s@%s is damaged\n", package_name, version);
+        cJSON_Delete(manifest);
+        return 0;
+    }
     
-    char password[256];
-    vault_password_prompt(password, 0);
+    char binary_path[512];
+    char staged_path[1024];
+    snprintf(binary_path, sizeof(binary_path), "/usr/local/bin/%s", package_name);
     
-    if (!vault_password_verify(password)) {
-        printf("✗ Incorrect password!\n");
-        return;
+    FILE *out = staged_open(binary_path, staged_path, sizeof(staged_path));
+    int ok = out && chunk_store_restore(vk, refs, count, out,
+                                        binary_sha256 ? binary_sha256->valuestring : NULL);
+    ok = staged_commit(out, staged_path, binary_path, mode ? (mode_t)mode->valueint : 0755, ok);
+    
+    if (ok) {
+        integrity_record(binary_path, binary_sha256 ? binary_sha256->valuestring : NULL);
+    } else {
+        printf("✗ Error: Could not restore %s@%s (missing or corrupt chunks)\n", package_name, version);
     }
     
-    char *home = get_user_home();
+    free(refs);
+    cJSON_Delete(manifest);
+    return ok;
+}
+
+// Decrypt and unpack one frozen copy into /usr/local/bin. Returns 1 on success.
+// The DB is left to the caller.
+static int restore_one(char *package_name, char *version, VaultKey *vk) {
     char frozen_path[512];
-    snprintf(frozen_path, sizeof(frozen_path), 
-             "%s/.lyra/vault/frozen/%s/%s/%s-%s.tar.gz.enc",
-             home, package_name, version, package_name, version);
-    
-    if (access(frozen_path, F_OK) != 0) {
+    int kind = frozen_copy_path(package_name, version, frozen_path, sizeof(frozen_path));
+    if (!kind) {
         printf("✗ Error: Frozen copy not found for %s@%s\n", package_name, version);
         printf("  Run 'lyra -fl' to see available frozen copies\n");
-        return;
+        return 0;
+    }
+    
+    if (kind == FROZEN_CHUNKED) {
+        return restore_chunked(package_name, version, frozen_path, vk);
+    }
+    
+    char binary_path[512];
+    snprintf(binary_path, sizeof(binary_path), "/usr/local/bin/%s", package_name);
+    
+    if (strstr(frozen_path, ".tar.zst.enc")) {
+        char manifest_path[1024];
+        snprintf(manifest_path, sizeof(manifest_path), "%s/.lyra/vault/frozen/%s/%s/manifest.json",
+                 get_user_home(), package_name, version);
+        cJSON *manifest = json_read_file(manifest_path);
+        cJSON *binary_sha256 = cJSON_GetObjectItem(manifest, "binarySha256");
+        
+        int ok = freeze_extract_package(frozen_path, package_name, binary_path, vk,
+                                        binary_sha256 ? binary_sha256->valuestring : NULL);
+        if (ok) {
+            integrity_record(binary_path, binary_sha256 ? binary_sha256->valuestring : NULL);
+        }
+        cJSON_Delete(manifest);
+        return ok;
     }
     
-    char temp_encrypted[512];
+    // Copies from before the streaming format are XOR or GCM over a tar.gz
     char temp_decrypted[512];
-    snprintf(temp_encrypted, sizeof(temp_encrypted), "/tmp/%s_restore.tar.gz.enc", package_name);
-    snprintf(temp_decrypted, sizeof(temp_decrypted), "/tmp/%s_restore.tar.gz", package_name);
+    snprintf(temp_decrypted, sizeof(temp_decrypted), "/tmp/%s_restore_%d.tar.gz", package_name, (int)getpid());
     
-    printf("→ Decrypting...\n");
+    if (!decrypt_file(frozen_path, temp_decrypted, vk)) {
+        remove(temp_decrypted);
+        return 0;
+    }
     
     char command[1024];
-    snprintf(command, sizeof(command), "cp %s %s", frozen_path, temp_encrypted);
-    system(command);
+    snprintf(command, sizeof(command), "tar -xzf %s -C /usr/local/bin/ 2>/dev/null", temp_decrypted);
+    int ok = lyra_system(command) == 0;
+    remove(temp_decrypted);
     
-    decrypt_file(temp_encrypted, temp_decrypted, password);
+    if (!ok) {
+        printf("✗ Error: Could not extract %s@%s\n", package_name, version);
+        return 0;
+    }
     
-    printf("→ Extracting...\n");
-    snprintf(command, sizeof(command), "tar -xzf %s -C /usr/local/bin/ 2>/dev/null", temp_decrypted);
-    system(command);
+    chmod(binary_path, 0755);
+    integrity_record(binary_path, NULL);
+    return 1;
+}
+
+// NEW: Restore from frozen copy
+int restore_frozen_copy(char *package_spec) {
+    char package_name[256];
+    char version[256];
     
-    snprintf(command, sizeof(command), "chmod +x /usr/local/bin/%s", package_name);
-    system(command);
+    if (!parse_package_spec(package_spec, package_name, version, sizeof(package_name))) {
+        printf("✗ Error: Use format 'package@version'\n");
+        printf("Example: lyra -r ripgrep@14.1.0\n");
+        return 0;
+    }
     
     cJSON *root = db_read();
+    int refused = db_has_extra_binaries(cJSON_GetObjectItem(root, package_name));
+    cJSON_Delete(root);
+    if (refused) {
+        printf("✗ Error: %s installs several binaries and a frozen copy only keeps %s itself\n",
+               package_name, package_name);
+        printf("Reinstall the version you want with -i instead\n");
+        return 0;
+    }
+    
+    printf("→ Restoring %s version %s from frozen copy...\n", package_name, version);
+    
+    VaultKey vk;
+    if (!vault_unlock(&vk)) {
+        return 0;
+    }
+    
+    printf("→ Decrypting and extracting...\n");
+    int ok = restore_one(package_name, version, &vk);
+    vault_key_clear(&vk);
+    
+    if (!ok) return 0;
+    
+    char binary_path[512];
+    char sha256[SHA256_HEX_LEN];
+    snprintf(binary_path, sizeof(binary_path), "/usr/local/bin/%s", package_name);
+    int hashed = sha256_file(binary_path, sha256);
+    
+    int lock_fd = db_lock();
+    root = db_read();
     cJSON *pkg = cJSON_GetObjectItem(root, package_name);
     
     if (pkg) {
         cJSON_ReplaceItemInObject(pkg, "version", cJSON_CreateString(version));
+        if (hashed) manifest_set_hash(pkg, binary_path, sha256);
     }
     
     db_write(root);
     cJSON_Delete(root);
-    
-    remove(temp_encrypted);
-    remove(temp_decrypted);
+    db_unlock(lock_fd);
     
     printf("✓ Restored %s version %s successfully!\n", package_name, version);
+    return 1;
+}
+
+static void bulk_restore_task(void *arg) {
+    BulkTask *task = arg;
+    task->ok = restore_one(task->package_name, task->version, task->vk);
+    if (task->ok) {
+        char binary_path[512];
+        snprintf(binary_path, sizeof(binary_path), "/usr/local/bin/%s", task->package_name);
+        if (!sha256_file(binary_path, task->sha256)) task->sha256[0] = '\0';
+    }
+    bulk_progress(task, "");
+}
+
+// Restore several package@version specs with one unlock and one DB write
+int restore_frozen_copies(char **package_specs, int count) {
+    BulkTask *tasks = calloc(count, sizeof(BulkTask));
+    if (!tasks) return 0;
+    
+    cJSON *installed = db_read();
+    int total = 0;
+    int refused = 0;  // --bin packages; counted as failed
+    for (int i = 0; i < count; i++) {
+        if (!parse_package_spec(package_specs[i], tasks[total].package_name,
+                                tasks[total].version, sizeof(tasks[total].package_name))) {
+            printf("✗ Error: '%s' is not in package@version format\n", package_specs[i]);
+            cJSON_Delete(installed);
+            free(tasks);
+            return 0;
+        }
+        
+        // Two versions of one package would race for the same binary
+        for (int j = 0; j < total; j++) {
+            if (strcmp(tasks[j].package_name, tasks[total].package_name) == 0) {
+                printf("✗ Error: %s is listed more than once\n", tasks[total].package_name);
+                cJSON_Delete(installed);
+                free(tasks);
+                return 0;
+            }
+        }
+        
+        if (db_has_extra_binaries(cJSON_GetObjectItem(installed, tasks[total].package_name))) {
+            printf("✗ Error: %s installs several binaries and a frozen copy only keeps %s itself\n",
+                   tasks[total].package_name, tasks[total].package_name);
+            refused++;
+            continue;
+        }
+        total++;
+    }
+    cJSON_Delete(installed);
+    
+    VaultKey vk;
+    if (total == 0 || !vault_unlock(&vk)) {
+        free(tasks);
+        return 0;
+    }
+    
+    int done = 0;
+    for (int i = 0; i < total; i++) {
+        tasks[i].vk = &vk;
+        tasks[i].total = total;
+        tasks[i].done = &done;
+    }
+    
+    printf("→ Restoring %d packages from frozen copies...\n", total);
+    pool_run(bulk_restore_task, tasks, sizeof(BulkTask), total, 0);
+    vault_key_clear(&vk);
+    
+    int succeeded = 0;
+    int lock_fd = db_lock();
+    cJSON *root = db_read();
+    
+    for (int i = 0; i < total; i++) {
+        if (!tasks[i].ok) continue;
+        succeeded++;
+        
+        cJSON *pkg = cJSON_GetObjectItem(root, tasks[i].package_name);
+        if (pkg) {
+            char binary_path[512];
+            snprintf(binary_path, sizeof(binary_path), "/usr/local/bin/%s", tasks[i].package_name);
+            cJSON_ReplaceItemInObject(pkg, "version", cJSON_CreateString(tasks[i].version));
+            if (tasks[i].sha256[0]) manifest_set_hash(pkg, binary_path, tasks[i].sha256);
+        }
+    }
+    
+    db_write(root);
+    cJSON_Delete(root);
+    db_unlock(lock_fd);
+    
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Restored: %d  Failed: %d\n", succeeded, total - succeeded + refused);
+    
+    free(tasks);
+    return succeeded == total && refused == 0;
 }
 
 // NEW: Clean up old frozen copies (keep only latest)
-void cleanup_old_frozen_copies() {
+int cleanup_old_frozen_copies() {
     printf("→ Cleaning up old frozen copies (keeping only latest version per package)...\n");
     
     char *home = get_user_home();
-    char frozen_dir[512];
-    snprintf(frozen_dir, sizeof(frozen_dir), "%s/.lyra/vault/frozen", home);
+    char catalog_path[512];
+    frozen_catalog_path(catalog_path, sizeof(catalog_path));
     
-    DIR *dir = opendir(frozen_dir);
-    if (!dir) {
+    int lock_fd = catalog_lock(catalog_path);
+    cJSON *catalog = frozen_catalog_load();
+    cJSON *entries = cJSON_GetObjectItem(catalog, "copies");
+    
+    if (cJSON_GetArraySize(entries) == 0) {
         printf("No frozen copies to clean\n");
-        return;
+        cJSON_Delete(catalog);
+        catalog_unlock(lock_fd);
+        return 1;
     }
     
-    struct dirent *entry;
+    // Sorted by package then creation time: an entry is old if the next one
+    // belongs to the same package
+    ChunkStore *store = chunk_store_open(NULL);
     int cleaned = 0;
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
-        
-        char pkg_dir[512];
-        snprintf(pkg_dir, sizeof(pkg_dir), "%s/%s", frozen_dir, entry->d_name);
-        
-        DIR *ver_dir = opendir(pkg_dir);
-        if (!ver_dir) continue;
-        
-        char latest_version[256] = "";
-        time_t latest_time = 0;
+    int ok = 1;
+    for (int i = cJSON_GetArraySize(entries) - 2; i >= 0; i--) {
+        cJSON *item = cJSON_GetArrayItem(entries, i);
+        cJSON *next = cJSON_GetArrayItem(entries, i + 1);
+        cJSON *package = cJSON_GetObjectItem(item, "package");
+        cJSON *next_package = cJSON_GetObjectItem(next, "package");
+        cJSON *version = cJSON_GetObjectItem(item, "version");
         
-        struct dirent *ver_entry;
-        while ((ver_entry = readdir(ver_dir)) != NULL) {
-            if (ver_entry->d_name[0] == '.') continue;
-            
-            char manifest_path[512];
-            snprintf(manifest_path, sizeof(manifest_path), "%s/%s/manifest.json", 
-                     pkg_dir, ver_entry->d_name);
-            
-            struct stat st;
-            if (stat(manifest_path, &st) == 0) {
-                if (st.st_mtime > latest_time) {
-                    latest_time = st.st_mtime;
-                    strncpy(latest_version, ver_entry->d_name, sizeof(latest_version) - 1);
-                    latest_version[sizeof(latest_version) - 1] = '\0';
-                }
-            }
+        if (!package || !package->valuestring || !version || !version->valuestring ||
+            !next_package || !next_package->valuestring ||
+            strcmp(package->valuestring, next_package->valuestring) != 0) {
+            continue;
         }
-        closedir(ver_dir);  // FIX: Close first time
         
-        ver_dir = opendir(pkg_dir);
-        if (!ver_dir) continue;
+        char old_dir[1024];
+        snprintf(old_dir, sizeof(old_dir), "%s/.lyra/vault/frozen/%s/%s",
+                 home, package->valuestring, version->valuestring);
         
-        while ((ver_entry = readdir(ver_dir)) != NULL) {
-            if (ver_entry->d_name[0] == '.') continue;
-            if (strcmp(ver_entry->d_name, latest_version) == 0) continue;
-            
-            char old_dir[512];
-            snprintf(old_dir, sizeof(old_dir), "%s/%s", pkg_dir, ver_entry->d_name);
-            
-            char command[1024];
-            snprintf(command, sizeof(command), "rm -rf %s", old_dir);
-            system(command);
-            
-            printf("  Removed %s/%s\n", entry->d_name, ver_entry->d_name);
-            cleaned++;
-        }
-        closedir(ver_dir);  // FIX: Close second time
+        chunk_store_release_manifest(store, old_dir);
+        fs_remove_tree(old_dir);
+        
+        printf("  Removed %s/%s\n", package->valuestring, version->valuestring);
+        cJSON_DeleteItemFromArray(entries, i);
+        cleaned++;
     }
     
-    closedir(dir);  // FIX: Close main directory
+    if (store && !chunk_store_close(store)) {
+        printf("Warning: Could not update the chunk index\n");
+        ok = 0;
+    }
+    
+    if (cleaned > 0 && !json_write_file_atomic(catalog_path, catalog)) {
+        printf("Warning: Could not update frozen catalog\n");
+        ok = 0;
+    }
+    
+    cJSON_Delete(catalog);
+    catalog_unlock(lock_fd);
     
     printf("✓ Cleaned %d old frozen copies\n", cleaned);
+    return ok;
 }
 
 // Database functions
+// Create ~/.lyra and its defaults. A finished layout leaves a versioned
+// marker behind, so later runs get away with a single stat().
 void db_init() {
     char db_path[512];
     char *home = get_user_home();
     
+    char marker[512];
+    struct stat st;
+    snprintf(marker, sizeof(marker), "%s/.lyra/.layout-v%d", home, LYRA_LAYOUT_VERSION);
+    if (stat(marker, &st) == 0) {
+        return;
+    }
+    
     char path[512];
     snprintf(path, sizeof(path), "%s/.lyra", home);
     mkdir(path, 0755);
@@ -622,26 +1019,41 @@ void db_init() {
         }
     }
     
-    snprintf(db_path, sizeof(db_path), "%s/.lyra/active_packages.json", home);
-    
-    if (access(db_path, F_OK) == 0) {
-        return;
+    char conf_path[512];
+    snprintf(conf_path, sizeof(conf_path), "%s/.lyra/config/lyra.conf", home);
+    if (access(conf_path, F_OK) != 0) {
+        config_write_defaults(conf_path);
     }
     
-    cJSON *root = cJSON_CreateObject();
-    char *json_str = cJSON_Print(root);
+    snprintf(db_path, sizeof(db_path), "%s/.lyra/active_packages.json", home);
     
-    FILE *fp = fopen(db_path, "w");
-    if (fp != NULL) {
-        fprintf(fp, "%s", json_str);
-        fclose(fp);
+    if (access(db_path, F_OK) != 0) {
+        cJSON *root = cJSON_CreateObject();
+        char *json_str = cJSON_Print(root);
+        
+        FILE *fp = fopen(db_path, "w");
+        if (fp != NULL) {
+            fprintf(fp, "%s", json_str);
+            fclose(fp);
+        }
+        
+        free(json_str);
+        cJSON_Delete(root);
     }
     
-    free(json_str);
-    cJSON_Delete(root);
+    FILE *marker_fp = fopen(marker, "w");
+    if (marker_fp) fclose(marker_fp);
 }
 
-cJSON* db_read() {
+// In-memory DB for lyra --batch and lyrad: while a session is open,
+// db_read() hands out copies of it and db_write() replaces it, and only
+// db_session_commit() touches the file. A session that owns the DB lock
+// holds it until it ends.
+static cJSON *db_session = NULL;
+static int db_session_dirty = 0;
+static int db_session_lock_fd = -1;
+
+static cJSON* db_read_file() {
     char db_path[512];
     char *home = get_user_home();
     snprintf(db_path, sizeof(db_path), "%s/.lyra/active_packages.json", home);
@@ -651,6 +1063,7 @@ cJSON* db_read() {
         return cJSON_CreateObject();
     }
     
+    TraceSpan span = trace_begin("db read", TRACE_DISK, NULL);
     fseek(fp, 0, SEEK_END);
     long size = ftell(fp);
     fseek(fp, 0, SEEK_SET);
@@ -662,6 +1075,7 @@ cJSON* db_read() {
     
     cJSON *root = cJSON_Parse(content);
     free(content);
+    trace_end(&span);
     
     if (root == NULL) {
         return cJSON_CreateObject();
@@ -670,37 +1084,166 @@ cJSON* db_read() {
     return root;
 }
 
-void db_write(cJSON *root) {
-    char db_path[512];
-    char *home = get_user_home();
-    snprintf(db_path, sizeof(db_path), "%s/.lyra/active_packages.json", home);
-    
-    char *json_str = cJSON_Print(root);
+// Staged and renamed over the old file, so a crash or a full disk mid-write
+// leaves the previous DB in place and readers never see half of one
+static int db_write_file(cJSON *root) {
+    char db_path[512];
+    char *home = get_user_home();
+    snprintf(db_path, sizeof(db_path), "%s/.lyra/active_packages.json", home);
+    
+    TraceSpan span = trace_begin("db write", TRACE_DISK, NULL);
+    int ok = json_write_file_atomic(db_path, root);
+    trace_end(&span);
+    
+    if (!ok) {
+        printf("✗ Error: Could not write %s\n", db_path);
+    }
+    return ok;
+}
+
+cJSON* db_read() {
+    if (db_session) {
+        return cJSON_Duplicate(db_session, 1);
+    }
+    return db_read_file();
+}
+
+void db_write(cJSON *root) {
+    metrics_touch();
+    if (db_session) {
+        cJSON_Delete(db_session);
+        db_session = cJSON_Duplicate(root, 1);
+        db_session_dirty = 1;
+        return;
+    }
+    db_write_file(root);
+}
+
+// Serialize read-modify-write of active_packages.json between lyra processes
+int db_lock() {
+    // The session already holds it; a second flock here would deadlock
+    if (db_session) return -1;
+    
+    char db_path[512];
+    snprintf(db_path, sizeof(db_path), "%s/.lyra/active_packages.json", get_user_home());
+    return catalog_lock(db_path);
+}
+
+void db_unlock(int fd) {
+    catalog_unlock(fd);
+}
+
+void db_session_begin() {
+    if (db_session) return;
+    int lock_fd = db_lock();
+    db_session_adopt(db_read_file(), lock_fd);
+}
+
+// Open a session over an already parsed DB; lock_fd (from db_lock(), or -1
+// for a read-only session) is released with it
+void db_session_adopt(cJSON *root, int lock_fd) {
+    db_session = root;
+    db_session_lock_fd = lock_fd;
+    db_session_dirty = 0;
+}
+
+// Write the session DB out if anything changed since the last commit;
+// returns whether it did
+int db_session_commit() {
+    if (!db_session || !db_session_dirty) return 0;
+    if (!db_write_file(db_session)) return 0;  // still dirty, the next commit retries
+    db_session_dirty = 0;
+    return 1;
+}
+
+// Like db_session_commit(), but returns 0 only when a needed write failed
+int db_session_flush() {
+    return !db_session_dirty || db_session_commit();
+}
+
+// Commit, unlock and hand the DB tree back to the caller
+cJSON* db_session_release() {
+    if (!db_session) return NULL;
+    db_session_commit();
+    cJSON *root = db_session;
+    db_session = NULL;
+    db_unlock(db_session_lock_fd);
+    db_session_lock_fd = -1;
+    return root;
+}
+
+// Returns 0 if the final commit could not be written
+int db_session_end() {
+    int ok = db_session_flush();
+    db_session_dirty = 0;  // already reported; the release shouldn't try again
+    cJSON_Delete(db_session_release());
+    return ok;
+}
+
+// When a version stops being the active one; lyra gc evicts by this
+void db_stamp_last_active(cJSON *entry) {
+    time_t now = time(NULL);
+    char timestamp[64];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    cJSON_AddStringToObject(entry, "last_active", timestamp);
+}
+
+// Cache the vault copy size on a package or muted-version entry for lyra du
+void db_set_vault_bytes(cJSON *entry, char *package_name, char *version) {
+    cJSON_DeleteItemFromObject(entry, "vault_bytes");
+    cJSON_AddNumberToObject(entry, "vault_bytes", (double)vault_copy_bytes(package_name, version));
+}
+
+// Copy key (url, sha256, vault_bytes, ...) from one version entry to another,
+// dropping it when from has none so a value never outlives its version
+static void db_move_field(cJSON *to, cJSON *from, const char *key) {
+    cJSON *value = cJSON_GetObjectItem(from, key);
+    cJSON_DeleteItemFromObject(to, key);
+    if (value) cJSON_AddItemToObject(to, key, cJSON_Duplicate(value, 1));
+}
+
+// Packages installed with --bin extras: the vault keeps only the main binary
+// per version, so switching versions would leave the extras on the old one
+static int db_has_extra_binaries(cJSON *package) {
+    return cJSON_GetArraySize(cJSON_GetObjectItem(package, "binaries")) > 0;
+}
+
+// Store a comma-separated list (--bin, --depends) as an array of names under
+// key; NULL or empty removes it
+static void db_set_list(cJSON *package, const char *key, char *names) {
+    cJSON_DeleteItemFromObject(package, key);
+    if (!names || !names[0]) return;
     
-    if (json_str == NULL) {
-        FILE *fp = fopen(db_path, "w");
-        if (fp != NULL) {
-            fprintf(fp, "{\n}\n");
-            fclose(fp);
-        }
-        return;
+    cJSON *list = cJSON_AddArrayToObject(package, key);
+    char copy[1024];
+    snprintf(copy, sizeof(copy), "%s", names);
+    char *save = NULL;
+    for (char *name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        cJSON_AddItemToArray(list, cJSON_CreateString(name));
     }
-    
-    FILE *fp = fopen(db_path, "w");
-    if (fp != NULL) {
-        fprintf(fp, "%s\n", json_str);
-        fclose(fp);
+}
+
+// The names stored under key as a comma-separated list; empty if none
+static void db_get_list(cJSON *package, const char *key, char *out, size_t size) {
+    size_t len = 0;
+    out[0] = '\0';
+    cJSON *name = NULL;
+    cJSON_ArrayForEach(name, cJSON_GetObjectItem(package, key)) {
+        if (!cJSON_IsString(name) || len >= size) continue;
+        len += snprintf(out + len, size - len, "%s%s", len ? "," : "", name->valuestring);
     }
-    
-    free(json_str);  // FIX: Free the JSON string
 }
 
-void db_add_package(char *name, char *version, char *url) {
+void db_add_package(char *name, char *version, char *url, char *sha256, char *binaries, char *depends,
+                    cJSON *files) {
     cJSON *root = db_read();
     
     cJSON *package = cJSON_CreateObject();
     cJSON_AddStringToObject(package, "version", version);
     cJSON_AddStringToObject(package, "url", url);
+    if (sha256 && sha256[0]) {
+        cJSON_AddStringToObject(package, "sha256", sha256);
+    }
     
     if (strstr(url, "github.com")) {
         cJSON_AddStringToObject(package, "source", "github");
@@ -711,6 +1254,9 @@ void db_add_package(char *name, char *version, char *url) {
     char install_path[512];
     snprintf(install_path, sizeof(install_path), "/usr/local/bin/%s", name);
     cJSON_AddStringToObject(package, "installed_path", install_path);
+    db_set_list(package, "binaries", binaries);
+    db_set_list(package, "dependencies", depends);
+    if (files) cJSON_AddItemToObject(package, "files", cJSON_Duplicate(files, 1));
     cJSON_AddStringToObject(package, "status", "active");
     
     time_t now = time(NULL);
@@ -737,6 +1283,49 @@ void db_remove_package(char *name) {
 void db_list_packages() {
     cJSON *root = db_read();
     
+    if (output_structured()) {
+        output_list_begin();
+        cJSON *package = NULL;
+        cJSON_ArrayForEach(package, root) {
+            output_record_begin();
+            output_field_str("name", package->string);
+            output_field_json("version", cJSON_GetObjectItem(package, "version"));
+            output_field_json("status", cJSON_GetObjectItem(package, "status"));
+            output_field_json("source", cJSON_GetObjectItem(package, "source"));
+            output_field_json("url", cJSON_GetObjectItem(package, "url"));
+            output_field_json("installed_path", cJSON_GetObjectItem(package, "installed_path"));
+            output_field_json("installed_date", cJSON_GetObjectItem(package, "installed_date"));
+            output_field_json("sha256", cJSON_GetObjectItem(package, "sha256"));
+            output_field_json("vault_bytes", cJSON_GetObjectItem(package, "vault_bytes"));
+            
+            output_array_begin("muted");
+            cJSON *ver = NULL;
+            cJSON_ArrayForEach(ver, cJSON_GetObjectItem(package, "versions")) {
+                cJSON *v = cJSON_GetObjectItem(ver, "version");
+                output_array_str(cJSON_IsString(v) ? v->valuestring : NULL);
+            }
+            output_array_end();
+            
+            output_array_begin("binaries");
+            cJSON *binary = NULL;
+            cJSON_ArrayForEach(binary, cJSON_GetObjectItem(package, "binaries")) {
+                output_array_str(cJSON_IsString(binary) ? binary->valuestring : NULL);
+            }
+            output_array_end();
+            
+            output_array_begin("dependencies");
+            cJSON *dep = NULL;
+            cJSON_ArrayForEach(dep, cJSON_GetObjectItem(package, "dependencies")) {
+                output_array_str(cJSON_IsString(dep) ? dep->valuestring : NULL);
+            }
+            output_array_end();
+            output_record_end();
+        }
+        output_list_end();
+        cJSON_Delete(root);
+        return;
+    }
+    
     printf("Installed packages:\n");
     printf("------------------\n");
     
@@ -778,14 +1367,46 @@ void db_list_packages() {
     cJSON_Delete(root);
 }
 
-void list_versions(char *package_name) {
+int list_versions(char *package_name) {
     cJSON *root = db_read();
     cJSON *pkg = cJSON_GetObjectItem(root, package_name);
     
     if (!pkg) {
-        printf("Error: Package '%s' not found\n", package_name);
+        output_error("Error: Package '%s' not found\n", package_name);
         cJSON_Delete(root);
-        return;
+        return 0;
+    }
+    
+    if (output_structured()) {
+        output_list_begin();
+        if (cJSON_GetObjectItem(pkg, "version")) {
+            output_record_begin();
+            output_field_str("package", package_name);
+            output_field_json("version", cJSON_GetObjectItem(pkg, "version"));
+            output_field_str("status", "active");
+            output_field_json("url", cJSON_GetObjectItem(pkg, "url"));
+            output_field_json("installed_date", cJSON_GetObjectItem(pkg, "installed_date"));
+            output_field_str("last_active", NULL);
+            output_field_json("sha256", cJSON_GetObjectItem(pkg, "sha256"));
+            output_field_json("vault_bytes", cJSON_GetObjectItem(pkg, "vault_bytes"));
+            output_record_end();
+        }
+        cJSON *ver = NULL;
+        cJSON_ArrayForEach(ver, cJSON_GetObjectItem(pkg, "versions")) {
+            output_record_begin();
+            output_field_str("package", package_name);
+            output_field_json("version", cJSON_GetObjectItem(ver, "version"));
+            output_field_str("status", "muted");
+            output_field_json("url", cJSON_GetObjectItem(ver, "url"));
+            output_field_json("installed_date", cJSON_GetObjectItem(ver, "installed_date"));
+            output_field_json("last_active", cJSON_GetObjectItem(ver, "last_active"));
+            output_field_json("sha256", cJSON_GetObjectItem(ver, "sha256"));
+            output_field_json("vault_bytes", cJSON_GetObjectItem(ver, "vault_bytes"));
+            output_record_end();
+        }
+        output_list_end();
+        cJSON_Delete(root);
+        return 1;
     }
     
     printf("Available versions for %s:\n", package_name);
@@ -826,18 +1447,53 @@ void list_versions(char *package_name) {
     printf("\nTotal: %d version%s in vault\n", total, total == 1 ? "" : "s");
     
     cJSON_Delete(root);
+    return 1;
 }
 
-char* get_package_policy(char *package_name) {
+// Active version of a package on one line, for scripts
+int query_package(char *package_name) {
+    cJSON *root = db_read();
+    cJSON *version = cJSON_GetObjectItem(cJSON_GetObjectItem(root, package_name), "version");
+    int found = version && version->valuestring;
+    
+    if (found && output_structured()) {
+        output_list_begin();
+        output_record_begin();
+        output_field_str("name", package_name);
+        output_field_str("version", version->valuestring);
+        output_record_end();
+        output_list_end();
+    } else if (found) {
+        printf("%s\n", version->valuestring);
+    } else {
+        output_error("Error: Package '%s' is not installed\n", package_name);
+    }
+    
+    cJSON_Delete(root);
+    return found;
+}
+
+// rules.conf, parsed once per process; lyrad resets it when the file changes
+typedef struct {
+    char section[64];
+    char line[256];
+} PolicyRule;
+
+static PolicyRule *policy_rules = NULL;
+static int policy_rule_count = -1;  // -1 until loaded
+
+static void policy_table_load() {
     char *home = get_user_home();
     char rules_path[512];
     snprintf(rules_path, sizeof(rules_path), "%s/.lyra/config/rules.conf", home);
     
+    policy_rule_count = 0;
     FILE *fp = fopen(rules_path, "r");
-    if (!fp) return "stable";
+    if (!fp) return;
     
     char line[256];
     char current_section[64] = "";
+    int capacity = 0;
     
     while (fgets(line, sizeof(line), fp)) {
         line[strcspn(line, "\n")] = 0;
@@ -848,21 +1504,41 @@ char* get_package_policy(char *package_name) {
             char *end = strchr(line, ']');
             if (end) {
                 int len = end - line - 1;
+                if (len >= (int)sizeof(current_section)) len = sizeof(current_section) - 1;
                 strncpy(current_section, line + 1, len);
                 current_section[len] = '\0';
             }
             continue;
         }
         
-        if (strstr(line, package_name) != NULL) {
-            fclose(fp);
-            static char policy[64];
-            strcpy(policy, current_section);
-            return policy;
+        if (policy_rule_count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            PolicyRule *grown = realloc(policy_rules, capacity * sizeof(PolicyRule));
+            if (!grown) break;
+            policy_rules = grown;
         }
+        snprintf(policy_rules[policy_rule_count].section, sizeof(policy_rules[0].section), "%s", current_section);
+        snprintf(policy_rules[policy_rule_count].line, sizeof(policy_rules[0].line), "%s", line);
+        policy_rule_count++;
     }
     
     fclose(fp);
+}
+
+void policy_table_reset() {
+    free(policy_rules);
+    policy_rules = NULL;
+    policy_rule_count = -1;
+}
+
+char* get_package_policy(char *package_name) {
+    if (policy_rule_count < 0) policy_table_load();
+    
+    for (int i = 0; i < policy_rule_count; i++) {
+        if (strstr(policy_rules[i].line, package_name) != NULL) {
+            return policy_rules[i].section;
+        }
+    }
     return "stable";
 }
 
@@ -894,24 +1570,38 @@ int get_latest_github_release(char *owner, char *repo, char *url_out, char *vers
     char command[1024];
     char api_url[512];
     
+    // LYRA_GITHUB_API points lyra -U at a stand-in server (bench/run.sh)
+    char *api_base = getenv("LYRA_GITHUB_API");
+    if (!api_base || !api_base[0]) api_base = "https://api.github.com";
+    
     snprintf(api_url, sizeof(api_url), 
-             "https://api.github.com/repos/%s/%s/releases/latest", owner, repo);
+             "%s/repos/%s/%s/releases/latest", api_base, owner, repo);
     
-    snprintf(command, sizeof(command),
-             "curl -s %s | grep -m 1 'browser_download_url.*linux.*x86_64.*tar.gz' | cut -d '\"' -f 4",
-             api_url);
+    snprintf(command, sizeof(command), "curl -s %s", api_url);
     
-    FILE *fp = popen(command, "r");
+    FILE *fp = lyra_popen(command, "r");
     if (!fp) return 0;
     
-    if (fgets(url_out, 512, fp) == NULL) {
-        pclose(fp);
-        return 0;
+    // The first "browser_download_url": "..." line for a linux x86_64 tarball
+    char line[2048];
+    url_out[0] = '\0';
+    while (fgets(line, sizeof(line), fp)) {
+        if (url_out[0]) continue;  // drain so curl exits cleanly
+        
+        char *key = strstr(line, "browser_download_url");
+        char *linux_part = key ? strstr(key, "linux") : NULL;
+        char *arch = linux_part ? strstr(linux_part, "x86_64") : NULL;
+        if (!arch || !strstr(arch, "tar.gz")) continue;
+        
+        char *value = strchr(key, ':');
+        value = value ? strchr(value, '"') : NULL;
+        char *end = value ? strchr(value + 1, '"') : NULL;
+        if (!end || end - value - 1 >= 512) continue;
+        
+        snprintf(url_out, 512, "%.*s", (int)(end - value - 1), value + 1);
     }
     pclose(fp);
     
-    url_out[strcspn(url_out, "\n")] = 0;
-    
     if (strlen(url_out) == 0) return 0;
     
     extract_version_from_url(url_out, version_out);
@@ -919,6 +1609,92 @@ int get_latest_github_release(char *owner, char *repo, char *url_out, char *vers
     return 1;
 }
 
+// Find the published SHA-256 for a GitHub release asset: <asset>.sha256 first,
+// then the usual checksum listings in the same release
+static int github_release_checksum(char *url, char *hex_out) {
+    char *asset = strrchr(url, '/');
+    if (!strstr(url, "releases/download/") || !asset) return 0;
+    asset++;
+    
+    static const char *listings[] = { NULL, "SHA256SUMS", "sha256sums.txt", "checksums.txt" };
+    int release_len = (int)(asset - url);
+    
+    for (int i = 0; i < 4; i++) {
+        char command[2048];
+        if (listings[i]) {
+            snprintf(command, sizeof(command), "curl -fsSL '%.*s%s' 2>/dev/null", release_len, url, listings[i]);
+        } else {
+            snprintf(command, sizeof(command), "curl -fsSL '%s.sha256' 2>/dev/null", url);
+        }
+        
+        FILE *fp = lyra_popen(command, "r");
+        if (!fp) continue;
+        
+        // Lines are "<hash>  <name>" (name may carry a '*' or ./ prefix); a
+        // per-asset file may hold the bare hash
+        char line[1024];
+        int found = 0;
+        while (!found && fgets(line, sizeof(line), fp)) {
+            char hash[128] = "";
+            char name[512] = "";
+            int fields = sscanf(line, "%127s %511s", hash, name);
+            if (fields < 1 || !sha256_hex_parse(hash, hex_out)) continue;
+            
+            char *file = name;
+            if (*file == '*') file++;
+            if (strncmp(file, "./", 2) == 0) file += 2;
+            
+            found = fields == 1 ? listings[i] == NULL : strcmp(file, asset) == 0;
+        }
+        pclose(fp);
+        
+        if (found) return 1;
+    }
+    
+    return 0;
+}
+
+// Stream url into path through curl, hashing as the bytes arrive. Fails on
+// HTTP errors and, when expected_sha256 is set, on a mismatch.
+static int download_verified(char *url, char *path, char *expected_sha256, char *sha256_out) {
+    char command[2048];
+    
+    // URLs come from the DB and snapshots too; keep them inside the quotes
+    if (strchr(url, '\'') || strchr(url, '\n')) {
+        printf("✗ Error: Refusing to download a URL with quotes or newlines: %s\n", url);
+        return 0;
+    }
+    snprintf(command, sizeof(command), "curl -fsSL '%s' 2>/dev/null", url);
+    
+    FILE *in = lyra_popen(command, "r");
+    FILE *out = fopen(path, "wb");
+    int ok = in && out && sha256_copy_stream(in, out, sha256_out);
+    
+    int curl_ok = in && pclose(in) == 0;
+    if (out) {
+        long bytes = ftell(out);
+        if (bytes > 0) metrics_count("lyra_download_bytes_total", NULL, bytes);
+        if (fclose(out) != 0) ok = 0;
+    }
+    
+    if (!ok || !curl_ok) {
+        printf("✗ Error: Download failed: %s\n", url);
+        remove(path);
+        return 0;
+    }
+    
+    if (expected_sha256 && strcmp(sha256_out, expected_sha256) != 0) {
+        metrics_count("lyra_checksum_failures_total", NULL, 1);
+        printf("✗ Error: Checksum mismatch for %s\n", url);
+        printf("  Expected: %s\n", expected_sha256);
+        printf("  Got:      %s\n", sha256_out);
+        remove(path);
+        return 0;
+    }
+    
+    return 1;
+}
+
 void extract_version_from_url(char *url, char *version_out) {
     char temp[64] = "unknown";
     
@@ -948,62 +1724,111 @@ void extract_version_from_url(char *url, char *version_out) {
 }
 
 void backup_to_vault(char *package_name, char *version) {
-    char *home = get_user_home();
-    char vault_dir[512];
-    char version_dir[512];
     char source[512];
-    char dest[512];
-    char command[1024];
-    
-    snprintf(vault_dir, sizeof(vault_dir), "%s/.lyra/vault/%s", home, package_name);
-    mkdir(vault_dir, 0755);
-    
-    snprintf(version_dir, sizeof(version_dir), "%s/%s", vault_dir, version);
-    mkdir(version_dir, 0755);
     
     snprintf(source, sizeof(source), "/usr/local/bin/%s", package_name);
-    snprintf(dest, sizeof(dest), "%s/%s", version_dir, package_name);
     
-    snprintf(command, sizeof(command), "cp %s %s", source, dest);
-    system(command);
+    // Switching back and forth re-vaults the same binary; skip the recompress
+    if (vault_copy_matches(package_name, version, source)) {
+        printf("→ Vault copy of %s (%s) is up to date\n", package_name, version);
+        return;
+    }
     
-    printf("→ Backed up %s (%s) to vault\n", package_name, version);
+    if (vault_store(package_name, version, source)) {
+        printf("→ Backed up %s (%s) to vault\n", package_name, version);
+    }
 }
 
-void find_and_install_binary(char *extract_dir, char *package_name) {
-    char command[1024];
-    char binary_path[512];
-    FILE *fp;
+// Install the package's binary as /usr/local/bin/<package>, plus each name
+// in the comma-separated binaries list under its own name, plus the man
+// pages and shell completions shipped for them. Everything is located and
+// checked against the ownership index before anything is copied; each
+// installed file is added to files.
+int find_and_install_binary(char *extract_dir, char *package_name, char *binaries, cJSON *files) {
+    char names[LYRA_MAX_BINARIES + 1][256];
+    CompanionFile installs[LYRA_MAX_BINARIES + 1 + LYRA_MAX_COMPANIONS];
+    int count = 1;
+    
+    snprintf(names[0], sizeof(names[0]), "%s", package_name);
+    if (binaries) {
+        char copy[1024];
+        snprintf(copy, sizeof(copy), "%s", binaries);
+        char *save = NULL;
+        for (char *name = strtok_r(copy, ",", &save); name && count <= LYRA_MAX_BINARIES;
+             name = strtok_r(NULL, ",", &save)) {
+            snprintf(names[count++], sizeof(names[0]), "%s", name);
+        }
+    }
+    int binary_count = count;
     
     printf("→ Finding binary...\n");
     
-    snprintf(command, sizeof(command), 
-             "find %s -type f -executable | head -n 1", extract_dir);
-    
-    fp = popen(command, "r");
-    if (fp == NULL || fgets(binary_path, sizeof(binary_path), fp) == NULL) {
-        printf("Error: Could not find binary!\n");
-        if (fp) pclose(fp);
-        return;
+    TraceSpan span = trace_begin("find binary", TRACE_DISK, package_name);
+    for (int i = 0; i < binary_count; i++) {
+        if (!binary_find(extract_dir, names[i], i > 0, installs[i].source, sizeof(installs[i].source))) {
+            if (i == 0) {
+                printf("Error: Could not find binary!\n");
+            } else {
+                printf("Error: No executable named '%s' in the archive\n", names[i]);
+            }
+            trace_end(&span);
+            return 0;
+        }
+        snprintf(installs[i].dest, sizeof(installs[i].dest), "/usr/local/bin/%s", names[i]);
+        printf("Found: %s\n", installs[i].source);
+    }
+    count += companion_find(extract_dir, names, binary_count, installs + binary_count, LYRA_MAX_COMPANIONS);
+    trace_end(&span);
+    
+    // Never take over another package's files
+    for (int i = 0; i < count; i++) {
+        char owner[256];
+        if (!owners_lookup(installs[i].dest, owner, sizeof(owner)) || strcmp(owner, package_name) == 0) continue;
+        if (i < binary_count) {
+            printf("Error: %s belongs to package '%s'\n", installs[i].dest, owner);
+            return 0;
+        }
+        printf("→ Skipping %s (belongs to '%s')\n", installs[i].dest, owner);
+        installs[i--] = installs[--count];
     }
-    pclose(fp);
-    
-    binary_path[strcspn(binary_path, "\n")] = 0;
-    printf("Found: %s\n", binary_path);
-    
-    printf("→ Installing to /usr/local/bin/%s...\n", package_name);
-    snprintf(command, sizeof(command), 
-             "cp %s /usr/local/bin/%s", binary_path, package_name);
-    system(command);
     
-    snprintf(command, sizeof(command), 
-             "chmod +x /usr/local/bin/%s", package_name);
-    system(command);
+    for (int i = 0; i < count; i++) {
+        char *installed_path = installs[i].dest;
+        printf("→ Installing to %s...\n", installed_path);
+        
+        char dest_dir[512];
+        snprintf(dest_dir, sizeof(dest_dir), "%s", installed_path);
+        fs_mkdirs(dirname(dest_dir), 0755);
+        
+        span = trace_begin("install binary", TRACE_DISK, package_name);
+        if (!fs_copy_file(installs[i].source, installed_path, i < binary_count ? 0755 : 0644)) {
+            printf("Error: Could not copy %s to %s\n", installs[i].source, installed_path);
+            trace_end(&span);
+            return 0;
+        }
+        trace_end(&span);
+        
+        span = trace_begin("integrity hash", TRACE_CPU, package_name);
+        char sha256[SHA256_HEX_LEN];
+        if (sha256_file(installed_path, sha256)) {
+            integrity_record(installed_path, sha256);
+            manifest_add(files, installed_path, sha256);
+        } else {
+            manifest_add(files, installed_path, NULL);
+        }
+        trace_end(&span);
+    }
     
     printf("Done! Installed to /usr/local/bin/%s\n", package_name);
+    
+    return 1;
 }
 
-void install_package(char *package_name, char *url) {
+// Installs can run on several threads at once (lyra bundle); everything from
+// looking at the installed version to recording the new one happens under this
+static pthread_mutex_t install_commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int install_package(char *package_name, char *url, char *expected_sha256, char *binaries, char *depends) {
     char download_path[512];
     char extract_dir[512];
     char command[1024];
@@ -1012,6 +1837,10 @@ void install_package(char *package_name, char *url) {
     
     char old_version[256] = "";
     char old_url[1024] = "";
+    char old_sha256[SHA256_HEX_LEN] = "";
+    char old_binaries[1024] = "";
+    char old_depends[1024] = "";
+    cJSON *old_files = NULL;
     int has_old_version = 0;
     
     db_init();
@@ -1020,6 +1849,48 @@ void install_package(char *package_name, char *url) {
     
     extract_version_from_url(url, version);
     
+    // Download and check the archive before anything installed is touched
+    char expected[SHA256_HEX_LEN] = "";
+    if (expected_sha256) {
+        snprintf(expected, sizeof(expected), "%s", expected_sha256);
+    } else {
+        TraceSpan span = trace_begin("checksum lookup", TRACE_NET, package_name);
+        if (github_release_checksum(url, expected)) {
+            printf("→ Found published SHA-256 for this release\n");
+        }
+        trace_end(&span);
+    }
+    
+    snprintf(download_path, sizeof(download_path), "/tmp/%s.tar.gz", package_name);
+    snprintf(extract_dir, sizeof(extract_dir), "/tmp/%s_extracted", package_name);
+    
+    char sha256[SHA256_HEX_LEN];
+    printf("→ Downloading version %s...\n", version);
+    TraceSpan span = trace_begin("download", TRACE_NET, package_name);
+    int downloaded = download_verified(url, download_path, expected[0] ? expected : NULL, sha256);
+    trace_end(&span);
+    if (!downloaded) {
+        printf("  Nothing was installed\n");
+        metrics_count("lyra_install_failures_total", package_name, 1);
+        return 0;
+    }
+    
+    if (expected[0]) {
+        printf("✓ SHA-256 verified (%.16s…)\n", sha256);
+    } else {
+        printf("→ SHA-256: %s (no published checksum to compare)\n", sha256);
+    }
+    
+    fs_mkdirs(extract_dir, 0755);
+    
+    printf("→ Extracting...\n");
+    span = trace_begin("extract", TRACE_CPU, package_name);
+    snprintf(command, sizeof(command), "tar -xzf %s -C %s 2>/dev/null", download_path, extract_dir);
+    lyra_system(command);
+    trace_end(&span);
+    
+    pthread_mutex_lock(&install_commit_lock);
+    
     snprintf(installed_path, sizeof(installed_path), "/usr/local/bin/%s", package_name);
     if (access(installed_path, F_OK) == 0) {
         cJSON *root = db_read();
@@ -1041,6 +1912,15 @@ void install_package(char *package_name, char *url) {
                 strncpy(old_url, current_url_obj->valuestring, 1023);
                 old_url[1023] = '\0';
             }
+            
+            cJSON *current_sha256 = cJSON_GetObjectItem(pkg, "sha256");
+            if (current_sha256 && current_sha256->valuestring) {
+                snprintf(old_sha256, sizeof(old_sha256), "%s", current_sha256->valuestring);
+            }
+            
+            db_get_list(pkg, "binaries", old_binaries, sizeof(old_binaries));
+            db_get_list(pkg, "dependencies", old_depends, sizeof(old_depends));
+            old_files = manifest_files(pkg, package_name);
         }
         cJSON_Delete(root);
         
@@ -1049,21 +1929,20 @@ void install_package(char *package_name, char *url) {
         }
     }
     
-    snprintf(download_path, sizeof(download_path), "/tmp/%s.tar.gz", package_name);
-    snprintf(extract_dir, sizeof(extract_dir), "/tmp/%s_extracted", package_name);
-    
-    printf("→ Downloading version %s...\n", version);
-    snprintf(command, sizeof(command), "curl -L -o %s %s 2>/dev/null", download_path, url);
-    system(command);
-    
-    snprintf(command, sizeof(command), "mkdir -p %s", extract_dir);
-    system(command);
-    
-    printf("→ Extracting...\n");
-    snprintf(command, sizeof(command), "tar -xzf %s -C %s 2>/dev/null", download_path, extract_dir);
-    system(command);
+    // Upgrades keep the extra binaries and dependencies the package was installed with
+    if (!binaries) binaries = old_binaries;
+    if (!depends) depends = old_depends;
     
-    find_and_install_binary(extract_dir, package_name);
+    cJSON *files = cJSON_CreateArray();
+    if (!find_and_install_binary(extract_dir, package_name, binaries, files)) {
+        pthread_mutex_unlock(&install_commit_lock);
+        cJSON_Delete(files);
+        cJSON_Delete(old_files);
+        remove(download_path);
+        fs_remove_tree(extract_dir);
+        metrics_count("lyra_install_failures_total", package_name, 1);
+        return 0;
+    }
     
     if (has_old_version) {
         cJSON *root = db_read();
@@ -1080,38 +1959,68 @@ void install_package(char *package_name, char *url) {
             cJSON_AddStringToObject(ver_entry, "version", old_version);
             cJSON_AddStringToObject(ver_entry, "url", old_url);
             cJSON_AddStringToObject(ver_entry, "status", "muted");
+            if (old_sha256[0]) {
+                cJSON_AddStringToObject(ver_entry, "sha256", old_sha256);
+            }
             
             time_t now = time(NULL);
             char timestamp[64];
             strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
             cJSON_AddStringToObject(ver_entry, "installed_date", timestamp);
+            cJSON_AddStringToObject(ver_entry, "last_active", timestamp);
+            db_set_vault_bytes(ver_entry, package_name, old_version);
             
             cJSON_AddItemToArray(versions, ver_entry);
             
             cJSON_ReplaceItemInObject(pkg, "version", cJSON_CreateString(version));
             cJSON_ReplaceItemInObject(pkg, "url", cJSON_CreateString(url));
+            cJSON_DeleteItemFromObject(pkg, "sha256");
+            cJSON_AddStringToObject(pkg, "sha256", sha256);
+            cJSON_DeleteItemFromObject(pkg, "installed_date");
+            cJSON_AddStringToObject(pkg, "installed_date", timestamp);
+            db_set_vault_bytes(pkg, package_name, version);
+            db_set_list(pkg, "binaries", binaries);
+            db_set_list(pkg, "dependencies", depends);
+            cJSON_DeleteItemFromObject(pkg, "files");
+            cJSON_AddItemToObject(pkg, "files", cJSON_Duplicate(files, 1));
             
             db_write(root);
         }
         cJSON_Delete(root);
     } else {
-        db_add_package(package_name, version, url);
+        db_add_package(package_name, version, url, sha256, binaries, depends, files);
     }
     
     printf("→ Added to database\n");
+    metrics_count("lyra_installs_total", NULL, 1);
+    
+    // Files the old version had and this one doesn't go away
+    cJSON *old_file = NULL;
+    cJSON_ArrayForEach(old_file, old_files) {
+        cJSON *path = cJSON_GetObjectItem(old_file, "path");
+        if (cJSON_IsString(path) && !manifest_contains(files, path->valuestring)) {
+            unlink(path->valuestring);
+        }
+    }
+    owners_update(package_name, old_files, files);
+    pthread_mutex_unlock(&install_commit_lock);
+    cJSON_Delete(old_files);
+    cJSON_Delete(files);
     
     remove(download_path);
-    snprintf(command, sizeof(command), "rm -rf %s", extract_dir);
-    system(command);
+    fs_remove_tree(extract_dir);
+    
+    return 1;
 }
 
-void update_packages() {
+int update_packages() {
     printf("Checking for updates...\n");
     
     cJSON *root = db_read();
     cJSON *pkg = NULL;
     
     int updated = 0;
+    int failed = 0;
     
     cJSON_ArrayForEach(pkg, root) {
         char *pkg_name = pkg->string;
@@ -1145,21 +2054,34 @@ void update_packages() {
                 char latest_url[512];
                 char latest_version[64];
                 
-                if (get_latest_github_release(owner, repo, latest_url, latest_version)) {
+                TraceSpan span = trace_begin("release lookup", TRACE_NET, pkg_name);
+                int found = get_latest_github_release(owner, repo, latest_url, latest_version);
+                trace_end(&span);
+                
+                if (found) {
                     if (strcmp(current_version, latest_version) != 0) {
                         printf("  → Update available: %s → %s\n", current_version, latest_version);
                         printf("  → Installing update...\n");
                         
-                        install_package(pkg_name, latest_url);
-                        updated++;
+                        if (install_package(pkg_name, latest_url, NULL, NULL, NULL)) {
+                            metrics_count("lyra_updates_total", pkg_name, 1);
+                            updated++;
+                        } else {
+                            metrics_count("lyra_update_failures_total", pkg_name, 1);
+                            failed++;
+                        }
                     } else {
                         printf("  Already up to date (%s)\n", current_version);
                     }
                 } else {
                     printf("  Error: Could not fetch latest release from GitHub\n");
+                    metrics_count("lyra_update_failures_total", pkg_name, 1);
+                    failed++;
                 }
             } else {
                 printf("  Error: Could not parse GitHub URL\n");
+                metrics_count("lyra_update_failures_total", pkg_name, 1);
+                failed++;
             }
         } else if (strcmp(source, "mirror") == 0) {
             printf("  Mirror updates not implemented yet\n");
@@ -1168,16 +2090,24 @@ void update_packages() {
         }
     }
     
-    if (updated == 0) {
+    metrics_gauge("lyra_update_last_run_timestamp_seconds", NULL, (double)time(NULL));
+    if (failed == 0) {
+        metrics_gauge("lyra_update_last_success_timestamp_seconds", NULL, (double)time(NULL));
+    }
+    
+    if (failed > 0) {
+        printf("\n✗ Updated %d package%s, %d failed\n", updated, updated == 1 ? "" : "s", failed);
+    } else if (updated == 0) {
         printf("\n✓ All packages are up to date!\n");
     } else {
         printf("\n✓ Updated %d package%s\n", updated, updated == 1 ? "" : "s");
     }
     
     cJSON_Delete(root);
+    return failed == 0;
 }
 
-void take_snapshot() {
+int take_snapshot() {
     char *home = get_user_home();
     char snapshot_dir[512];
     char snapshot_path[512];
@@ -1195,19 +2125,21 @@ void take_snapshot() {
     snprintf(snapshot_dir, sizeof(snapshot_dir), "%s/.lyra/vault/snapshots", home);
     mkdir(snapshot_dir, 0755);
     
-    int snapshot_num = 1;
-    DIR *dir = opendir(snapshot_dir);
-    if (dir) {
-        struct dirent *entry;
-        char search_prefix[64];
-        snprintf(search_prefix, sizeof(search_prefix), "%s_", date_str);
-        
-        while ((entry = readdir(dir)) != NULL) {
-            if (strncmp(entry->d_name, search_prefix, strlen(search_prefix)) == 0) {
-                snapshot_num++;
-            }
-        }
-        closedir(dir);
+    char catalog_path[512];
+    snapshot_catalog_path(catalog_path, sizeof(catalog_path));
+    
+    int lock_fd = catalog_lock(catalog_path);
+    cJSON *catalog = snapshot_catalog_load();
+    
+    int snapshot_num = snapshot_catalog_next_number(catalog, date_str);
+    
+    // Someone may have dropped a snapshot file in by hand, don't overwrite it
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/%s_%d.json", 
+             snapshot_dir, date_str, snapshot_num);
+    while (access(snapshot_path, F_OK) == 0) {
+        snapshot_num++;
+        snprintf(snapshot_path, sizeof(snapshot_path), "%s/%s_%d.json", 
+                 snapshot_dir, date_str, snapshot_num);
     }
     
     cJSON *snapshot = cJSON_CreateObject();
@@ -1228,11 +2160,13 @@ void take_snapshot() {
         cJSON *status = cJSON_GetObjectItem(pkg, "status");
         cJSON *install_path = cJSON_GetObjectItem(pkg, "installed_path");
         cJSON *url = cJSON_GetObjectItem(pkg, "url");
+        cJSON *sha256 = cJSON_GetObjectItem(pkg, "sha256");
         
         if (version) cJSON_AddStringToObject(pkg_snapshot, "version", version->valuestring);
         if (status) cJSON_AddStringToObject(pkg_snapshot, "status", status->valuestring);
         if (install_path) cJSON_AddStringToObject(pkg_snapshot, "installPath", install_path->valuestring);
         if (url) cJSON_AddStringToObject(pkg_snapshot, "url", url->valuestring);
+        if (cJSON_IsString(sha256)) cJSON_AddStringToObject(pkg_snapshot, "sha256", sha256->valuestring);
         
         cJSON *muted_array = cJSON_CreateArray();
         cJSON *versions = cJSON_GetObjectItem(pkg, "versions");
@@ -1249,24 +2183,33 @@ void take_snapshot() {
     }
     
     cJSON_AddItemToObject(snapshot, "packages", packages);
+    int package_count = cJSON_GetArraySize(packages);
     cJSON_Delete(db);
     
-    snprintf(snapshot_path, sizeof(snapshot_path), "%s/%s_%d.json", 
-             snapshot_dir, date_str, snapshot_num);
-    
-    char *json_str = cJSON_Print(snapshot);
-    FILE *fp = fopen(snapshot_path, "w");
-    if (fp) {
-        fprintf(fp, "%s\n", json_str);
-        fclose(fp);
+    int ok = json_write_file_atomic(snapshot_path, snapshot);
+    if (ok) {
+        char name[128];
+        snprintf(name, sizeof(name), "%s_%d", date_str, snapshot_num);
+        
+        struct stat st;
+        long size_bytes = stat(snapshot_path, &st) == 0 ? (long)st.st_size : 0;
+        
+        snapshot_catalog_add(catalog, name, date_str, snapshot_num, timestamp,
+                             package_count, size_bytes);
+        if (!json_write_file_atomic(catalog_path, catalog)) {
+            printf("Warning: Could not update snapshot catalog\n");
+        }
+        
         printf("Snapshot saved: %s_%d\n", date_str, snapshot_num);
         printf("Location: %s\n", snapshot_path);
     } else {
         printf("Error: Could not save snapshot\n");
     }
     
-    free(json_str);
+    catalog_unlock(lock_fd);
+    cJSON_Delete(catalog);
     cJSON_Delete(snapshot);
+    return ok;
 }
 
 void list_snapshots() {
@@ -1275,67 +2218,236 @@ void list_snapshots() {
     
     snprintf(snapshot_dir, sizeof(snapshot_dir), "%s/.lyra/vault/snapshots", home);
     
-    DIR *dir = opendir(snapshot_dir);
-    if (!dir) {
-        printf("No snapshots found\n");
+    if (access(snapshot_dir, F_OK) != 0) {
+        if (output_structured()) {
+            output_list_begin();
+            output_list_end();
+        } else {
+            printf("No snapshots found\n");
+        }
+        return;
+    }
+    
+    cJSON *catalog = snapshot_catalog_load();
+    cJSON *entries = cJSON_GetObjectItem(catalog, "snapshots");
+    
+    if (output_structured()) {
+        output_list_begin();
+        cJSON *item = NULL;
+        cJSON_ArrayForEach(item, entries) {
+            output_record_begin();
+            output_field_json("name", cJSON_GetObjectItem(item, "name"));
+            output_field_json("date", cJSON_GetObjectItem(item, "date"));
+            output_field_json("number", cJSON_GetObjectItem(item, "number"));
+            output_field_json("timestamp", cJSON_GetObjectItem(item, "timestamp"));
+            output_field_json("packages", cJSON_GetObjectItem(item, "packages"));
+            output_field_json("size_bytes", cJSON_GetObjectItem(item, "sizeBytes"));
+            output_record_end();
+        }
+        output_list_end();
+        cJSON_Delete(catalog);
         return;
     }
     
     printf("Available snapshots:\n");
     printf("-------------------\n");
     
-    struct dirent *entry;
-    int count = 0;
+    int count = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, entries) {
+        cJSON *name = cJSON_GetObjectItem(item, "name");
+        cJSON *timestamp = cJSON_GetObjectItem(item, "timestamp");
+        cJSON *packages = cJSON_GetObjectItem(item, "packages");
+        
+        if (!name || !name->valuestring) continue;
+        
+        printf("  %s.json", name->valuestring);
+        if (timestamp && timestamp->valuestring && timestamp->valuestring[0]) {
+            printf(" - %s", timestamp->valuestring);
+        }
+        printf(" (%d packages)\n", packages ? packages->valueint : 0);
+        count++;
+    }
+    
+    cJSON_Delete(catalog);
+    
+    if (count == 0) {
+        printf("  (no snapshots found)\n");
+    } else {
+        printf("\nTotal: %d snapshots\n", count);
+    }
+}
+
+// Restore planner: each snapshot package is diffed against the live DB and
+// /usr/local/bin first, and only packages that actually differ get work queued
+enum {
+    RESTORE_KEEP,
+    RESTORE_FROM_VAULT,
+    RESTORE_DOWNLOAD,
+    RESTORE_UNAVAILABLE,
+    RESTORE_MULTI_BINARY  // version change on a package with --bin extras; left as is
+};
+
+typedef struct {
+    char name[256];
+    char version[256];
+    char url[1024];
+    char current_version[256];
+    int action;
+    int ok;
+    int extra_binaries;
+    char sha256[SHA256_HEX_LEN];  // of the restored binary
+    char archive_sha256[SHA256_HEX_LEN];  // recorded for this version, if known
+} RestorePlanItem;
+
+// Sorted view of a DB object's packages, so loops over a snapshot's
+// packages look each one up in O(log n) instead of walking the DB
+typedef struct {
+    const char *name;
+    cJSON *entry;
+} DbIndexEntry;
+
+typedef struct {
+    DbIndexEntry *entries;
+    int count;
+} DbIndex;
+
+static int db_index_compare(const void *a, const void *b) {
+    return strcmp(((const DbIndexEntry *)a)->name, ((const DbIndexEntry *)b)->name);
+}
+
+static void db_index_build(cJSON *root, DbIndex *index) {
+    index->count = 0;
+    index->entries = malloc((cJSON_GetArraySize(root) + 1) * sizeof(DbIndexEntry));
+    if (!index->entries) return;
+
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, root) {
+        if (!pkg->string) continue;
+        index->entries[index->count].name = pkg->string;
+        index->entries[index->count].entry = pkg;
+        index->count++;
+    }
+    qsort(index->entries, index->count, sizeof(DbIndexEntry), db_index_compare);
+}
+
+static cJSON *db_index_get(DbIndex *index, const char *name) {
+    DbIndexEntry key = { name, NULL };
+    DbIndexEntry *found = index->count > 0 ? bsearch(&key, index->entries, index->count,
+                                                     sizeof(DbIndexEntry), db_index_compare) : NULL;
+    return found ? found->entry : NULL;
+}
+
+// The DB entry for version of pkg: the package itself when it is active,
+// else its muted entry
+static cJSON *db_version_entry(cJSON *pkg, const char *version) {
+    cJSON *active = cJSON_GetObjectItem(pkg, "version");
+    if (cJSON_IsString(active) && strcmp(active->valuestring, version) == 0) return pkg;
+
+    cJSON *ver = NULL;
+    cJSON_ArrayForEach(ver, cJSON_GetObjectItem(pkg, "versions")) {
+        cJSON *v = cJSON_GetObjectItem(ver, "version");
+        if (cJSON_IsString(v) && strcmp(v->valuestring, version) == 0) return ver;
+    }
+    return NULL;
+}
+
+static void restore_plan_package(void *arg) {
+    RestorePlanItem *item = arg;
+    char vault_path[1024];
+    char dest_path[512];
+    
+    snprintf(dest_path, sizeof(dest_path), "/usr/local/bin/%s", item->name);
+    
+    int in_vault = vault_copy_path(item->name, item->version, vault_path, sizeof(vault_path)) != 0;
+    int installed = access(dest_path, F_OK) == 0;
+    int same_version = strcmp(item->current_version, item->version) == 0;
+    
+    if (item->extra_binaries && !same_version) {
+        item->action = RESTORE_MULTI_BINARY;
+        return;
+    }
+    
+    if (installed && same_version) {
+        // Already at the snapshot version; only recopy if the binary drifted from the vault copy
+        if (!in_vault || vault_copy_matches(item->name, item->version, dest_path)) {
+            item->action = RESTORE_KEEP;
+            return;
+        }
+    }
+    
+    if (in_vault) {
+        item->action = RESTORE_FROM_VAULT;
+    } else if (item->url[0]) {
+        item->action = RESTORE_DOWNLOAD;
+    } else {
+        item->action = RESTORE_UNAVAILABLE;
+    }
+}
+
+static int restore_from_url(RestorePlanItem *item, char *dest_path) {
+    char download_path[512];
+    char extract_dir[512];
+    char command[2048];
+    int ok = 0;
+    
+    snprintf(download_path, sizeof(download_path), "/tmp/%s_restore.tar.gz", item->name);
+    snprintf(extract_dir, sizeof(extract_dir), "/tmp/%s_restore_extracted", item->name);
+    
+    // Checked against the hash recorded when this version was installed
+    char sha256[SHA256_HEX_LEN];
+    char *expected = item->archive_sha256[0] ? item->archive_sha256 : NULL;
+    if (!download_verified(item->url, download_path, expected, sha256)) {
+        printf("  Error: Failed to download %s from URL\n", item->name);
+        return 0;
+    }
+    if (!expected) snprintf(item->archive_sha256, sizeof(item->archive_sha256), "%s", sha256);
+    
+    fs_mkdirs(extract_dir, 0755);
     
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
-        if (strstr(entry->d_name, ".json") == NULL) continue;
-        
-        char snapshot_path[512];
-        snprintf(snapshot_path, sizeof(snapshot_path), "%s/%s", snapshot_dir, entry->d_name);
-        
-        FILE *fp = fopen(snapshot_path, "r");
-        if (fp) {
-            fseek(fp, 0, SEEK_END);
-            long size = ftell(fp);
-            fseek(fp, 0, SEEK_SET);
-            
-            char *content = malloc(size + 1);
-            if (content) {  // FIX: Check malloc result
-                fread(content, 1, size, fp);
-                content[size] = '\0';
-                fclose(fp);
-                
-                cJSON *snapshot = cJSON_Parse(content);
-                if (snapshot) {
-                    cJSON *timestamp = cJSON_GetObjectItem(snapshot, "timestamp");
-                    cJSON *packages = cJSON_GetObjectItem(snapshot, "packages");
-                    int pkg_count = packages ? cJSON_GetArraySize(packages) : 0;
-                    
-                    printf("  %s", entry->d_name);
-                    if (timestamp) printf(" - %s", timestamp->valuestring);
-                    printf(" (%d packages)\n", pkg_count);
-                    
-                    cJSON_Delete(snapshot);  // FIX: Free cJSON
-                }
-                free(content);  // FIX: Free malloc'd content
-                count++;
-            } else {
-                fclose(fp);
-            }
+    snprintf(command, sizeof(command), "tar -xzf %s -C %s 2>/dev/null", download_path, extract_dir);
+    lyra_system(command);
+    
+    char binary_path[1024];
+    if (binary_find(extract_dir, item->name, 0, binary_path, sizeof(binary_path))) {
+        if (fs_copy_file(binary_path, dest_path, 0755)) {
+            if (sha256_file(dest_path, item->sha256)) integrity_record(dest_path, item->sha256);
+            vault_store(item->name, item->version, binary_path);
+            ok = 1;
+        } else {
+            printf("  Error: Could not copy %s to %s\n", binary_path, dest_path);
         }
+    } else {
+        printf("  Error: Could not find binary in downloaded archive for %s\n", item->name);
     }
     
-    closedir(dir);  // FIX: Close directory
+    remove(download_path);
+    fs_remove_tree(extract_dir);
     
-    if (count == 0) {
-        printf("  (no snapshots found)\n");
-    } else {
-        printf("\nTotal: %d snapshots\n", count);
+    return ok;
+}
+
+static void restore_execute_package(void *arg) {
+    RestorePlanItem *item = arg;
+    char dest_path[512];
+    
+    snprintf(dest_path, sizeof(dest_path), "/usr/local/bin/%s", item->name);
+    
+    if (item->action == RESTORE_FROM_VAULT) {
+        if (vault_activate(item->name, item->version, dest_path, item->sha256)) {
+            printf("  → Restored %s (%s)\n", item->name, item->version);
+            item->ok = 1;
+        }
+    } else if (item->action == RESTORE_DOWNLOAD) {
+        printf("    → Re-downloading %s (%s) from URL: %s\n", item->name, item->version, item->url);
+        item->ok = restore_from_url(item, dest_path);
+        if (item->ok) {
+            printf("  → Restored %s (%s) from URL\n", item->name, item->version);
+        }
     }
 }
 
-void restore_snapshot(char *date, int number) {
+int restore_snapshot(char *date, int number) {
     char *home = get_user_home();
     char snapshot_path[512];
 
@@ -1344,7 +2456,7 @@ void restore_snapshot(char *date, int number) {
 
     if (access(snapshot_path, F_OK) != 0) {
         printf("Error: Snapshot '%s_%d' not found\n", date, number);
-        return;
+        return 0;
     }
 
     printf("WARNING: This will restore your system to snapshot %s_%d\n", date, number);
@@ -1355,53 +2467,113 @@ void restore_snapshot(char *date, int number) {
     if (fgets(response, sizeof(response), stdin) == NULL ||
         (response[0] != 'y' && response[0] != 'Y')) {
         printf("Restore cancelled\n");
-        return;
-    }
-
-    FILE *fp = fopen(snapshot_path, "r");
-    if (!fp) {
-        printf("Error: Could not read snapshot\n");
-        return;
-    }
-
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    char *content = malloc(size + 1);
-    if (!content) {
-        fclose(fp);
-        printf("Error: Out of memory\n");
-        return;
+        return 0;
     }
-    fread(content, 1, size, fp);
-    content[size] = '\0';
-    fclose(fp);
 
-    cJSON *snapshot = cJSON_Parse(content);
-    free(content);
+    cJSON *snapshot = json_read_file(snapshot_path);
 
     if (!snapshot) {
         printf("Error: Invalid snapshot file\n");
-        return;
+        return 0;
     }
 
     cJSON *packages = cJSON_GetObjectItem(snapshot, "packages");
     if (!packages) {
         printf("Error: No packages in snapshot\n");
         cJSON_Delete(snapshot);
-        return;
+        return 0;
     }
 
-    printf("→ Restoring snapshot...\n");
+    printf("→ Planning restore...\n");
 
-    cJSON *new_db = cJSON_CreateObject();
+    int total = cJSON_GetArraySize(packages);
+    RestorePlanItem *plan = calloc(total > 0 ? total : 1, sizeof(RestorePlanItem));
+    if (!plan) {
+        printf("Error: Out of memory\n");
+        cJSON_Delete(snapshot);
+        return 0;
+    }
+
+    cJSON *current_db = db_read();
+    DbIndex current_index;
+    db_index_build(current_db, &current_index);
+    int planned = 0;
 
     cJSON *pkg = NULL;
     cJSON_ArrayForEach(pkg, packages) {
         char *pkg_name = pkg->string;
         if (!pkg_name) continue;
 
+        cJSON *version_obj = cJSON_GetObjectItem(pkg, "version");
+        if (!version_obj || !version_obj->valuestring) {
+            printf("  Warning: package '%s' in snapshot lacks 'version', skipping\n", pkg_name);
+            continue;
+        }
+
+        RestorePlanItem *item = &plan[planned++];
+        strncpy(item->name, pkg_name, sizeof(item->name) - 1);
+        strncpy(item->version, version_obj->valuestring, sizeof(item->version) - 1);
+
+        cJSON *url_obj = cJSON_GetObjectItem(pkg, "url");
+        if (url_obj && url_obj->valuestring) {
+            strncpy(item->url, url_obj->valuestring, sizeof(item->url) - 1);
+        }
+
+        cJSON *current = db_index_get(&current_index, pkg_name);
+        cJSON *current_ver = current ? cJSON_GetObjectItem(current, "version") : NULL;
+        if (current_ver && current_ver->valuestring) {
+            strncpy(item->current_version, current_ver->valuestring, sizeof(item->current_version) - 1);
+        }
+        item->extra_binaries = db_has_extra_binaries(current);
+
+        cJSON *sha256_obj = cJSON_GetObjectItem(pkg, "sha256");
+        if (!sha256_obj) sha256_obj = cJSON_GetObjectItem(db_version_entry(current, item->version), "sha256");
+        if (cJSON_IsString(sha256_obj)) {
+            snprintf(item->archive_sha256, sizeof(item->archive_sha256), "%s", sha256_obj->valuestring);
+        }
+    }
+
+    int threads = pool_default_threads();
+    pool_run(restore_plan_package, plan, sizeof(RestorePlanItem), planned, threads);
+
+    int keep = 0, from_vault = 0, download = 0, unavailable = 0;
+    for (int i = 0; i < planned; i++) {
+        switch (plan[i].action) {
+            case RESTORE_KEEP: keep++; break;
+            case RESTORE_FROM_VAULT: from_vault++; break;
+            case RESTORE_DOWNLOAD: download++; break;
+            case RESTORE_MULTI_BINARY:
+                printf("    Warning: %s installs several binaries; keeping %s instead of switching to %s\n",
+                       plan[i].name, plan[i].current_version, plan[i].version);
+                unavailable++;
+                break;
+            default:
+                printf("    Warning: Version %s for package %s not found in vault\n",
+                       plan[i].version, plan[i].name);
+                printf("  Error: No URL available to re-download package\n");
+                unavailable++;
+                break;
+        }
+    }
+
+    printf("→ Plan: %d unchanged, %d from vault, %d to download, %d unavailable\n",
+           keep, from_vault, download, unavailable);
+
+    if (from_vault + download > 0) {
+        printf("→ Restoring snapshot...\n");
+        fflush(stdout);
+        pool_run(restore_execute_package, plan, sizeof(RestorePlanItem), planned, threads);
+    }
+
+    cJSON *new_db = cJSON_CreateObject();
+
+    // Same packages in the same order as the plan
+    RestorePlanItem *item = plan;
+    pkg = NULL;
+    cJSON_ArrayForEach(pkg, packages) {
+        char *pkg_name = pkg->string;
+        if (!pkg_name) continue;
+
         cJSON *version_obj = cJSON_GetObjectItem(pkg, "version");
         cJSON *status_obj = cJSON_GetObjectItem(pkg, "status");
         cJSON *url_obj = cJSON_GetObjectItem(pkg, "url");
@@ -1413,126 +2585,104 @@ void restore_snapshot(char *date, int number) {
         const char *url = url_obj && url_obj->valuestring ? url_obj->valuestring : NULL;
         const char *installed_path = installed_path_obj && installed_path_obj->valuestring ? installed_path_obj->valuestring : NULL;
 
-        if (!version) {
-            printf("  Warning: package '%s' in snapshot lacks 'version', skipping\n", pkg_name);
-            continue;
-        }
+        if (!version) continue;
 
-        char vault_path[512];
         char dest_path[512];
-        char command[1024];
-
-        snprintf(vault_path, sizeof(vault_path), "%s/.lyra/vault/%s/%s/%s",
-                 home, pkg_name, version, pkg_name);
         snprintf(dest_path, sizeof(dest_path), "/usr/local/bin/%s", pkg_name);
+        cJSON *current = db_index_get(&current_index, pkg_name);
 
-        if (access(vault_path, F_OK) != 0) {
-            printf("    Warning: Version %s for package %s not found in vault\n", version, pkg_name);
-            
-            if (url) {
-                printf("    → Re-downloading from URL: %s\n", url);
-                
-                char download_path[512];
-                char extract_dir[512];
-                snprintf(download_path, sizeof(download_path), "/tmp/%s_restore.tar.gz", pkg_name);
-                snprintf(extract_dir, sizeof(extract_dir), "/tmp/%s_restore_extracted", pkg_name);
-                
-                snprintf(command, sizeof(command), "curl -L -o %s %s 2>/dev/null", download_path, url);
-                if (system(command) == 0) {
-                    snprintf(command, sizeof(command), "mkdir -p %s", extract_dir);
-                    system(command);
-                    
-                    snprintf(command, sizeof(command), "tar -xzf %s -C %s 2>/dev/null", download_path, extract_dir);
-                    system(command);
-                    
-                    snprintf(command, sizeof(command), "find %s -type f -executable | head -n 1", extract_dir);
-                    FILE *fp = popen(command, "r");
-                    char binary_path[512];
-                    if (fp && fgets(binary_path, sizeof(binary_path), fp)) {
-                        binary_path[strcspn(binary_path, "\n")] = 0;
-                        
-                        snprintf(command, sizeof(command), "cp %s %s", binary_path, dest_path);
-                        system(command);
-                        snprintf(command, sizeof(command), "chmod +x %s", dest_path);
-                        system(command);
-                        
-                        char vault_ver_dir[512];
-                        snprintf(vault_ver_dir, sizeof(vault_ver_dir), "%s/.lyra/vault/%s/%s", home, pkg_name, version);
-                        snprintf(command, sizeof(command), "mkdir -p %s", vault_ver_dir);
-                        system(command);
-                        snprintf(command, sizeof(command), "cp %s %s/%s", binary_path, vault_ver_dir, pkg_name);
-                        system(command);
-                        
-                        printf("  → Restored %s (%s) from URL\n", pkg_name, version);
-                        
-                        if (fp) pclose(fp);
-                    } else {
-                        printf("  Error: Could not find binary in downloaded archive\n");
-                        if (fp) pclose(fp);
-                    }
-                    
-                    remove(download_path);
-                    snprintf(command, sizeof(command), "rm -rf %s", extract_dir);
-                    system(command);
-                } else {
-                    printf("  Error: Failed to download from URL\n");
-                }
-            } else {
-                printf("  Error: No URL available to re-download package\n");
-            }
-        } else {
-            snprintf(command, sizeof(command), "cp %s %s", vault_path, dest_path);
-            if (system(command) == 0) {
-                snprintf(command, sizeof(command), "chmod +x %s", dest_path);
-                system(command);
-                printf("  → Restored %s (%s)\n", pkg_name, version);
-            } else {
-                printf("  Error: Failed to copy %s to %s\n", vault_path, dest_path);
-            }
+        // Nothing on disk changed for it, so neither does its entry
+        if (item->action == RESTORE_MULTI_BINARY) {
+            cJSON_AddItemToObject(new_db, pkg_name, cJSON_Duplicate(current, 1));
+            item++;
+            continue;
         }
 
         cJSON *pkg_entry = cJSON_CreateObject();
         cJSON_AddStringToObject(pkg_entry, "version", version);
         if (url) cJSON_AddStringToObject(pkg_entry, "url", url);
+        if (item->archive_sha256[0]) cJSON_AddStringToObject(pkg_entry, "sha256", item->archive_sha256);
         if (installed_path) cJSON_AddStringToObject(pkg_entry, "installed_path", installed_path);
         else cJSON_AddStringToObject(pkg_entry, "installed_path", dest_path);
         cJSON_AddStringToObject(pkg_entry, "status", status);
+        
+        // Dates and cached sizes stay with the package and its versions, as
+        // with -m; a re-download stored a new vault copy
+        db_move_field(pkg_entry, current, "installed_date");
+        if (item->action == RESTORE_DOWNLOAD && item->ok) {
+            db_set_vault_bytes(pkg_entry, pkg_name, (char *)version);
+        } else {
+            db_move_field(pkg_entry, db_version_entry(current, version), "vault_bytes");
+        }
 
         cJSON *versions_obj = cJSON_CreateArray();
         if (muted_array && cJSON_IsArray(muted_array) && cJSON_GetArraySize(muted_array) > 0) {
             cJSON *mv = NULL;
             cJSON_ArrayForEach(mv, muted_array) {
-                if (cJSON_IsString(mv)) {
-                    cJSON *verobj = cJSON_CreateObject();
-                    cJSON_AddStringToObject(verobj, "version", mv->valuestring);
-                    cJSON_AddStringToObject(verobj, "status", "muted");
-                    cJSON_AddItemToArray(versions_obj, verobj);
-                } else if (cJSON_IsObject(mv)) {
-                    cJSON *verstr = cJSON_GetObjectItem(mv, "version");
-                    cJSON *urlstr = cJSON_GetObjectItem(mv, "url");
-                    cJSON *verobj = cJSON_CreateObject();
-                    if (verstr && verstr->valuestring) cJSON_AddStringToObject(verobj, "version", verstr->valuestring);
-                    if (urlstr && urlstr->valuestring) cJSON_AddStringToObject(verobj, "url", urlstr->valuestring);
-                    cJSON_AddStringToObject(verobj, "status", "muted");
-                    cJSON_AddItemToArray(versions_obj, verobj);
+                // Snapshots list muted versions by name; their url and
+                // archive hash come from the live DB when it still knows them
+                cJSON *verstr = cJSON_IsString(mv) ? mv : cJSON_GetObjectItem(mv, "version");
+                if (!cJSON_IsString(verstr)) continue;
+                cJSON *known = db_version_entry(current, verstr->valuestring);
+                cJSON *verobj = cJSON_CreateObject();
+                cJSON_AddStringToObject(verobj, "version", verstr->valuestring);
+                db_move_field(verobj, cJSON_IsObject(mv) && cJSON_GetObjectItem(mv, "url") ? mv : known, "url");
+                db_move_field(verobj, known, "sha256");
+                db_move_field(verobj, known, "vault_bytes");
+                if (current && known == current) {
+                    db_stamp_last_active(verobj);  // active until this restore
+                } else {
+                    db_move_field(verobj, known, "installed_date");
+                    db_move_field(verobj, known, "last_active");
                 }
+                cJSON_AddStringToObject(verobj, "status", "muted");
+                cJSON_AddItemToArray(versions_obj, verobj);
             }
         }
         cJSON_AddItemToObject(pkg_entry, "versions", versions_obj);
 
+        // The files a package installed and what it depends on stay with it;
+        // only its binary changed
+        cJSON *current_files = cJSON_GetObjectItem(current, "files");
+        cJSON *current_binaries = cJSON_GetObjectItem(current, "binaries");
+        cJSON *current_dependencies = cJSON_GetObjectItem(current, "dependencies");
+        if (current_binaries) cJSON_AddItemToObject(pkg_entry, "binaries", cJSON_Duplicate(current_binaries, 1));
+        if (current_dependencies) {
+            cJSON_AddItemToObject(pkg_entry, "dependencies", cJSON_Duplicate(current_dependencies, 1));
+        }
+        if (current_files) cJSON_AddItemToObject(pkg_entry, "files", cJSON_Duplicate(current_files, 1));
+        if (item->ok && item->sha256[0]) manifest_set_hash(pkg_entry, dest_path, item->sha256);
+        item++;
+
         cJSON_AddItemToObject(new_db, pkg_name, pkg_entry);
     }
 
     db_write(new_db);
     cJSON_Delete(new_db);
+    free(current_index.entries);
+    cJSON_Delete(current_db);
+    owners_rebuild();
+
+    int failed = 0;
+    for (int i = 0; i < planned; i++) {
+        if (plan[i].action == RESTORE_MULTI_BINARY ||
+            ((plan[i].action == RESTORE_FROM_VAULT || plan[i].action == RESTORE_DOWNLOAD) && !plan[i].ok)) {
+            failed++;
+        }
+    }
+    free(plan);
 
+    if (failed > 0) {
+        printf("Warning: %d package%s could not be restored\n", failed, failed == 1 ? "" : "s");
+    }
     printf("Done! System restored to snapshot %s_%d\n", date, number);
     printf("Note: Run 'lyra -list' to verify\n");
 
     cJSON_Delete(snapshot);
+    return failed == 0;
 }
 
-void mute_package(char *arg) {
+int mute_package(char *arg) {
     char package_name[256];
     char target_version[256] = "";
     int has_target = 0;
@@ -1555,21 +2705,29 @@ void mute_package(char *arg) {
     if (!pkg) {
         printf("Error: Package '%s' not found\n", package_name);
         cJSON_Delete(root);
-        return;
+        return 0;
+    }
+    
+    if (db_has_extra_binaries(pkg)) {
+        printf("Error: %s installs several binaries and the vault only keeps %s itself\n",
+               package_name, package_name);
+        printf("Reinstall the version you want with -i instead\n");
+        cJSON_Delete(root);
+        return 0;
     }
     
     cJSON *versions = cJSON_GetObjectItem(pkg, "versions");
     if (!versions || cJSON_GetArraySize(versions) == 0) {
         printf("Error: No muted versions available for '%s'\n", package_name);
         cJSON_Delete(root);
-        return;
+        return 0;
     }
     
     cJSON *current_ver = cJSON_GetObjectItem(pkg, "version");
     if (!current_ver || !current_ver->valuestring) {
         printf("Error: Could not determine current version\n");
         cJSON_Delete(root);
-        return;
+        return 0;
     }
     
     char active_version[256];
@@ -1599,7 +2757,7 @@ void mute_package(char *arg) {
             printf("Error: Version '%s' not found in muted versions\n", target_version);
             printf("Use 'lyra -lv %s' to see available versions\n", package_name);
             cJSON_Delete(root);
-            return;
+            return 0;
         }
     } else {
         target_entry = cJSON_GetArrayItem(versions, 0);
@@ -1614,77 +2772,89 @@ void mute_package(char *arg) {
     if (!target_entry || strlen(found_version) == 0) {
         printf("Error: Could not find target version\n");
         cJSON_Delete(root);
-        return;
+        return 0;
     }
     
     printf("→ Switching from %s to %s\n", active_version, found_version);
     
     backup_to_vault(package_name, active_version);
     
-    char *home = get_user_home();
-    char vault_path[512];
+    char vault_path[1024];
     char dest_path[512];
-    char command[1024];
     
-    snprintf(vault_path, sizeof(vault_path), "%s/.lyra/vault/%s/%s/%s", 
-             home, package_name, found_version, package_name);
     snprintf(dest_path, sizeof(dest_path), "/usr/local/bin/%s", package_name);
     
-    if (access(vault_path, F_OK) != 0) {
+    if (!vault_copy_path(package_name, found_version, vault_path, sizeof(vault_path))) {
         printf("Error: Muted version not found in vault\n");
         cJSON_Delete(root);
-        return;
+        return 0;
+    }
+    
+    char sha256[SHA256_HEX_LEN] = "";
+    if (!vault_activate(package_name, found_version, dest_path, sha256)) {
+        cJSON_Delete(root);
+        return 0;
     }
     
-    snprintf(command, sizeof(command), "cp %s %s", vault_path, dest_path);
-    system(command);
-    snprintf(command, sizeof(command), "chmod +x %s", dest_path);
-    system(command);
+    // The outgoing version keeps its own url and archive hash
+    cJSON *new_muted = cJSON_CreateObject();
+    cJSON_AddStringToObject(new_muted, "version", active_version);
+    db_move_field(new_muted, pkg, "url");
+    db_move_field(new_muted, pkg, "sha256");
     
     cJSON *target_url = cJSON_GetObjectItem(target_entry, "url");
     cJSON_ReplaceItemInObject(pkg, "version", cJSON_CreateString(found_version));
+    db_set_vault_bytes(pkg, package_name, found_version);
+    manifest_set_hash(pkg, dest_path, sha256);
     if (target_url) {
         cJSON_ReplaceItemInObject(pkg, "url", cJSON_CreateString(target_url->valuestring));
     }
+    db_move_field(pkg, target_entry, "sha256");
     
-    cJSON_DetachItemFromArray(versions, target_index);
+    cJSON_DeleteItemFromArray(versions, target_index);
     
-    cJSON *new_muted = cJSON_CreateObject();
-    cJSON_AddStringToObject(new_muted, "version", active_version);
-    cJSON *old_url = cJSON_GetObjectItem(pkg, "url");
-    if (old_url) {
-        cJSON_AddStringToObject(new_muted, "url", old_url->valuestring);
-    }
+    db_stamp_last_active(new_muted);
+    db_set_vault_bytes(new_muted, package_name, active_version);
     cJSON_AddItemToArray(versions, new_muted);
     
     db_write(root);
     cJSON_Delete(root);
     
     printf("Done! Now using %s version %s\n", package_name, found_version);
+    
+    return 1;
 }
 
-void unmute_package(char *package_name) {
+int unmute_package(char *package_name) {
     cJSON *root = db_read();
     cJSON *pkg = cJSON_GetObjectItem(root, package_name);
     
     if (!pkg) {
         printf("Error: Package '%s' not found\n", package_name);
         cJSON_Delete(root);
-        return;
+        return 0;
+    }
+    
+    if (db_has_extra_binaries(pkg)) {
+        printf("Error: %s installs several binaries and the vault only keeps %s itself\n",
+               package_name, package_name);
+        printf("Reinstall the version you want with -i instead\n");
+        cJSON_Delete(root);
+        return 0;
     }
     
     cJSON *versions = cJSON_GetObjectItem(pkg, "versions");
     if (!versions || cJSON_GetArraySize(versions) == 0) {
         printf("Error: Package '%s' has no muted versions to unmute\n", package_name);
         cJSON_Delete(root);
-        return;
+        return 0;
     }
     
     cJSON *current_ver = cJSON_GetObjectItem(pkg, "version");
     if (!current_ver || !current_ver->valuestring) {
         printf("Error: Could not determine current version\n");
         cJSON_Delete(root);
-        return;
+        return 0;
     }
     
     char active_version[256];
@@ -1697,7 +2867,7 @@ void unmute_package(char *package_name) {
     if (!v || !v->valuestring) {
         printf("Error: Invalid muted version data\n");
         cJSON_Delete(root);
-        return;
+        return 0;
     }
     
     char unmute_version[256];
@@ -1708,90 +2878,112 @@ void unmute_package(char *package_name) {
     
     backup_to_vault(package_name, active_version);
     
-    char *home = get_user_home();
-    char vault_path[512];
+    char vault_path[1024];
     char dest_path[512];
-    char command[1024];
     
-    snprintf(vault_path, sizeof(vault_path), "%s/.lyra/vault/%s/%s/%s", 
-             home, package_name, unmute_version, package_name);
     snprintf(dest_path, sizeof(dest_path), "/usr/local/bin/%s", package_name);
     
-    if (access(vault_path, F_OK) != 0) {
+    if (!vault_copy_path(package_name, unmute_version, vault_path, sizeof(vault_path))) {
         printf("Error: Unmuted version not found in vault\n");
         cJSON_Delete(root);
-        return;
+        return 0;
+    }
+    
+    char sha256[SHA256_HEX_LEN] = "";
+    if (!vault_activate(package_name, unmute_version, dest_path, sha256)) {
+        cJSON_Delete(root);
+        return 0;
     }
     
-    snprintf(command, sizeof(command), "cp %s %s", vault_path, dest_path);
-    system(command);
-    snprintf(command, sizeof(command), "chmod +x %s", dest_path);
-    system(command);
+    // The outgoing version keeps its own url and archive hash
+    cJSON *new_muted = cJSON_CreateObject();
+    cJSON_AddStringToObject(new_muted, "version", active_version);
+    db_move_field(new_muted, pkg, "url");
+    db_move_field(new_muted, pkg, "sha256");
     
     cJSON *target_url = cJSON_GetObjectItem(target_entry, "url");
     cJSON_ReplaceItemInObject(pkg, "version", cJSON_CreateString(unmute_version));
+    db_set_vault_bytes(pkg, package_name, unmute_version);
+    manifest_set_hash(pkg, dest_path, sha256);
     if (target_url) {
         cJSON_ReplaceItemInObject(pkg, "url", cJSON_CreateString(target_url->valuestring));
     }
+    db_move_field(pkg, target_entry, "sha256");
     
-    cJSON_DetachItemFromArray(versions, 0);
+    cJSON_DeleteItemFromArray(versions, 0);
     
-    cJSON *new_muted = cJSON_CreateObject();
-    cJSON_AddStringToObject(new_muted, "version", active_version);
-    cJSON *old_url = cJSON_GetObjectItem(pkg, "url");
-    if (old_url) {
-        cJSON_AddStringToObject(new_muted, "url", old_url->valuestring);
-    }
+    db_stamp_last_active(new_muted);
+    db_set_vault_bytes(new_muted, package_name, active_version);
     cJSON_AddItemToArray(versions, new_muted);
     
     db_write(root);
     cJSON_Delete(root);
     
     printf("Done! Now using %s version %s\n", package_name, unmute_version);
+    
+    return 1;
+}
+
+// Unlink every other file in the package's manifest and drop its index
+// entries; the caller has removed the binary itself
+static void remove_owned_files(char *package_name) {
+    cJSON *root = db_read();
+    cJSON *pkg = cJSON_GetObjectItem(root, package_name);
+    cJSON *files = pkg ? manifest_files(pkg, package_name) : NULL;
+    
+    cJSON *file = NULL;
+    cJSON_ArrayForEach(file, files) {
+        cJSON *path = cJSON_GetObjectItem(file, "path");
+        if (cJSON_IsString(path) && unlink(path->valuestring) == 0) {
+            printf("→ Removed %s\n", path->valuestring);
+        }
+    }
+    owners_update(package_name, files, NULL);
+    
+    cJSON_Delete(files);
+    cJSON_Delete(root);
 }
 
-void remove_package(char *package_name) {
+int remove_package(char *package_name) {
     char path[512];
-    char command[1024];
     
     snprintf(path, sizeof(path), "/usr/local/bin/%s", package_name);
     
     if (access(path, F_OK) != 0) {
         printf("Error: Package '%s' is not installed\n", package_name);
-        return;
+        return 0;
     }
     
     printf("→ Removing %s...\n", package_name);
     
-    snprintf(command, sizeof(command), "rm %s", path);
-    
-    if (system(command) == 0) {
+    if (unlink(path) == 0) {
         printf("Done! Removed %s\n", package_name);
         printf("→ Vault copy preserved for future restoration\n");
         
+        remove_owned_files(package_name);
         db_remove_package(package_name);
         printf("→ Removed from database\n");
     } else {
         printf("Error: Failed to remove %s\n", package_name);
+        return 0;
     }
+    
+    return 1;
 }
 
-void remove_package_completely(char *package_name) {
+int remove_package_completely(char *package_name) {
     char path[512];
-    char command[1024];
     
     snprintf(path, sizeof(path), "/usr/local/bin/%s", package_name);
     
     if (access(path, F_OK) != 0) {
         printf("Error: Package '%s' is not installed\n", package_name);
-        return;
+        return 0;
     }
     
     printf("→ Completely removing %s (including vault and frozen copies)...\n", package_name);
     
-    snprintf(command, sizeof(command), "rm %s", path);
-    
-    if (system(command) == 0) {
+    if (unlink(path) == 0) {
         printf("Done! Removed %s\n", package_name);
         
         char *home = get_user_home();
@@ -1799,24 +2991,51 @@ void remove_package_completely(char *package_name) {
         char frozen_dir[512];
         
         snprintf(vault_dir, sizeof(vault_dir), "%s/.lyra/vault/%s", home, package_name);
-        snprintf(command, sizeof(command), "rm -rf %s", vault_dir);
-        system(command);
+        fs_remove_tree(vault_dir);
         
         snprintf(frozen_dir, sizeof(frozen_dir), "%s/.lyra/vault/frozen/%s", home, package_name);
-        snprintf(command, sizeof(command), "rm -rf %s", frozen_dir);
-        system(command);
         
+        char catalog_path[512];
+        frozen_catalog_path(catalog_path, sizeof(catalog_path));
+        int lock_fd = catalog_lock(catalog_path);
+        cJSON *catalog = frozen_catalog_load();
+        
+        // Let go of the chunks held by every frozen version of the package
+        ChunkStore *store = chunk_store_open(NULL);
+        cJSON *item = NULL;
+        cJSON_ArrayForEach(item, cJSON_GetObjectItem(catalog, "copies")) {
+            cJSON *item_pkg = cJSON_GetObjectItem(item, "package");
+            cJSON *item_ver = cJSON_GetObjectItem(item, "version");
+            if (store && item_pkg && item_ver && item_ver->valuestring &&
+                strcmp(item_pkg->valuestring, package_name) == 0) {
+                char version_dir[1024];
+                snprintf(version_dir, sizeof(version_dir), "%s/%s", frozen_dir, item_ver->valuestring);
+                chunk_store_release_manifest(store, version_dir);
+            }
+        }
+        chunk_store_close(store);
+        
+        fs_remove_tree(frozen_dir);
+        
+        frozen_catalog_remove(catalog, package_name, NULL);
+        json_write_file_atomic(catalog_path, catalog);
+        cJSON_Delete(catalog);
+        catalog_unlock(lock_fd);
+        
+        remove_owned_files(package_name);
         db_remove_package(package_name);
         printf("→ Removed from database, vault, and frozen copies\n");
     } else {
         printf("Error: Failed to remove %s\n", package_name);
+        return 0;
     }
+    
+    return 1;
 }
 
 void clean_everything() {
     char *home = get_user_home();
     char lyra_dir[512];
-    char command[1024];
     
     printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
     printf("  LYRA NUCLEAR CLEANUP WARNING \n");
@@ -1852,9 +3071,7 @@ void clean_everything() {
     
     if (access(lyra_dir, F_OK) == 0) {
         printf("→ Removing %s...\n", lyra_dir);
-        snprintf(command, sizeof(command), "rm -rf %s", lyra_dir);
-        
-        if (system(command) == 0) {
+        if (fs_remove_tree(lyra_dir)) {
             printf("✓ Successfully removed ~/.lyra\n");
         } else {
             printf("✗ Error: Failed to remove ~/.lyra\n");
@@ -1881,7 +3098,6 @@ void uninstall_lyra() {
     char *home = get_user_home();
     char lyra_dir[512];
     char lyra_binary[512];
-    char command[1024];
     
     printf("\n");
     printf("  LYRA COMPLETE UNINSTALL WARNING \n");
@@ -1918,9 +3134,7 @@ void uninstall_lyra() {
     
     if (access(lyra_dir, F_OK) == 0) {
         printf("→ Removing %s...\n", lyra_dir);
-        snprintf(command, sizeof(command), "rm -rf %s", lyra_dir);
-        
-        if (system(command) == 0) {
+        if (fs_remove_tree(lyra_dir)) {
             printf("✓ Successfully removed ~/.lyra\n");
         } else {
             printf("✗ Error: Failed to remove ~/.lyra\n");
@@ -1933,9 +3147,7 @@ void uninstall_lyra() {
     
     if (access(lyra_binary, F_OK) == 0) {
         printf("→ Removing %s...\n", lyra_binary);
-        snprintf(command, sizeof(command), "rm %s", lyra_binary);
-        
-        if (system(command) == 0) {
+        if (unlink(lyra_binary) == 0) {
             printf("✓ Successfully removed Lyra binary\n");
         } else {
             printf("✗ Error: Failed to remove Lyra binary\n");
@@ -1952,13 +3164,17 @@ void uninstall_lyra() {
     printf("Packages installed via Lyra remain in /usr/local/bin/\n");
 }
 
+#ifndef LYRA_NO_MAIN
 int main(int argc, char *argv[]) {
     int needs_sudo = 1;
     if (argc >= 2) {
         if (strcmp(argv[1], "-list") == 0 ||
             strcmp(argv[1], "-lv") == 0 ||
+            strcmp(argv[1], "-q") == 0 ||
+            strcmp(argv[1], "owns") == 0 ||
             strcmp(argv[1], "-ssl") == 0 ||
             strcmp(argv[1], "-fl") == 0 ||
+            (strcmp(argv[1], "du") == 0 && argc == 2) ||
             strcmp(argv[1], "--version") == 0 ||
             strcmp(argv[1], "-h") == 0 ||
             strcmp(argv[1], "--help") == 0) {
@@ -1974,14 +3190,25 @@ int main(int argc, char *argv[]) {
         printf("Lyra Package Manager v0.8 (with freeze-copy & encryption)\n\n");
         printf("Usage:\n");
         printf("  lyra -i <package> <url>               Install package (auto-mutes old version)\n");
-        printf("  lyra -fc <package>                    Freeze-copy package (encrypted backup)\n");
+        printf("  lyra -i <package> <url> --sha256 <h>  Install, aborting unless the download matches\n");
+        printf("  lyra -i <package> <url> --bin <a,b>   Also install the archive's a and b executables\n");
+        printf("  lyra -i <package> <url> --depends <p> Record packages this one needs\n");
+        printf("  lyra bundle <file.json>               Install many packages in parallel, in dependency order\n");
+        printf("  lyra -fc <package> [package2] ...     Freeze-copy packages (encrypted backup)\n");
+        printf("  lyra -fc --all                        Freeze-copy every installed package\n");
         printf("  lyra -fl                              List all frozen copies\n");
-        printf("  lyra -r <package@version>             Restore from frozen copy\n");
+        printf("  lyra -r <pkg@version> [pkg2@ver] ...  Restore from frozen copies\n");
         printf("  lyra -frm                             Clean old frozen copies (keep latest)\n");
+        printf("  lyra -unlock                          Cache vault key for key_agent_ttl seconds\n");
+        printf("  lyra -lock                            Forget cached vault key\n");
         printf("  lyra -rmpkg <pkg1> [pkg2] [pkg3]...  Remove packages (keeps vault copies)\n");
         printf("  lyra -rmcpkg <pkg1> [pkg2] ...       Remove packages completely (deletes vault)\n");
         printf("  lyra -list                            List installed packages\n");
         printf("  lyra -lv <package>                    List all versions of a package\n");
+        printf("  lyra -q <package>                     Print the active version of a package\n");
+        printf("  lyra owns <path>                      Print the package that installed a file\n");
+        printf("      list/query commands also take --json | --ndjson [--fields a,b,...]\n");
+        printf("      any command takes --timings [--trace <file>] for a per-phase time breakdown\n");
         printf("  lyra -m <package>                     Cycle to next muted version\n");
         printf("  lyra -m <package@version>             Switch to specific version\n");
         printf("  lyra -um <package>                    Unmute package (reactivate muted version)\n");
@@ -1989,59 +3216,167 @@ int main(int argc, char *argv[]) {
         printf("  lyra -ssl                             List all snapshots\n");
         printf("  lyra -rsw <date> [number]             Restore snapshot (DD-MM-YYYY)\n");
         printf("  lyra -U                               Update packages (GitHub or mirror)\n");
+        printf("  lyra verify [--full]                  Check binaries, vault and frozen copies\n");
+        printf("  lyra du [--recompute]                 Show vault, frozen and snapshot space use\n");
+        printf("  lyra gc [--keep N] [--max-age D] [--max-size MB] [--dry-run]\n");
+        printf("                                        Drop old muted versions from the vault\n");
+        printf("  lyra --batch <file|-> [--commit-each] Run one command per line in a single process\n");
         printf("  lyra -clean                           NUCLEAR: Delete everything and reset\n");
         printf("  lyra -uninstall                       Completely uninstall Lyra\n");
         return 1;
     }
     
+    if (strcmp(argv[1], "--batch") == 0) {
+        if (argc < 3 || (argc >= 4 && strcmp(argv[3], "--commit-each") != 0)) {
+            printf("Usage: lyra --batch <file|-> [--commit-each]\n");
+            return 1;
+        }
+        return batch_run(argv[2], argc >= 4);
+    }
+    
+    // lyrad answers from memory when it is running
+    int status;
+    if (daemon_call(argc, argv, &status)) {
+        return status;
+    }
+    
+    return lyra_command(argc, argv);
+}
+
+#endif
+
+static int run_command(int argc, char *argv[]);
+
+// Run one command line (argv[1] is the command). Returns the exit status;
+// lyra --batch and lyrad call this once per request.
+int lyra_command(int argc, char *argv[]) {
+    if (!output_parse_args(&argc, argv) || !trace_parse_args(&argc, argv)) {
+        output_reset();
+        return 1;
+    }
+    int status = run_command(argc, argv);
+    output_reset();
+    trace_finish();
+    metrics_finish();
+    spawn_report();
+    return status;
+}
+
+static int run_command(int argc, char *argv[]) {
     if (strcmp(argv[1], "-i") == 0) {
         if (argc < 4) {
-            printf("Usage: lyra -i <package> <url>\n");
+            printf("Usage: lyra -i <package> <url> [--sha256 <hex>] [--bin <name>[,<name>...]] [--depends <pkg>[,<pkg>...]]\n");
+            return 1;
+        }
+        char expected_sha256[SHA256_HEX_LEN];
+        int has_sha256 = 0;
+        char *binaries = NULL;
+        char *depends = NULL;
+        for (int i = 4; i < argc; i++) {
+            if (strcmp(argv[i], "--sha256") == 0) {
+                if (i + 1 >= argc || !sha256_hex_parse(argv[i + 1], expected_sha256)) {
+                    printf("✗ Error: --sha256 takes a 64-digit hex SHA-256\n");
+                    return 1;
+                }
+                has_sha256 = 1;
+                i++;
+            } else if (strcmp(argv[i], "--bin") == 0) {
+                if (i + 1 >= argc || !binary_list_valid(argv[2], argv[i + 1])) {
+                    printf("✗ Error: --bin takes up to %d comma-separated file names other than the package's\n",
+                           LYRA_MAX_BINARIES);
+                    return 1;
+                }
+                binaries = argv[++i];
+            } else if (strcmp(argv[i], "--depends") == 0) {
+                if (i + 1 >= argc || !argv[i + 1][0]) {
+                    printf("✗ Error: --depends takes a comma-separated list of packages\n");
+                    return 1;
+                }
+                depends = argv[++i];
+            } else {
+                printf("✗ Error: Unknown option '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        return install_package(argv[2], argv[3], has_sha256 ? expected_sha256 : NULL, binaries, depends) ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "bundle") == 0) {
+        if (argc < 3) {
+            printf("Usage: lyra bundle <file.json>\n");
             return 1;
         }
-        install_package(argv[2], argv[3]);
+        return bundle_install(argv[2]);
     }
     else if (strcmp(argv[1], "-fc") == 0) {
         if (argc < 3) {
-            printf("Usage: lyra -fc <package>\n");
+            printf("Usage: lyra -fc <package> [package2] ... | --all\n");
             return 1;
         }
-        freeze_copy_package(argv[2]);
+        int ok;
+        if (strcmp(argv[2], "--all") == 0) {
+            ok = freeze_copy_packages(NULL, 0);
+        } else if (argc == 3) {
+            ok = freeze_copy_package(argv[2]);
+        } else {
+            ok = freeze_copy_packages(&argv[2], argc - 2);
+        }
+        return ok ? 0 : 1;
     }
     else if (strcmp(argv[1], "-fl") == 0) {
         list_frozen_copies();
     }
     else if (strcmp(argv[1], "-r") == 0) {
         if (argc < 3) {
-            printf("Usage: lyra -r <package@version>\n");
+            printf("Usage: lyra -r <package@version> [package2@version] ...\n");
             printf("Example: lyra -r ripgrep@14.1.0\n");
             return 1;
         }
-        restore_frozen_copy(argv[2]);
+        int ok = argc == 3 ? restore_frozen_copy(argv[2]) : restore_frozen_copies(&argv[2], argc - 2);
+        return ok ? 0 : 1;
     }
     else if (strcmp(argv[1], "-frm") == 0) {
-        cleanup_old_frozen_copies();
+        return cleanup_old_frozen_copies() ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "-unlock") == 0) {
+        db_init();
+        if (config_get_long("key_agent_ttl", 0) <= 0) {
+            printf("Key agent is disabled, set key_agent_ttl in ~/.lyra/config/lyra.conf\n");
+            return 1;
+        }
+        VaultKey vk;
+        if (!vault_unlock(&vk)) {
+            return 1;
+        }
+        vault_key_clear(&vk);
+        printf("✓ Vault key cached for %ld seconds\n", config_get_long("key_agent_ttl", 0));
+    }
+    else if (strcmp(argv[1], "-lock") == 0) {
+        vault_agent_clear();
+        printf("✓ Cached vault key cleared\n");
     }
     else if (strcmp(argv[1], "-rmpkg") == 0) {
         if (argc < 3) {
             printf("Usage: lyra -rmpkg <package1> [package2] ...\n");
             return 1;
         }
+        int failed = 0;
         for (int i = 2; i < argc; i++) {
-            remove_package(argv[i]);
+            if (!remove_package(argv[i])) failed = 1;
         }
+        return failed;
     }
     else if (strcmp(argv[1], "-rmcpkg") == 0) {
         if (argc < 3) {
             printf("Usage: lyra -rmcpkg <package1> [package2] ...\n");
             return 1;
         }
+        int failed = 0;
         for (int i = 2; i < argc; i++) {
-            remove_package_completely(argv[i]);
+            if (!remove_package_completely(argv[i])) failed = 1;
         }
+        return failed;
     }
     else if (strcmp(argv[1], "-list") == 0) {
-        db_init();
         db_list_packages();
     }
     else if (strcmp(argv[1], "-lv") == 0) {
@@ -2049,25 +3384,38 @@ int main(int argc, char *argv[]) {
             printf("Usage: lyra -lv <package>\n");
             return 1;
         }
-        db_init();
-        list_versions(argv[2]);
+        return list_versions(argv[2]) ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "-q") == 0) {
+        if (argc < 3) {
+            printf("Usage: lyra -q <package>\n");
+            return 1;
+        }
+        return query_package(argv[2]) ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "owns") == 0) {
+        if (argc < 3) {
+            printf("Usage: lyra owns <path>\n");
+            return 1;
+        }
+        return owns_path(argv[2]) ? 0 : 1;
     }
     else if (strcmp(argv[1], "-m") == 0) {
         if (argc < 3) {
             printf("Usage: lyra -m <package> or lyra -m <package@version>\n");
             return 1;
         }
-        mute_package(argv[2]);
+        return mute_package(argv[2]) ? 0 : 1;
     }
     else if (strcmp(argv[1], "-um") == 0) {
         if (argc < 3) {
             printf("Usage: lyra -um <package>\n");
             return 1;
         }
-        unmute_package(argv[2]);
+        return unmute_package(argv[2]) ? 0 : 1;
     }
     else if (strcmp(argv[1], "-ss") == 0) {
-        take_snapshot();
+        return take_snapshot() ? 0 : 1;
     }
     else if (strcmp(argv[1], "-ssl") == 0) {
         list_snapshots();
@@ -2080,10 +3428,43 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         int snapshot_num = (argc >= 4) ? atoi(argv[3]) : 1;
-        restore_snapshot(argv[2], snapshot_num);
+        return restore_snapshot(argv[2], snapshot_num) ? 0 : 1;
     }
     else if (strcmp(argv[1], "-U") == 0) {
-        update_packages();
+        return update_packages() ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "verify") == 0) {
+        int full = argc >= 3 && strcmp(argv[2], "--full") == 0;
+        return verify_all(full) > 0 ? 1 : 0;
+    }
+    else if (strcmp(argv[1], "du") == 0) {
+        if (argc >= 3 && strcmp(argv[2], "--recompute") != 0) {
+            printf("Usage: lyra du [--recompute]\n");
+            return 1;
+        }
+        return disk_usage(argc >= 3) ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "gc") == 0) {
+        long keep_last = -1;
+        long max_age_days = -1;
+        long long max_bytes = -1;
+        int dry_run = 0;
+        
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--dry-run") == 0) {
+                dry_run = 1;
+            } else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) {
+                keep_last = atol(argv[++i]);
+            } else if (strcmp(argv[i], "--max-age") == 0 && i + 1 < argc) {
+                max_age_days = atol(argv[++i]);
+            } else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+                max_bytes = atoll(argv[++i]) * 1048576LL;
+            } else {
+                printf("Usage: lyra gc [--keep N] [--max-age DAYS] [--max-size MB] [--dry-run]\n");
+                return 1;
+            }
+        }
+        return vault_gc(keep_last, max_age_days, max_bytes, dry_run) ? 0 : 1;
     }
     else if (strcmp(argv[1], "-clean") == 0) {
         clean_everything();
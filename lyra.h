@@ -12,6 +12,7 @@
 #include <pwd.h>
 #include <termios.h>
 #include <libgen.h>
+#include <stdint.h>
 
 // Install rules structure
 typedef struct {
@@ -22,26 +23,70 @@ typedef struct {
     char script[1024];
 } InstallRule;
 
+// Derived vault key, plus the typed password when there is one (pre-scrypt
+// frozen copies were encrypted straight from the password)
+typedef struct {
+    unsigned char key[32];
+    char password[256];
+} VaultKey;
+
+// One chunk of a chunked frozen copy: keyed hash of the plaintext, and its length
+#define CHUNK_ID_SIZE 32
+
+typedef struct {
+    unsigned char id[CHUNK_ID_SIZE];
+    uint32_t size;
+} ChunkRef;
+
+// What a freeze produced, for the manifest
+typedef struct {
+    uint64_t size_bytes;
+    char sha256[65];
+    uint64_t input_bytes;
+    char binary_sha256[65];
+    char created_at[32];
+    int chunked;
+    ChunkRef *chunks;
+    int chunk_count;
+    uint64_t new_bytes;
+    unsigned int mode;
+} FreezeResult;
+
 // Utility functions
 char* get_user_home();
 void ensure_sudo();
 
 // Database functions
+#define LYRA_LAYOUT_VERSION 1
+
 void db_init();
 cJSON* db_read();
 void db_write(cJSON *root);
-void db_add_package(char *name, char *version, char *url);
+int db_lock();
+void db_unlock(int fd);
+void db_session_begin();
+void db_session_adopt(cJSON *root, int lock_fd);
+int db_session_commit();
+int db_session_flush();
+cJSON* db_session_release();
+int db_session_end();
+void db_add_package(char *name, char *version, char *url, char *sha256, char *binaries, char *depends,
+                    cJSON *files);
 void db_remove_package(char *name);
+void db_stamp_last_active(cJSON *entry);
+void db_set_vault_bytes(cJSON *entry, char *package_name, char *version);
 void db_list_packages();
-void list_versions(char *package_name);
+int list_versions(char *package_name);
+int query_package(char *package_name);
 char* get_package_policy(char *package_name);
+void policy_table_reset();
 
 // Package installation
-void install_package(char *package_name, char *url);
+int install_package(char *package_name, char *url, char *expected_sha256, char *binaries, char *depends);
 void install_package_with_mirror(char *package_name, char *url);
-void remove_package(char *package_name);
-void remove_package_completely(char *package_name);
-void update_packages();
+int remove_package(char *package_name);
+int remove_package_completely(char *package_name);
+int update_packages();
 
 // Mirror and install rules
 int download_from_mirror(char *package_name, char *dest_path);
@@ -55,31 +100,310 @@ void extract_version_from_url(char *url, char *version_out);
 
 // Vault and backup
 void backup_to_vault(char *package_name, char *version);
-void find_and_install_binary(char *extract_dir, char *package_name);
+int find_and_install_binary(char *extract_dir, char *package_name, char *binaries, cJSON *files);
 
 // Freeze-copy and encryption
 void vault_password_setup();
 int vault_password_verify(char *password);
 void vault_password_prompt(char *password, int is_setup);
-void freeze_copy_package(char *package_name);
+int freeze_copy_package(char *package_name);
 void list_frozen_copies();
-void restore_frozen_copy(char *package_spec);
-void cleanup_old_frozen_copies();
-void encrypt_file(char *input_path, char *output_path, char *password);
-void decrypt_file(char *input_path, char *output_path, char *password);
-void create_manifest(char *package_name, char *version, char *binary_path, char *frozen_path);
+int restore_frozen_copy(char *package_spec);
+int freeze_copy_packages(char **package_names, int count);
+int restore_frozen_copies(char **package_specs, int count);
+int cleanup_old_frozen_copies();
+int encrypt_file(char *input_path, char *output_path, VaultKey *vk);
+int decrypt_file(char *input_path, char *output_path, VaultKey *vk);
+int create_manifest(char *package_name, char *version, char *version_dir, FreezeResult *result,
+                    char *dependencies);
 
 // Snapshots
-void take_snapshot();
+int take_snapshot();
 void list_snapshots();
-void restore_snapshot(char *date, int number);
+int restore_snapshot(char *date, int number);
+
+// Streaming freeze pipeline (freeze.c)
+#define LYRA_FREEZE_ZSTD_LEVEL 9
+#define LYRA_FROZEN_FORMAT "tar+zstd+aes-256-gcm"
+#define LYRA_CHUNKED_FORMAT "cdc+zstd+aes-256-gcm"
+#define FROZEN_ARCHIVE 1
+#define FROZEN_CHUNKED 2
+
+int freeze_stream_package(char *source_path, char *entry_name, char *frozen_path,
+                          VaultKey *vk, FreezeResult *result);
+int frozen_copy_path(char *package_name, char *version, char *path_out, size_t size);
+int freeze_extract_package(char *frozen_path, char *entry_name, char *dest_path,
+                           VaultKey *vk, char *expected_sha256);
+FILE *staged_open(char *dest_path, char *staged_out, size_t size);
+int staged_commit(FILE *fp, char *staged_path, char *dest_path, mode_t mode, int ok);
+
+// Content-defined chunk store for frozen copies (chunkstore.c)
+typedef struct ChunkStore ChunkStore;
+
+ChunkStore *chunk_store_open(VaultKey *vk);
+int chunk_store_close(ChunkStore *store);
+int chunk_store_put_file(ChunkStore *store, char *source_path, FreezeResult *result);
+void chunk_store_ref(ChunkStore *store, ChunkRef *refs, int count, int delta);
+void chunk_store_release_manifest(ChunkStore *store, char *version_dir);
+int chunk_store_restore(VaultKey *vk, ChunkRef *refs, int count, FILE *out, char *sha256_hex);
+int chunk_refs_from_manifest(cJSON *manifest, ChunkRef **refs_out, int *count_out);
+void chunk_id_to_hex(const unsigned char *id, char *hex_out);
+int chunk_id_from_hex(const char *hex, unsigned char *id_out);
+void chunk_store_each_file(void (*fn)(char *path, void *ctx), void *ctx);
+uint64_t chunk_store_bytes();
+int frozen_store_chunked();
+void freeze_result_free(FreezeResult *result);
+
+// Hashing (hash.c)
+#define SHA256_DIGEST_LEN 32
+#define SHA256_HEX_LEN 65
+
+void sha256_to_hex(const unsigned char *digest, char *hex_out);
+int sha256_file(const char *path, char *hex_out);
+int files_identical(const char *path_a, const char *path_b);
+int sha256_copy_stream(FILE *in, FILE *out, char *hex_out);
+int sha256_hex_parse(const char *text, char *hex_out);
+
+// Integrity log and verification (verify.c)
+typedef struct IntegrityLog IntegrityLog;
+
+IntegrityLog *integrity_log_open();
+void integrity_log_add(IntegrityLog *log, char *path, char *sha256_hex);
+void integrity_log_close(IntegrityLog *log);
+void integrity_record(char *path, char *sha256_hex);
+int verify_all(int full);
+
+// Vault key derivation and key agent (vaultkey.c)
+#define VAULT_KDF_DEFAULT_N 131072
+#define VAULT_KDF_DEFAULT_R 8
+#define VAULT_KDF_DEFAULT_P 1
+
+int vault_auth_write(char *password);
+int vault_derive_key(char *password, unsigned char *key_out);
+int vault_agent_get(unsigned char *key_out);
+int vault_agent_put(const unsigned char *key, long ttl_seconds);
+void vault_agent_clear();
+int vault_unlock(VaultKey *vk);
+int vault_unlock_prompts();
+void vault_key_clear(VaultKey *vk);
+
+// Vault copies of muted versions (vaultcopy.c)
+#define LYRA_VAULT_ZSTD_LEVEL 19
+#define VAULT_COPY_RAW 1
+#define VAULT_COPY_ZSTD 2
+
+int vault_copy_path(char *package_name, char *version, char *path_out, size_t size);
+int vault_store(char *package_name, char *version, char *source_path);
+int vault_activate(char *package_name, char *version, char *dest_path, char *sha256_out);
+int vault_copy_matches(char *package_name, char *version, char *path);
+uint64_t vault_copy_bytes(char *package_name, char *version);
+
+// Space accounting (du.c)
+int disk_usage(int recompute_sizes);
+
+// Vault garbage collection (gc.c)
+#define LYRA_GC_KEEP_LAST 3
+
+int vault_gc(long keep_last, long max_age_days, long long max_bytes, int dry_run);
+
+// Configuration (config.c)
+int config_get(char *key, char *value_out, size_t size);
+long config_get_long(char *key, long default_value);
+long config_get_long_for(char *key, char *package_name, long default_value);
+void config_write_defaults(char *conf_path);
+
+// Chunked AES-256-GCM streams for frozen copies (crypto.c)
+#define LYRA_KEY_SIZE 32
+#define LYRA_ENC_HEADER_SIZE 40
+#define LYRA_ENC_SALT_SIZE 16
+#define LYRA_ENC_TAG_SIZE 16
+#define LYRA_ENC_CHUNK_SIZE (1u << 20)
+
+typedef struct {
+    FILE *fp;
+    unsigned char key[LYRA_KEY_SIZE];
+    unsigned char header[LYRA_ENC_HEADER_SIZE];
+    unsigned char nonce_prefix[4];
+    uint32_t chunk_size;
+    int batch_chunks;
+    uint64_t chunk_index;
+    unsigned char *pending;
+    size_t pending_len;
+    size_t capacity;
+    unsigned char *sealed;
+    uint64_t bytes_out;
+    void *digest;
+    char sha256[SHA256_HEX_LEN];
+    int error;
+} EncWriter;
+
+typedef struct {
+    FILE *fp;
+    unsigned char key[LYRA_KEY_SIZE];
+    unsigned char header[LYRA_ENC_HEADER_SIZE];
+    unsigned char nonce_prefix[4];
+    uint32_t chunk_size;
+    int batch_chunks;
+    uint64_t chunk_index;
+    unsigned char *sealed;
+    unsigned char *plain;
+    size_t plain_len;
+    size_t plain_pos;
+    int saw_final;
+    int error;
+} DecReader;
+
+int enc_writer_open(EncWriter *w, FILE *out, VaultKey *vk);
+int enc_writer_write(EncWriter *w, const void *data, size_t len);
+int enc_writer_close(EncWriter *w);
+int dec_reader_open(DecReader *r, FILE *in, VaultKey *vk);
+ssize_t dec_reader_read(DecReader *r, void *buf, size_t len);
+void dec_reader_close(DecReader *r);
+int is_encrypted_format(char *path);
+void enc_describe_file(char *path, cJSON *entry);
+
+// Worker pool (pool.c)
+typedef void (*pool_task_fn)(void *arg);
+
+int pool_default_threads();
+int pool_in_worker();
+void pool_run(pool_task_fn fn, void *args, size_t arg_size, int count, int threads);
+
+// Tasks run by pool_run_graph() return 1 on success; failures skip dependents
+typedef int (*pool_graph_fn)(void *arg);
+#define POOL_TASK_DONE 0
+#define POOL_TASK_FAILED 1
+#define POOL_TASK_SKIPPED 2
+
+int pool_run_graph(pool_graph_fn fn, void *args, size_t arg_size, int count,
+                   const int *edges, int edge_count, int threads, int *status_out);
+
+// Catalogs (catalog.c)
+#define SNAPSHOT_CATALOG_VERSION 1
+#define FROZEN_CATALOG_VERSION 1
+
+cJSON* json_read_file(char *path);
+int json_write_file_atomic(char *path, cJSON *root);
+int catalog_lock(char *path);
+void catalog_unlock(int fd);
+void snapshot_catalog_path(char *path_out, size_t size);
+cJSON* snapshot_catalog_rebuild();
+cJSON* snapshot_catalog_load();
+void snapshot_catalog_keep_resident();
+void snapshot_catalog_invalidate();
+int snapshot_catalog_next_number(cJSON *catalog, char *date);
+void snapshot_catalog_add(cJSON *catalog, char *name, char *date, int number,
+                          char *timestamp, int package_count, long size_bytes);
+void frozen_catalog_path(char *path_out, size_t size);
+cJSON* frozen_catalog_rebuild();
+cJSON* frozen_catalog_load();
+void frozen_catalog_remove(cJSON *catalog, char *package, char *version);
+void frozen_catalog_put(cJSON *catalog, char *package, char *version, char *frozen_path,
+                        FreezeResult *result);
 
 // Muting
-void mute_package(char *arg);
-void unmute_package(char *package_name);
+int mute_package(char *arg);
+int unmute_package(char *package_name);
 
 // System management
 void clean_everything();
 void uninstall_lyra();
 
+// Command dispatch and batch mode (batch.c)
+int lyra_command(int argc, char *argv[]);
+int batch_run(char *path, int commit_each);
+
+// Machine-readable output (output.c)
+#define OUTPUT_TEXT 0
+#define OUTPUT_JSON 1
+#define OUTPUT_NDJSON 2
+
+int output_parse_args(int *argc, char *argv[]);
+void output_reset();
+int output_structured();
+void output_error(const char *format, ...);
+void output_list_begin();
+void output_list_end();
+void output_record_begin();
+void output_record_end();
+void output_field_str(const char *name, const char *value);
+void output_field_num(const char *name, double value);
+void output_field_json(const char *name, cJSON *value);
+void output_array_begin(const char *name);
+void output_array_str(const char *value);
+void output_array_end();
+
+// Phase timings (trace.c)
+#define TRACE_NET "net"
+#define TRACE_DISK "disk"
+#define TRACE_CPU "cpu"
+
+typedef struct {
+    const char *name;
+    const char *category;
+    const char *detail;
+    uint64_t start_us;
+} TraceSpan;
+
+int trace_parse_args(int *argc, char *argv[]);
+int trace_requested(int argc, char *argv[]);
+TraceSpan trace_begin(const char *name, const char *category, const char *detail);
+void trace_end(TraceSpan *span);
+void trace_finish();
+
+// Filesystem helpers and spawn counting (fsutil.c)
+typedef int (*fs_walk_fn)(const char *path, const struct stat *st, void *ctx);
+
+int lyra_system(const char *command);
+FILE *lyra_popen(const char *command, const char *mode);
+int spawn_count();
+void spawn_report();
+int fs_mkdirs(const char *path, mode_t mode);
+int fs_remove_tree(const char *path);
+int fs_copy_file(const char *src, const char *dest, mode_t mode);
+int fs_walk(const char *root, fs_walk_fn fn, void *ctx);
+
+// Binary discovery in release archives (binfind.c)
+#define LYRA_MAX_BINARIES 16
+#define LYRA_MAX_COMPANIONS 64
+#define LYRA_MAN_DIR "/usr/local/share/man"
+#define LYRA_BASH_COMPLETION_DIR "/usr/local/share/bash-completion/completions"
+#define LYRA_ZSH_COMPLETION_DIR "/usr/local/share/zsh/site-functions"
+#define LYRA_FISH_COMPLETION_DIR "/usr/local/share/fish/vendor_completions.d"
+
+// A man page or shell completion shipped next to a package's binaries
+typedef struct {
+    char source[1024];
+    char dest[512];
+} CompanionFile;
+
+int binary_find(const char *dir, const char *name, int exact_only, char *path_out, size_t size);
+int binary_list_valid(char *package_name, char *binaries);
+int companion_find(const char *dir, char names[][256], int name_count, CompanionFile *out, int max);
+
+// Installed-file manifests and the ownership index (manifest.c)
+cJSON *manifest_files(cJSON *pkg, const char *package_name);
+void manifest_add(cJSON *files, const char *path, const char *sha256);
+int manifest_contains(cJSON *files, const char *path);
+void manifest_set_hash(cJSON *pkg, const char *path, const char *sha256);
+int owners_lookup(const char *path, char *package_out, size_t size);
+void owners_update(const char *package, cJSON *old_files, cJSON *new_files);
+void owners_rebuild();
+int owns_path(char *path);
+
+// Parallel installs of many packages (bundle.c)
+int bundle_install(char *path);
+
+// Prometheus textfile export (metrics.c)
+void metrics_count(const char *name, const char *package, double value);
+void metrics_gauge(const char *name, const char *package, double value);
+void metrics_phase(const char *phase, const char *category, uint64_t duration_us);
+void metrics_touch();
+void metrics_finish();
+
+// Resident daemon (daemon.c, lyrad.c)
+void lyrad_socket_path(char *path_out, size_t size);
+int daemon_call(int argc, char *argv[], int *status_out);
+int daemon_serve();
+
 #endif
@@ -0,0 +1,14 @@
+#include "lyra.h"
+
+// lyrad: resident lyra daemon, see daemon.c. Runs in the foreground; stop it
+// with SIGTERM or Ctrl-C.
+int main(int argc, char *argv[]) {
+    if (argc >= 2) {
+        printf("Usage: sudo lyrad\n");
+        printf("Serves lyra -list, -lv, -q, -ssl, -i, -m and -um from memory over ~/.lyra/lyrad.sock\n");
+        return argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) ? 0 : 1;
+    }
+
+    ensure_sudo();
+    return daemon_serve();
+}
@@ -0,0 +1,252 @@
+#include "lyra.h"
+#include <errno.h>
+#include <limits.h>
+
+// Installed-file manifests and the ownership index
+//
+// Each DB entry lists every file its package put on the system under
+// "files": [{ "path", "sha256", "size" }]; entries written before manifests
+// stand for just their installed_path. ~/.lyra/owners maps those paths back
+// to their package: one small bucket file per path hash, holding
+// "<package>\t<path>" lines, so `lyra owns` and the install-time conflict
+// check read one file instead of the whole DB. The index is rebuilt from the
+// DB when it is missing.
+
+static void owners_dir(char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/.lyra/owners", get_user_home());
+}
+
+static uint64_t owners_hash(const char *path) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *path; path++) {
+        h = (h ^ (unsigned char)*path) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static void owners_bucket(const char *dir, const char *path, char *bucket_out, size_t size) {
+    snprintf(bucket_out, size, "%s/%016llx", dir, (unsigned long long)owners_hash(path));
+}
+
+// Rewrite the bucket for path with path owned by package, or dropped when
+// package is NULL. Callers hold the owners lock.
+static int owners_put(const char *dir, const char *path, const char *package) {
+    char bucket[1024];
+    char tmp_path[1100];
+    owners_bucket(dir, path, bucket, sizeof(bucket));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", bucket, (int)getpid());
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) return 0;
+
+    int kept = 0;
+    FILE *in = fopen(bucket, "r");
+    if (in) {
+        char line[1536];
+        while (fgets(line, sizeof(line), in)) {
+            char *tab = strchr(line, '\t');
+            if (!tab) continue;
+            line[strcspn(line, "\n")] = '\0';
+            if (strcmp(tab + 1, path) == 0) continue;
+            fprintf(out, "%s\n", line);
+            kept++;
+        }
+        fclose(in);
+    }
+    if (package) {
+        fprintf(out, "%s\t%s\n", package, path);
+        kept++;
+    }
+
+    int ok = fclose(out) == 0;
+    if (ok && kept == 0) {
+        remove(tmp_path);
+        return remove(bucket) == 0 || errno == ENOENT;
+    }
+    if (!ok || rename(tmp_path, bucket) != 0) {
+        remove(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Build the index from the DB into a fresh dir and swap it in
+static int owners_rebuild_into(const char *dir) {
+    char build_dir[600];
+    char old_dir[600];
+    snprintf(build_dir, sizeof(build_dir), "%s.build.%d", dir, (int)getpid());
+    snprintf(old_dir, sizeof(old_dir), "%s.old.%d", dir, (int)getpid());
+
+    fs_remove_tree(build_dir);
+    if (!fs_mkdirs(build_dir, 0755)) return 0;
+
+    cJSON *root = db_read();
+    cJSON *pkg = NULL;
+    int ok = 1;
+    cJSON_ArrayForEach(pkg, root) {
+        cJSON *files = manifest_files(pkg, pkg->string);
+        cJSON *file = NULL;
+        cJSON_ArrayForEach(file, files) {
+            cJSON *path = cJSON_GetObjectItem(file, "path");
+            if (cJSON_IsString(path) && !owners_put(build_dir, path->valuestring, pkg->string)) ok = 0;
+        }
+        cJSON_Delete(files);
+    }
+    cJSON_Delete(root);
+
+    if (ok) {
+        rename(dir, old_dir);
+        ok = rename(build_dir, dir) == 0;
+    }
+    fs_remove_tree(ok ? old_dir : build_dir);
+    return ok;
+}
+
+// Lock the index, building it first if it isn't there yet
+static int owners_open(char *dir, size_t size) {
+    owners_dir(dir, size);
+    int lock_fd = catalog_lock(dir);
+
+    struct stat st;
+    if (stat(dir, &st) != 0 && !owners_rebuild_into(dir)) {
+        fprintf(stderr, "Warning: Could not build the ownership index in %s\n", dir);
+    }
+    return lock_fd;
+}
+
+void owners_rebuild() {
+    char dir[512];
+    owners_dir(dir, sizeof(dir));
+    int lock_fd = catalog_lock(dir);
+    if (!owners_rebuild_into(dir)) {
+        fprintf(stderr, "Warning: Could not rebuild the ownership index in %s\n", dir);
+    }
+    catalog_unlock(lock_fd);
+}
+
+// The package that owns path, if any. Returns 1 when owned.
+int owners_lookup(const char *path, char *package_out, size_t size) {
+    char dir[512];
+    char bucket[1024];
+    int lock_fd = owners_open(dir, sizeof(dir));
+    owners_bucket(dir, path, bucket, sizeof(bucket));
+
+    int found = 0;
+    FILE *fp = fopen(bucket, "r");
+    if (fp) {
+        char line[1536];
+        while (!found && fgets(line, sizeof(line), fp)) {
+            char *tab = strchr(line, '\t');
+            if (!tab) continue;
+            line[strcspn(line, "\n")] = '\0';
+            *tab = '\0';
+            if (strcmp(tab + 1, path) == 0) {
+                snprintf(package_out, size, "%s", line);
+                found = 1;
+            }
+        }
+        fclose(fp);
+    }
+
+    catalog_unlock(lock_fd);
+    return found;
+}
+
+// Move package's index entries from old_files to new_files; either may be NULL
+void owners_update(const char *package, cJSON *old_files, cJSON *new_files) {
+    char dir[512];
+    int lock_fd = owners_open(dir, sizeof(dir));
+
+    cJSON *file = NULL;
+    cJSON_ArrayForEach(file, old_files) {
+        cJSON *path = cJSON_GetObjectItem(file, "path");
+        if (cJSON_IsString(path) && !manifest_contains(new_files, path->valuestring)) {
+            owners_put(dir, path->valuestring, NULL);
+        }
+    }
+    cJSON_ArrayForEach(file, new_files) {
+        cJSON *path = cJSON_GetObjectItem(file, "path");
+        if (cJSON_IsString(path)) owners_put(dir, path->valuestring, package);
+    }
+
+    catalog_unlock(lock_fd);
+}
+
+// A copy of the package's file list. Entries from before manifests get one
+// for their installed binary, without a hash.
+cJSON *manifest_files(cJSON *pkg, const char *package_name) {
+    cJSON *files = cJSON_GetObjectItem(pkg, "files");
+    if (cJSON_IsArray(files)) return cJSON_Duplicate(files, 1);
+
+    char path[512];
+    cJSON *installed = cJSON_GetObjectItem(pkg, "installed_path");
+    if (cJSON_IsString(installed)) {
+        snprintf(path, sizeof(path), "%s", installed->valuestring);
+    } else {
+        snprintf(path, sizeof(path), "/usr/local/bin/%s", package_name);
+    }
+
+    files = cJSON_CreateArray();
+    cJSON *file = cJSON_CreateObject();
+    cJSON_AddStringToObject(file, "path", path);
+    cJSON_AddItemToArray(files, file);
+    return files;
+}
+
+static void manifest_fill(cJSON *file, const char *path, const char *sha256) {
+    struct stat st;
+    cJSON_DeleteItemFromObject(file, "sha256");
+    cJSON_DeleteItemFromObject(file, "size");
+    if (sha256) cJSON_AddStringToObject(file, "sha256", sha256);
+    if (stat(path, &st) == 0) cJSON_AddNumberToObject(file, "size", (double)st.st_size);
+}
+
+void manifest_add(cJSON *files, const char *path, const char *sha256) {
+    cJSON *file = cJSON_CreateObject();
+    cJSON_AddStringToObject(file, "path", path);
+    manifest_fill(file, path, sha256);
+    cJSON_AddItemToArray(files, file);
+}
+
+int manifest_contains(cJSON *files, const char *path) {
+    cJSON *file = NULL;
+    cJSON_ArrayForEach(file, files) {
+        cJSON *file_path = cJSON_GetObjectItem(file, "path");
+        if (cJSON_IsString(file_path) && strcmp(file_path->valuestring, path) == 0) return 1;
+    }
+    return 0;
+}
+
+// A rollback swapped path for another version; record its new hash
+void manifest_set_hash(cJSON *pkg, const char *path, const char *sha256) {
+    cJSON *file = NULL;
+    cJSON_ArrayForEach(file, cJSON_GetObjectItem(pkg, "files")) {
+        cJSON *file_path = cJSON_GetObjectItem(file, "path");
+        if (cJSON_IsString(file_path) && strcmp(file_path->valuestring, path) == 0) {
+            manifest_fill(file, path, sha256);
+        }
+    }
+}
+
+// lyra owns <path>
+int owns_path(char *path) {
+    char resolved[PATH_MAX];
+    if (!realpath(path, resolved)) snprintf(resolved, sizeof(resolved), "%s", path);
+
+    char package[256];
+    int found = owners_lookup(resolved, package, sizeof(package));
+
+    if (found && output_structured()) {
+        output_list_begin();
+        output_record_begin();
+        output_field_str("path", resolved);
+        output_field_str("package", package);
+        output_record_end();
+        output_list_end();
+    } else if (found) {
+        printf("%s\n", package);
+    } else {
+        output_error("Error: No package owns %s\n", resolved);
+    }
+    return found;
+}
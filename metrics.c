@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include "lyra.h"
+#include <pthread.h>
+
+// Prometheus textfile export
+//
+// Set metrics_textfile in ~/.lyra/config/lyra.conf to a path in
+// node_exporter's textfile collector directory. Install, update, verify and
+// the phase spans record counters and gauges as they run. After a command
+// that recorded any, or changed the DB, the counters are added to the
+// totals in ~/.lyra/metrics.json and the textfile is rewritten with
+// write+rename. Per-package gauges come from the DB, which the install and
+// vault paths keep current.
+
+typedef struct {
+    char series[320];
+    double value;
+    int gauge;  // gauges replace the stored value, counters add to it
+} MetricsPending;
+
+typedef struct {
+    const char *name;
+    const char *type;
+    const char *help;
+} MetricsDef;
+
+// Series kept in ~/.lyra/metrics.json, in the order they are written
+static const MetricsDef metrics_stored[] = {
+    { "lyra_installs_total", "counter", "Packages installed or upgraded" },
+    { "lyra_install_failures_total", "counter", "Installs that failed, by package" },
+    { "lyra_download_bytes_total", "counter", "Bytes downloaded for installs and restores" },
+    { "lyra_checksum_failures_total", "counter", "Downloads rejected for a SHA-256 mismatch" },
+    { "lyra_phase_seconds_total", "counter", "Time spent per install/update phase" },
+    { "lyra_phase_runs_total", "counter", "Times each install/update phase ran" },
+    { "lyra_updates_total", "counter", "Updates applied by lyra -U, by package" },
+    { "lyra_update_failures_total", "counter", "Failed update checks or installs in lyra -U, by package" },
+    { "lyra_update_last_run_timestamp_seconds", "gauge", "When lyra -U last ran" },
+    { "lyra_update_last_success_timestamp_seconds", "gauge", "When lyra -U last ran without a failure" },
+    { "lyra_verify_problems", "gauge", "Corrupt, missing or unreadable files found by the last lyra verify" },
+    { "lyra_verify_last_run_timestamp_seconds", "gauge", "When lyra verify last ran" },
+};
+
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static MetricsPending *metrics_pending = NULL;
+static int metrics_pending_count = 0;
+static int metrics_dirty = 0;
+
+// Label values escape \, " and newlines
+static void metrics_escape(char *out, size_t size, const char *value) {
+    size_t len = 0;
+    for (const char *p = value; *p && len + 3 < size; p++) {
+        if (*p == '\\' || *p == '"') out[len++] = '\\';
+        if (*p == '\n') {
+            out[len++] = '\\';
+            out[len++] = 'n';
+        } else {
+            out[len++] = *p;
+        }
+    }
+    out[len] = '\0';
+}
+
+static void metrics_series(char *out, size_t size, const char *name, const char *package) {
+    if (!package) {
+        snprintf(out, size, "%s", name);
+        return;
+    }
+    char escaped[256];
+    metrics_escape(escaped, sizeof(escaped), package);
+    snprintf(out, size, "%s{package=\"%s\"}", name, escaped);
+}
+
+// Phase timings alone don't mark the run dirty, so read-only commands
+// (whose only spans are db reads) never rewrite the textfile
+static void metrics_add(const char *series, double value, int gauge, int dirty) {
+    pthread_mutex_lock(&metrics_mutex);
+    if (dirty) metrics_dirty = 1;
+
+    int i = 0;
+    while (i < metrics_pending_count && strcmp(metrics_pending[i].series, series) != 0) i++;
+    if (i == metrics_pending_count) {
+        MetricsPending *grown = realloc(metrics_pending, (metrics_pending_count + 1) * sizeof(MetricsPending));
+        if (!grown) {
+            pthread_mutex_unlock(&metrics_mutex);
+            return;
+        }
+        metrics_pending = grown;
+        snprintf(metrics_pending[i].series, sizeof(metrics_pending[i].series), "%s", series);
+        metrics_pending[i].value = 0;
+        metrics_pending[i].gauge = gauge;
+        metrics_pending_count++;
+    }
+
+    if (gauge) {
+        metrics_pending[i].value = value;
+    } else {
+        metrics_pending[i].value += value;
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+// Add to a counter; package may be NULL
+void metrics_count(const char *name, const char *package, double value) {
+    char series[320];
+    metrics_series(series, sizeof(series), name, package);
+    metrics_add(series, value, 0, 1);
+}
+
+void metrics_gauge(const char *name, const char *package, double value) {
+    char series[320];
+    metrics_series(series, sizeof(series), name, package);
+    metrics_add(series, value, 1, 1);
+}
+
+// Called by trace_end() for every span, whether or not --timings is on
+void metrics_phase(const char *phase, const char *category, uint64_t duration_us) {
+    char series[320];
+    snprintf(series, sizeof(series), "lyra_phase_seconds_total{phase=\"%s\",kind=\"%s\"}", phase, category);
+    metrics_add(series, duration_us / 1e6, 0, 0);
+    snprintf(series, sizeof(series), "lyra_phase_runs_total{phase=\"%s\",kind=\"%s\"}", phase, category);
+    metrics_add(series, 1, 0, 0);
+}
+
+// The DB changed, so the per-package gauges need rewriting
+void metrics_touch() {
+    pthread_mutex_lock(&metrics_mutex);
+    metrics_dirty = 1;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+static void metrics_value(FILE *fp, const char *series, double value) {
+    if (value == (double)(long long)value) {
+        fprintf(fp, "%s %lld\n", series, (long long)value);
+    } else {
+        fprintf(fp, "%s %.6f\n", series, value);
+    }
+}
+
+static void metrics_header(FILE *fp, const char *name, const char *type, const char *help) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static double metrics_timestamp(cJSON *date) {
+    if (!cJSON_IsString(date)) return 0;
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (!strptime(date->valuestring, "%Y-%m-%dT%H:%M:%S", &tm)) return 0;
+    tm.tm_isdst = -1;
+    return (double)mktime(&tm);
+}
+
+static double metrics_number(cJSON *item) {
+    return cJSON_IsNumber(item) ? item->valuedouble : 0;
+}
+
+// Gauges read off the DB in one pass
+static void metrics_write_packages(FILE *fp) {
+    cJSON *root = db_read();
+    char series[512];
+    double vault_total = 0;
+
+    metrics_header(fp, "lyra_packages", "gauge", "Packages in the lyra database");
+    metrics_value(fp, "lyra_packages", cJSON_GetArraySize(root));
+
+    metrics_header(fp, "lyra_package_info", "gauge", "Active version and source of each package");
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, root) {
+        cJSON *version = cJSON_GetObjectItem(pkg, "version");
+        cJSON *source = cJSON_GetObjectItem(pkg, "source");
+        char name[256], version_label[256], source_label[64];
+        metrics_escape(name, sizeof(name), pkg->string);
+        metrics_escape(version_label, sizeof(version_label), cJSON_IsString(version) ? version->valuestring : "");
+        metrics_escape(source_label, sizeof(source_label), cJSON_IsString(source) ? source->valuestring : "");
+        fprintf(fp, "lyra_package_info{package=\"%s\",version=\"%s\",source=\"%s\"} 1\n",
+                name, version_label, source_label);
+    }
+
+    metrics_header(fp, "lyra_package_last_update_timestamp_seconds", "gauge",
+                   "When the active version of each package was installed");
+    cJSON_ArrayForEach(pkg, root) {
+        metrics_series(series, sizeof(series), "lyra_package_last_update_timestamp_seconds", pkg->string);
+        metrics_value(fp, series, metrics_timestamp(cJSON_GetObjectItem(pkg, "installed_date")));
+    }
+
+    metrics_header(fp, "lyra_package_vault_bytes", "gauge", "Vault bytes held for each package's versions");
+    cJSON_ArrayForEach(pkg, root) {
+        double bytes = metrics_number(cJSON_GetObjectItem(pkg, "vault_bytes"));
+        cJSON *ver = NULL;
+        cJSON_ArrayForEach(ver, cJSON_GetObjectItem(pkg, "versions")) {
+            bytes += metrics_number(cJSON_GetObjectItem(ver, "vault_bytes"));
+        }
+        vault_total += bytes;
+        metrics_series(series, sizeof(series), "lyra_package_vault_bytes", pkg->string);
+        metrics_value(fp, series, bytes);
+    }
+
+    metrics_header(fp, "lyra_vault_bytes", "gauge", "Vault bytes held across all packages");
+    metrics_value(fp, "lyra_vault_bytes", vault_total);
+
+    cJSON_Delete(root);
+}
+
+static int metrics_write_textfile(char *path, cJSON *totals) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) return 0;
+
+    metrics_write_packages(fp);
+
+    for (size_t i = 0; i < sizeof(metrics_stored) / sizeof(metrics_stored[0]); i++) {
+        const MetricsDef *def = &metrics_stored[i];
+        size_t name_len = strlen(def->name);
+        int wrote_header = 0;
+
+        cJSON *item = NULL;
+        cJSON_ArrayForEach(item, totals) {
+            if (strncmp(item->string, def->name, name_len) != 0) continue;
+            if (item->string[name_len] != '\0' && item->string[name_len] != '{') continue;
+            if (!wrote_header) {
+                metrics_header(fp, def->name, def->type, def->help);
+                wrote_header = 1;
+            }
+            metrics_value(fp, item->string, item->valuedouble);
+        }
+    }
+
+    metrics_header(fp, "lyra_last_run_timestamp_seconds", "gauge", "When lyra last wrote this file");
+    metrics_value(fp, "lyra_last_run_timestamp_seconds", (double)time(NULL));
+
+    int ok = fflush(fp) == 0;
+    ok = fsync(fileno(fp)) == 0 && ok;
+    fclose(fp);
+
+    // Same directory as the target, so the collector never sees a partial file
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return 0;
+    }
+    chmod(path, 0644);
+    return 1;
+}
+
+// Fold this command's metrics into the totals and rewrite the textfile
+void metrics_finish() {
+    pthread_mutex_lock(&metrics_mutex);
+    MetricsPending *pending = metrics_pending;
+    int count = metrics_pending_count;
+    int dirty = metrics_dirty;
+    metrics_pending = NULL;
+    metrics_pending_count = 0;
+    metrics_dirty = 0;
+    pthread_mutex_unlock(&metrics_mutex);
+
+    char textfile[1024];
+    if (!dirty || !config_get("metrics_textfile", textfile, sizeof(textfile)) || textfile[0] == '\0') {
+        free(pending);
+        return;
+    }
+
+    char state_path[512];
+    snprintf(state_path, sizeof(state_path), "%s/.lyra/metrics.json", get_user_home());
+
+    int lock_fd = catalog_lock(state_path);
+    cJSON *totals = json_read_file(state_path);
+    if (!cJSON_IsObject(totals)) {
+        cJSON_Delete(totals);
+        totals = cJSON_CreateObject();
+    }
+
+    for (int i = 0; i < count; i++) {
+        cJSON *item = cJSON_GetObjectItem(totals, pending[i].series);
+        double value = pending[i].value;
+        if (item && !pending[i].gauge) value += metrics_number(item);
+        if (item) {
+            cJSON_SetNumberValue(item, value);
+        } else {
+            cJSON_AddNumberToObject(totals, pending[i].series, value);
+        }
+    }
+    free(pending);
+
+    if (count > 0 && !json_write_file_atomic(state_path, totals)) {
+        fprintf(stderr, "Warning: Could not update %s\n", state_path);
+    }
+    if (!metrics_write_textfile(textfile, totals)) {
+        fprintf(stderr, "Warning: Could not write metrics to %s\n", textfile);
+    }
+
+    cJSON_Delete(totals);
+    catalog_unlock(lock_fd);
+}
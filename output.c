@@ -0,0 +1,178 @@
+#include "lyra.h"
+#include <stdarg.h>
+
+// Machine-readable output
+//
+// List and query commands take --json (one array) or --ndjson (one object
+// per line) after the command, and --fields a,b,c to keep only some keys.
+// Records are written to stdout field by field as the command walks its
+// data, so nothing is built twice. In those modes errors go to stderr and
+// stdout only ever carries JSON.
+
+#define OUTPUT_MAX_FIELDS 32
+
+static int output_mode = OUTPUT_TEXT;
+static char output_fields[OUTPUT_MAX_FIELDS][64];
+static int output_field_count = 0;  // 0 = every field
+
+static int output_records = 0;       // records in the current list
+static int output_record_fields = 0; // keys in the current record
+static int output_array_items = 0;
+static int output_array_skip = 0;
+
+// Pull --json, --ndjson and --fields out of argv[2..]; returns 0 on bad usage
+int output_parse_args(int *argc, char *argv[]) {
+    int kept = 2;
+    for (int i = 2; i < *argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            output_mode = OUTPUT_JSON;
+        } else if (strcmp(argv[i], "--ndjson") == 0) {
+            output_mode = OUTPUT_NDJSON;
+        } else if (strcmp(argv[i], "--fields") == 0) {
+            if (i + 1 >= *argc) {
+                printf("Error: --fields takes a comma-separated list, e.g. --fields name,version\n");
+                return 0;
+            }
+            char list[1024];
+            snprintf(list, sizeof(list), "%s", argv[++i]);
+            output_field_count = 0;
+            for (char *save = NULL, *field = strtok_r(list, ",", &save);
+                 field && output_field_count < OUTPUT_MAX_FIELDS; field = strtok_r(NULL, ",", &save)) {
+                snprintf(output_fields[output_field_count++], sizeof(output_fields[0]), "%s", field);
+            }
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    if (*argc > 2) {
+        *argc = kept;
+        argv[kept] = NULL;
+    }
+    return 1;
+}
+
+void output_reset() {
+    output_mode = OUTPUT_TEXT;
+    output_field_count = 0;
+}
+
+int output_structured() {
+    return output_mode != OUTPUT_TEXT;
+}
+
+// Errors stay out of stdout when it is carrying JSON
+void output_error(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(output_structured() ? stderr : stdout, format, args);
+    va_end(args);
+}
+
+static int output_wants(const char *name) {
+    if (output_field_count == 0) return 1;
+    for (int i = 0; i < output_field_count; i++) {
+        if (strcmp(output_fields[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+static void output_string(const char *value) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *)value; *p; p++) {
+        switch (*p) {
+            case '"': fputs("\\\"", stdout); break;
+            case '\\': fputs("\\\\", stdout); break;
+            case '\n': fputs("\\n", stdout); break;
+            case '\r': fputs("\\r", stdout); break;
+            case '\t': fputs("\\t", stdout); break;
+            default:
+                if (*p < 0x20) {
+                    printf("\\u%04x", *p);
+                } else {
+                    putchar(*p);
+                }
+        }
+    }
+    putchar('"');
+}
+
+static int output_key(const char *name) {
+    if (!output_wants(name)) return 0;
+    if (output_record_fields++ > 0) putchar(',');
+    output_string(name);
+    putchar(':');
+    return 1;
+}
+
+void output_list_begin() {
+    output_records = 0;
+    if (output_mode == OUTPUT_JSON) putchar('[');
+}
+
+void output_list_end() {
+    if (output_mode == OUTPUT_JSON) {
+        if (output_records > 0) putchar('\n');
+        printf("]\n");
+    }
+    fflush(stdout);
+}
+
+void output_record_begin() {
+    if (output_mode == OUTPUT_JSON) {
+        if (output_records > 0) putchar(',');
+        printf("\n  ");
+    }
+    output_records++;
+    output_record_fields = 0;
+    putchar('{');
+}
+
+void output_record_end() {
+    putchar('}');
+    if (output_mode == OUTPUT_NDJSON) putchar('\n');
+}
+
+// NULL values are written as null
+void output_field_str(const char *name, const char *value) {
+    if (!output_key(name)) return;
+    if (value) {
+        output_string(value);
+    } else {
+        fputs("null", stdout);
+    }
+}
+
+void output_field_num(const char *name, double value) {
+    if (!output_key(name)) return;
+    if (value == (double)(long long)value) {
+        printf("%lld", (long long)value);
+    } else {
+        printf("%.17g", value);
+    }
+}
+
+// A cJSON string or number, or null when it is missing
+void output_field_json(const char *name, cJSON *value) {
+    if (cJSON_IsNumber(value)) {
+        output_field_num(name, value->valuedouble);
+    } else {
+        output_field_str(name, cJSON_IsString(value) ? value->valuestring : NULL);
+    }
+}
+
+void output_array_begin(const char *name) {
+    output_array_skip = !output_key(name);
+    output_array_items = 0;
+    if (!output_array_skip) putchar('[');
+}
+
+void output_array_str(const char *value) {
+    if (output_array_skip || !value) return;
+    if (output_array_items++ > 0) putchar(',');
+    output_string(value);
+}
+
+void output_array_end() {
+    if (!output_array_skip) putchar(']');
+    output_array_skip = 0;
+}
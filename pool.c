@@ -0,0 +1,337 @@
+#include "lyra.h"
+#include <pthread.h>
+
+// Set on pool worker threads so nested pool_run() calls run inline instead of
+// multiplying threads (e.g. per-chunk work inside a per-package task)
+static __thread int in_pool_worker = 0;
+
+typedef struct {
+    pool_task_fn fn;
+    char *args;
+    size_t arg_size;
+    int count;
+    int next;
+    pthread_mutex_t lock;
+} PoolJob;
+
+int pool_default_threads() {
+    char *env = getenv("LYRA_JOBS");
+    if (env && atoi(env) > 0) {
+        return atoi(env);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    if (cpus > 64) cpus = 64;
+    return (int)cpus;
+}
+
+// True on a pool worker thread, where extra threads would only oversubscribe
+int pool_in_worker() {
+    return in_pool_worker;
+}
+
+static void *pool_worker(void *data) {
+    PoolJob *job = data;
+    in_pool_worker = 1;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        int index = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (index >= job->count) break;
+        job->fn(job->args + (size_t)index * job->arg_size);
+    }
+
+    return NULL;
+}
+
+// Run fn over count argument structs laid out contiguously in args, on up to
+// threads workers. Returns once every task has finished.
+void pool_run(pool_task_fn fn, void *args, size_t arg_size, int count, int threads) {
+    if (count <= 0) return;
+    if (threads <= 0) threads = pool_default_threads();
+    if (threads > count) threads = count;
+
+    if (threads == 1 || in_pool_worker) {
+        for (int i = 0; i < count; i++) {
+            fn((char *)args + (size_t)i * arg_size);
+        }
+        return;
+    }
+
+    PoolJob job;
+    job.fn = fn;
+    job.args = args;
+    job.arg_size = arg_size;
+    job.count = count;
+    job.next = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+
+    if (workers) {
+        for (int i = 0; i < threads; i++) {
+            if (pthread_create(&workers[i], NULL, pool_worker, &job) != 0) break;
+            started++;
+        }
+    }
+
+    // Fall back to running on this thread if we couldn't start any workers
+    if (started == 0) {
+        pool_worker(&job);
+        in_pool_worker = 0;
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    pthread_mutex_destroy(&job.lock);
+}
+
+// Dependency graphs
+//
+// pool_run_graph() runs tasks whose edges say which must finish first. Each
+// worker keeps a deque: tasks a worker unblocks go on the bottom of its own
+// deque and it takes from the bottom, so a chain tends to stay on one thread,
+// while idle workers steal the oldest task from the top of someone else's.
+// A task that fails (fn returns 0) skips everything that depends on it.
+
+typedef struct {
+    int *items;
+    int head;  // steal end
+    int tail;  // owner end
+    pthread_mutex_t lock;
+} PoolDeque;
+
+typedef struct {
+    pool_graph_fn fn;
+    char *args;
+    size_t arg_size;
+    int count;
+    int *waiting;       // unfinished dependencies per task
+    int *failed_dep;    // a dependency failed or was skipped
+    int *first_out;     // CSR adjacency: dependents of i are out[first_out[i]..first_out[i + 1])
+    int *out;
+    int *status;
+    PoolDeque *deques;
+    int workers;
+    int queued;         // tasks sitting in deques
+    int remaining;      // tasks not yet finished or skipped
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} PoolGraph;
+
+typedef struct {
+    PoolGraph *graph;
+    int id;
+    int *stack;  // for graph_finish, count entries
+} PoolGraphWorker;
+
+static void graph_push(PoolGraph *graph, int worker, int task) {
+    PoolDeque *deque = &graph->deques[worker];
+    pthread_mutex_lock(&deque->lock);
+    deque->items[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->lock);
+
+    pthread_mutex_lock(&graph->lock);
+    graph->queued++;
+    pthread_cond_signal(&graph->wake);
+    pthread_mutex_unlock(&graph->lock);
+}
+
+// Own deque from the bottom, then the top of the others'; -1 if all empty
+static int graph_take(PoolGraph *graph, int worker) {
+    for (int i = 0; i < graph->workers; i++) {
+        PoolDeque *deque = &graph->deques[(worker + i) % graph->workers];
+        int task = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail) {
+            task = i == 0 ? deque->items[--deque->tail] : deque->items[deque->head++];
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        if (task >= 0) {
+            pthread_mutex_lock(&graph->lock);
+            graph->queued--;
+            pthread_mutex_unlock(&graph->lock);
+            return task;
+        }
+    }
+    return -1;
+}
+
+// Mark task finished and release its dependents; skipped ones cascade here
+static void graph_finish(PoolGraph *graph, PoolGraphWorker *self, int task, int status) {
+    int *stack = self->stack;
+    int depth = 0;
+    int finished = 0;
+
+    graph->status[task] = status;
+    stack[depth++] = task;
+
+    while (depth > 0) {
+        int done = stack[--depth];
+        finished++;
+        int failed = graph->status[done] != POOL_TASK_DONE;
+
+        for (int e = graph->first_out[done]; e < graph->first_out[done + 1]; e++) {
+            int next = graph->out[e];
+            if (failed) __atomic_store_n(&graph->failed_dep[next], 1, __ATOMIC_RELAXED);
+            if (__atomic_sub_fetch(&graph->waiting[next], 1, __ATOMIC_ACQ_REL) != 0) continue;
+
+            if (__atomic_load_n(&graph->failed_dep[next], __ATOMIC_RELAXED)) {
+                graph->status[next] = POOL_TASK_SKIPPED;
+                stack[depth++] = next;
+            } else {
+                graph_push(graph, self->id, next);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&graph->lock);
+    graph->remaining -= finished;
+    if (graph->remaining == 0) pthread_cond_broadcast(&graph->wake);
+    pthread_mutex_unlock(&graph->lock);
+}
+
+static void *graph_worker(void *data) {
+    PoolGraphWorker *self = data;
+    PoolGraph *graph = self->graph;
+    in_pool_worker = 1;
+
+    for (;;) {
+        int task = graph_take(graph, self->id);
+        if (task < 0) {
+            pthread_mutex_lock(&graph->lock);
+            while (graph->queued == 0 && graph->remaining > 0) {
+                pthread_cond_wait(&graph->wake, &graph->lock);
+            }
+            int finished = graph->remaining == 0;
+            pthread_mutex_unlock(&graph->lock);
+            if (finished) break;
+            continue;
+        }
+
+        int ok = graph->fn(graph->args + (size_t)task * graph->arg_size);
+        graph_finish(graph, self, task, ok ? POOL_TASK_DONE : POOL_TASK_FAILED);
+    }
+
+    return NULL;
+}
+
+// Run count tasks on up to threads workers, where edges[2k] must finish
+// before edges[2k + 1] may start. The graph must be acyclic. status_out
+// gets POOL_TASK_DONE, POOL_TASK_FAILED or POOL_TASK_SKIPPED per task.
+// Returns 0 if the scheduler couldn't allocate.
+int pool_run_graph(pool_graph_fn fn, void *args, size_t arg_size, int count,
+                   const int *edges, int edge_count, int threads, int *status_out) {
+    if (count <= 0) return 1;
+    if (threads <= 0) threads = pool_default_threads();
+    if (threads > count) threads = count;
+    if (in_pool_worker) threads = 1;
+
+    PoolGraph graph;
+    memset(&graph, 0, sizeof(graph));
+    graph.fn = fn;
+    graph.args = args;
+    graph.arg_size = arg_size;
+    graph.count = count;
+    graph.status = status_out;
+    graph.workers = threads;
+    graph.remaining = count;
+    graph.waiting = calloc(count, sizeof(int));
+    graph.failed_dep = calloc(count, sizeof(int));
+    graph.first_out = calloc(count + 1, sizeof(int));
+    graph.out = malloc((edge_count > 0 ? edge_count : 1) * sizeof(int));
+    graph.deques = calloc(threads, sizeof(PoolDeque));
+    PoolGraphWorker *selves = calloc(threads, sizeof(PoolGraphWorker));
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+
+    int ok = graph.waiting && graph.failed_dep && graph.first_out && graph.out && graph.deques &&
+             selves && workers;
+    for (int i = 0; ok && i < threads; i++) {
+        graph.deques[i].items = malloc(count * sizeof(int));
+        selves[i].stack = malloc(count * sizeof(int));
+        if (!graph.deques[i].items || !selves[i].stack) ok = 0;
+    }
+
+    if (ok) {
+        for (int e = 0; e < edge_count; e++) {
+            graph.first_out[edges[2 * e] + 1]++;
+            graph.waiting[edges[2 * e + 1]]++;
+        }
+        for (int i = 0; i < count; i++) graph.first_out[i + 1] += graph.first_out[i];
+
+        int *fill = calloc(count, sizeof(int));
+        if (!fill) ok = 0;
+        for (int e = 0; ok && e < edge_count; e++) {
+            int from = edges[2 * e];
+            graph.out[graph.first_out[from] + fill[from]++] = edges[2 * e + 1];
+        }
+        free(fill);
+    }
+
+    if (ok) {
+        pthread_mutex_init(&graph.lock, NULL);
+        pthread_cond_init(&graph.wake, NULL);
+        for (int i = 0; i < threads; i++) pthread_mutex_init(&graph.deques[i].lock, NULL);
+
+        // Ready tasks are dealt round-robin so every worker starts with some
+        int next_worker = 0;
+        for (int i = 0; i < count; i++) {
+            status_out[i] = POOL_TASK_SKIPPED;
+            if (graph.waiting[i] > 0) continue;
+            PoolDeque *deque = &graph.deques[next_worker];
+            deque->items[deque->tail++] = i;
+            graph.queued++;
+            next_worker = (next_worker + 1) % threads;
+        }
+
+        int started = 0;
+        for (int i = 0; i < threads; i++) {
+            selves[i].graph = &graph;
+            selves[i].id = i;
+            if (threads == 1) break;
+            if (pthread_create(&workers[i], NULL, graph_worker, &selves[i]) != 0) break;
+            started++;
+        }
+
+        // One thread (or none could start): the deques still drain in order here
+        if (started == 0) {
+            int was_worker = in_pool_worker;
+            graph.workers = 1;
+            for (int i = 1; i < threads; i++) {
+                while (graph.deques[i].head < graph.deques[i].tail) {
+                    graph.deques[0].items[graph.deques[0].tail++] = graph.deques[i].items[graph.deques[i].head++];
+                }
+            }
+            selves[0].graph = &graph;
+            selves[0].id = 0;
+            graph_worker(&selves[0]);
+            in_pool_worker = was_worker;
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+
+        for (int i = 0; i < threads; i++) pthread_mutex_destroy(&graph.deques[i].lock);
+        pthread_cond_destroy(&graph.wake);
+        pthread_mutex_destroy(&graph.lock);
+    }
+
+    for (int i = 0; graph.deques && i < threads; i++) free(graph.deques[i].items);
+    for (int i = 0; selves && i < threads; i++) free(selves[i].stack);
+    free(graph.deques);
+    free(graph.waiting);
+    free(graph.failed_dep);
+    free(graph.first_out);
+    free(graph.out);
+    free(selves);
+    free(workers);
+    return ok;
+}
@@ -0,0 +1,197 @@
+#include "lyra.h"
+#include <pthread.h>
+#include <sys/syscall.h>
+
+// Phase timings
+//
+// --timings (after the command) times the phases of an install or update
+// and prints a per-phase summary to stderr when the command ends; --trace
+// <file> also writes the spans as Chrome trace-event JSON, which
+// chrome://tracing and Perfetto open. Each span has a category (net, disk,
+// cpu) so slow runs can be pinned on one of them. Every span also feeds the
+// phase counters in metrics.c; when neither flag is given, that is all
+// trace_end() does.
+
+typedef struct {
+    const char *name;
+    const char *category;
+    char detail[64];
+    uint64_t start_us;
+    uint64_t duration_us;
+    long tid;
+} TraceEvent;
+
+static int trace_on = 0;
+static char trace_path[512] = "";
+static uint64_t trace_origin_us = 0;
+static TraceEvent *trace_events = NULL;
+static int trace_count = 0;
+static int trace_capacity = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Pull --timings and --trace <file> out of argv[2..]; returns 0 on bad usage
+int trace_parse_args(int *argc, char *argv[]) {
+    int kept = 2;
+    for (int i = 2; i < *argc; i++) {
+        if (strcmp(argv[i], "--timings") == 0) {
+            trace_on = 1;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= *argc) {
+                printf("Error: --trace takes an output file, e.g. --trace install.trace.json\n");
+                return 0;
+            }
+            snprintf(trace_path, sizeof(trace_path), "%s", argv[++i]);
+            trace_on = 1;
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    if (*argc > 2) {
+        *argc = kept;
+        argv[kept] = NULL;
+    }
+    if (trace_on) trace_origin_us = now_us();
+    return 1;
+}
+
+// Whether argv asks for timings; lyrad leaves those runs to the CLI
+int trace_requested(int argc, char *argv[]) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--timings") == 0 || strcmp(argv[i], "--trace") == 0) return 1;
+    }
+    return 0;
+}
+
+TraceSpan trace_begin(const char *name, const char *category, const char *detail) {
+    TraceSpan span = { name, category, detail, now_us() };
+    return span;
+}
+
+void trace_end(TraceSpan *span) {
+    if (!span->name) return;
+
+    uint64_t end_us = now_us();
+    metrics_phase(span->name, span->category, end_us - span->start_us);
+    if (!trace_on) {
+        span->name = NULL;
+        return;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_count == trace_capacity) {
+        int capacity = trace_capacity ? trace_capacity * 2 : 64;
+        TraceEvent *grown = realloc(trace_events, capacity * sizeof(TraceEvent));
+        if (grown) {
+            trace_events = grown;
+            trace_capacity = capacity;
+        }
+    }
+    if (trace_count < trace_capacity) {
+        TraceEvent *event = &trace_events[trace_count++];
+        event->name = span->name;
+        event->category = span->category;
+        snprintf(event->detail, sizeof(event->detail), "%s", span->detail ? span->detail : "");
+        event->start_us = span->start_us - trace_origin_us;
+        event->duration_us = end_us - span->start_us;
+        event->tid = (long)syscall(SYS_gettid);
+    }
+    pthread_mutex_unlock(&trace_mutex);
+    span->name = NULL;
+}
+
+static void trace_write_chrome(uint64_t total_us) {
+    FILE *fp = fopen(trace_path, "w");
+    if (!fp) {
+        fprintf(stderr, "Warning: Could not write trace to %s\n", trace_path);
+        return;
+    }
+
+    long pid = (long)getpid();
+    fprintf(fp, "{\"traceEvents\":[\n");
+    fprintf(fp, "  {\"name\":\"lyra\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":0,\"dur\":%llu,\"pid\":%ld,\"tid\":%ld}",
+            (unsigned long long)total_us, pid, pid);
+    for (int i = 0; i < trace_count; i++) {
+        TraceEvent *event = &trace_events[i];
+        fprintf(fp, ",\n  {\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%ld,\"tid\":%ld",
+                event->name, event->category, (unsigned long long)event->start_us,
+                (unsigned long long)event->duration_us, pid, event->tid);
+        if (event->detail[0]) {
+            // Package names and versions; keep the JSON valid whatever they hold
+            fprintf(fp, ",\"args\":{\"detail\":\"");
+            for (char *p = event->detail; *p; p++) {
+                if (*p == '"' || *p == '\\') fputc('\\', fp);
+                if ((unsigned char)*p >= 0x20) fputc(*p, fp);
+            }
+            fprintf(fp, "\"}");
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+    fprintf(stderr, "→ Trace written to %s\n", trace_path);
+}
+
+// Print the per-phase summary, write the trace file if asked, and reset
+void trace_finish() {
+    if (!trace_on) return;
+
+    uint64_t total_us = now_us() - trace_origin_us;
+    fflush(stdout);
+
+    // Aggregate by phase name, in order of first appearance
+    typedef struct {
+        const char *name;
+        const char *category;
+        int count;
+        uint64_t total_us;
+        uint64_t max_us;
+    } TracePhase;
+    TracePhase *phases = calloc(trace_count > 0 ? trace_count : 1, sizeof(TracePhase));
+    int phase_count = 0;
+    uint64_t by_category[3] = { 0 };
+
+    for (int i = 0; phases && i < trace_count; i++) {
+        TraceEvent *event = &trace_events[i];
+        int j = 0;
+        while (j < phase_count && strcmp(phases[j].name, event->name) != 0) j++;
+        if (j == phase_count) {
+            phases[phase_count].name = event->name;
+            phases[phase_count].category = event->category;
+            phase_count++;
+        }
+        phases[j].count++;
+        phases[j].total_us += event->duration_us;
+        if (event->duration_us > phases[j].max_us) phases[j].max_us = event->duration_us;
+
+        if (strcmp(event->category, TRACE_NET) == 0) by_category[0] += event->duration_us;
+        else if (strcmp(event->category, TRACE_DISK) == 0) by_category[1] += event->duration_us;
+        else by_category[2] += event->duration_us;
+    }
+
+    fprintf(stderr, "\n%-22s %-5s %6s %11s %11s\n", "Phase", "Kind", "Count", "Total (ms)", "Max (ms)");
+    fprintf(stderr, "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    for (int i = 0; i < phase_count; i++) {
+        fprintf(stderr, "%-22s %-5s %6d %11.2f %11.2f\n", phases[i].name, phases[i].category, phases[i].count,
+                phases[i].total_us / 1000.0, phases[i].max_us / 1000.0);
+    }
+    fprintf(stderr, "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    fprintf(stderr, "Wall %.2f ms; net %.2f ms, disk %.2f ms, cpu %.2f ms (phases may overlap)\n",
+            total_us / 1000.0, by_category[0] / 1000.0, by_category[1] / 1000.0, by_category[2] / 1000.0);
+    fprintf(stderr, "External processes spawned: %d\n", spawn_count());
+    free(phases);
+
+    if (trace_path[0]) trace_write_chrome(total_us);
+
+    free(trace_events);
+    trace_events = NULL;
+    trace_count = 0;
+    trace_capacity = 0;
+    trace_path[0] = '\0';
+    trace_on = 0;
+}
@@ -0,0 +1,370 @@
+#include "lyra.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <zstd.h>
+#include <openssl/evp.h>
+
+// Vault copies of muted versions
+//
+// vault/<pkg>/<ver>/<pkg>.zst holds the binary zstd-compressed, or
+// vault/<pkg>/<ver>/<pkg> holds it as-is when vault_compress (or
+// vault_compress.<pkg>) is 0. The .zst file is a run of independent frames of
+// VAULT_FRAME_SIZE input each, with content sizes and checksums, so both
+// directions run frame-parallel on the worker pool and a damaged frame is
+// caught on activation. vault/<pkg>/<ver>/<pkg>.sha256 records the hash of
+// the binary itself, so a copy can be compared without decompressing it.
+
+#define VAULT_FRAME_SIZE (8u << 20)
+
+typedef struct {
+    const unsigned char *src;
+    size_t src_len;
+    unsigned char *dst;
+    size_t dst_len;
+    size_t out_len;
+    int level;
+    int ok;
+} VaultFrameTask;
+
+int vault_copy_path(char *package_name, char *version, char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/.lyra/vault/%s/%s/%s.zst", get_user_home(), package_name, version, package_name);
+    if (access(path_out, F_OK) == 0) return VAULT_COPY_ZSTD;
+
+    snprintf(path_out, size, "%s/.lyra/vault/%s/%s/%s", get_user_home(), package_name, version, package_name);
+    if (access(path_out, F_OK) == 0) return VAULT_COPY_RAW;
+
+    return 0;
+}
+
+static void content_hash_path(char *package_name, char *version, char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/.lyra/vault/%s/%s/%s.sha256", get_user_home(), package_name, version, package_name);
+}
+
+// The recorded hash of what the vault copy of package@version holds; 0 for
+// copies stored before hashes were recorded
+static int content_hash_read(char *package_name, char *version, char *hex_out) {
+    char path[1024];
+    char text[128] = "";
+    content_hash_path(package_name, version, path, sizeof(path));
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+    int ok = fgets(text, sizeof(text), fp) != NULL;
+    fclose(fp);
+
+    text[strcspn(text, "\n")] = '\0';
+    return ok && sha256_hex_parse(text, hex_out);
+}
+
+static void content_hash_write(char *package_name, char *version, char *sha256_hex) {
+    char path[1024];
+    char staged_path[1100];
+    content_hash_path(package_name, version, path, sizeof(path));
+
+    FILE *out = staged_open(path, staged_path, sizeof(staged_path));
+    int ok = out && fprintf(out, "%s\n", sha256_hex) > 0;
+    staged_commit(out, staged_path, path, 0644, ok);
+}
+
+// On-disk size of the vault copy of package@version, 0 if there is none
+uint64_t vault_copy_bytes(char *package_name, char *version) {
+    char path[1024];
+    struct stat st;
+    if (!vault_copy_path(package_name, version, path, sizeof(path)) || stat(path, &st) != 0) return 0;
+    return (uint64_t)st.st_size;
+}
+
+static void compress_frame(void *arg) {
+    VaultFrameTask *task = arg;
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+
+    task->ok = cctx != NULL &&
+               !ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, task->level)) &&
+               !ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1)) &&
+               !ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1));
+    if (task->ok) {
+        task->out_len = ZSTD_compress2(cctx, task->dst, task->dst_len, task->src, task->src_len);
+        task->ok = !ZSTD_isError(task->out_len);
+    }
+
+    ZSTD_freeCCtx(cctx);
+}
+
+static void decompress_frame(void *arg) {
+    VaultFrameTask *task = arg;
+    size_t got = ZSTD_decompress(task->dst, task->dst_len, task->src, task->src_len);
+    task->ok = !ZSTD_isError(got) && got == task->dst_len;
+}
+
+static unsigned char *map_file(char *path, size_t *len_out) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    unsigned char *data = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        *len_out = (size_t)st.st_size;
+        // An empty file still needs a non-NULL pointer
+        data = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : (unsigned char *)"";
+        if (data == MAP_FAILED) data = NULL;
+    }
+    close(fd);
+    return data;
+}
+
+static void unmap_file(unsigned char *data, size_t len) {
+    if (data && len > 0) munmap(data, len);
+}
+
+static int compress_enabled(char *package_name) {
+    return config_get_long_for("vault_compress", package_name, 1) != 0;
+}
+
+// Write source_path into the vault as package@version, compressed unless
+// the package opts out. Replaces whichever form was there before.
+int vault_store(char *package_name, char *version, char *source_path) {
+    char version_dir[512];
+    snprintf(version_dir, sizeof(version_dir), "%s/.lyra/vault/%s", get_user_home(), package_name);
+    mkdir(version_dir, 0755);
+    snprintf(version_dir, sizeof(version_dir), "%s/.lyra/vault/%s/%s", get_user_home(), package_name, version);
+    mkdir(version_dir, 0755);
+
+    char raw_path[1024];
+    char zst_path[1024];
+    snprintf(raw_path, sizeof(raw_path), "%s/%s", version_dir, package_name);
+    snprintf(zst_path, sizeof(zst_path), "%s/%s.zst", version_dir, package_name);
+
+    int compress = compress_enabled(package_name);
+    char *dest_path = compress ? zst_path : raw_path;
+
+    // Whatever hash was recorded describes the copy being replaced
+    char hash_path[1024];
+    content_hash_path(package_name, version, hash_path, sizeof(hash_path));
+    remove(hash_path);
+
+    size_t src_len = 0;
+    unsigned char *src = map_file(source_path, &src_len);
+    if (!src) {
+        printf("✗ Error: Could not read %s\n", source_path);
+        return 0;
+    }
+
+    TraceSpan span = trace_begin(compress ? "vault compress" : "vault copy", compress ? TRACE_CPU : TRACE_DISK,
+                                 package_name);
+
+    char staged_path[1100];
+    FILE *out = staged_open(dest_path, staged_path, sizeof(staged_path));
+    int ok = out != NULL;
+    char sha256[SHA256_HEX_LEN] = "";
+    char content_sha256[SHA256_HEX_LEN] = "";
+
+    unsigned char content_hash[SHA256_DIGEST_LEN];
+    unsigned int content_hash_len = 0;
+    ok = ok && EVP_Digest(src, src_len, content_hash, &content_hash_len, EVP_sha256(), NULL) == 1;
+    if (ok) sha256_to_hex(content_hash, content_sha256);
+
+    if (ok && compress) {
+        int count = (int)((src_len + VAULT_FRAME_SIZE - 1) / VAULT_FRAME_SIZE);
+        if (count == 0) count = 1;
+
+        VaultFrameTask *tasks = calloc(count, sizeof(VaultFrameTask));
+        int level = (int)config_get_long("vault_zstd_level", LYRA_VAULT_ZSTD_LEVEL);
+        ok = tasks != NULL;
+
+        for (int i = 0; ok && i < count; i++) {
+            size_t offset = (size_t)i * VAULT_FRAME_SIZE;
+            tasks[i].src = src + offset;
+            tasks[i].src_len = src_len - offset < VAULT_FRAME_SIZE ? src_len - offset : VAULT_FRAME_SIZE;
+            tasks[i].dst_len = ZSTD_compressBound(tasks[i].src_len);
+            tasks[i].dst = malloc(tasks[i].dst_len);
+            tasks[i].level = level;
+            ok = tasks[i].dst != NULL;
+        }
+
+        if (ok) {
+            pool_run(compress_frame, tasks, sizeof(VaultFrameTask), count, 0);
+        }
+
+        EVP_MD_CTX *digest = EVP_MD_CTX_new();
+        ok = ok && digest && EVP_DigestInit_ex(digest, EVP_sha256(), NULL) == 1;
+        for (int i = 0; ok && i < count; i++) {
+            ok = tasks[i].ok && fwrite(tasks[i].dst, 1, tasks[i].out_len, out) == tasks[i].out_len &&
+                 EVP_DigestUpdate(digest, tasks[i].dst, tasks[i].out_len) == 1;
+        }
+
+        unsigned char hash[SHA256_DIGEST_LEN];
+        unsigned int hash_len = 0;
+        if (ok && EVP_DigestFinal_ex(digest, hash, &hash_len) == 1) {
+            sha256_to_hex(hash, sha256);
+        }
+        EVP_MD_CTX_free(digest);
+
+        for (int i = 0; tasks && i < count; i++) free(tasks[i].dst);
+        free(tasks);
+    } else if (ok) {
+        ok = fwrite(src, 1, src_len, out) == src_len;
+        memcpy(sha256, content_sha256, SHA256_HEX_LEN);
+    }
+
+    unmap_file(src, src_len);
+
+    ok = staged_commit(out, staged_path, dest_path, 0755, ok);
+    trace_end(&span);
+    if (!ok) {
+        printf("✗ Error: Could not write vault copy %s\n", dest_path);
+        return 0;
+    }
+
+    remove(compress ? raw_path : zst_path);
+    integrity_record(dest_path, sha256);
+    content_hash_write(package_name, version, content_sha256);
+    return 1;
+}
+
+// Read a vault copy back into memory, decompressing frames in parallel.
+// The caller frees *data_out.
+static int vault_load(char *package_name, char *version, unsigned char **data_out, size_t *len_out) {
+    char path[1024];
+    int kind = vault_copy_path(package_name, version, path, sizeof(path));
+    if (!kind) return 0;
+
+    size_t src_len = 0;
+    unsigned char *src = map_file(path, &src_len);
+    if (!src) return 0;
+
+    if (kind == VAULT_COPY_RAW) {
+        *data_out = malloc(src_len > 0 ? src_len : 1);
+        if (*data_out) memcpy(*data_out, src, src_len);
+        *len_out = src_len;
+        unmap_file(src, src_len);
+        return *data_out != NULL;
+    }
+
+    // Walk the frame headers to size the output and place every frame
+    int count = 0;
+    int capacity = 16;
+    size_t total = 0;
+    VaultFrameTask *tasks = malloc(capacity * sizeof(VaultFrameTask));
+    int ok = tasks != NULL;
+
+    for (size_t offset = 0; ok && offset < src_len; count++) {
+        size_t frame_len = ZSTD_findFrameCompressedSize(src + offset, src_len - offset);
+        unsigned long long content = ZSTD_getFrameContentSize(src + offset, src_len - offset);
+        if (ZSTD_isError(frame_len) || content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR ||
+            content > VAULT_FRAME_SIZE) {
+            ok = 0;
+            break;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            VaultFrameTask *grown = realloc(tasks, capacity * sizeof(VaultFrameTask));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            tasks = grown;
+        }
+
+        memset(&tasks[count], 0, sizeof(VaultFrameTask));
+        tasks[count].src = src + offset;
+        tasks[count].src_len = frame_len;
+        tasks[count].dst_len = (size_t)content;
+        tasks[count].out_len = total;  // output offset until the buffer exists
+        total += content;
+        offset += frame_len;
+    }
+
+    unsigned char *data = ok ? malloc(total > 0 ? total : 1) : NULL;
+    ok = ok && data != NULL;
+    for (int i = 0; ok && i < count; i++) {
+        tasks[i].dst = data + tasks[i].out_len;
+    }
+
+    if (ok) {
+        pool_run(decompress_frame, tasks, sizeof(VaultFrameTask), count, 0);
+    }
+    for (int i = 0; ok && i < count; i++) {
+        ok = tasks[i].ok;
+    }
+
+    free(tasks);
+    unmap_file(src, src_len);
+
+    if (!ok) {
+        free(data);
+        return 0;
+    }
+
+    *data_out = data;
+    *len_out = total;
+    return 1;
+}
+
+// Put package@version from the vault at dest_path (staged, then renamed in).
+// sha256_out, if not NULL, gets the hash of what was written.
+int vault_activate(char *package_name, char *version, char *dest_path, char *sha256_out) {
+    unsigned char *data = NULL;
+    size_t len = 0;
+    TraceSpan span = trace_begin("vault load", TRACE_CPU, package_name);
+    int loaded = vault_load(package_name, version, &data, &len);
+    trace_end(&span);
+    if (!loaded) {
+        printf("✗ Error: Vault copy of %s@%s is missing or damaged\n", package_name, version);
+        return 0;
+    }
+
+    char staged_path[1024];
+    FILE *out = staged_open(dest_path, staged_path, sizeof(staged_path));
+    int ok = out && fwrite(data, 1, len, out) == len;
+    ok = staged_commit(out, staged_path, dest_path, 0755, ok);
+
+    unsigned char hash[SHA256_DIGEST_LEN];
+    unsigned int hash_len = 0;
+    char sha256[SHA256_HEX_LEN];
+    if (ok && EVP_Digest(data, len, hash, &hash_len, EVP_sha256(), NULL) == 1) {
+        sha256_to_hex(hash, sha256);
+        integrity_record(dest_path, sha256);
+        if (sha256_out) memcpy(sha256_out, sha256, SHA256_HEX_LEN);
+    }
+
+    free(data);
+    if (!ok) {
+        printf("✗ Error: Could not write %s\n", dest_path);
+    }
+    return ok;
+}
+
+// Whether the vault copy of package@version has the same content as path.
+// Hashes path against the recorded hash; only copies without one are
+// decompressed, and get a recorded hash when they match.
+int vault_copy_matches(char *package_name, char *version, char *path) {
+    char vault_path[1024];
+    int kind = vault_copy_path(package_name, version, vault_path, sizeof(vault_path));
+    if (!kind) return 0;
+
+    char recorded[SHA256_HEX_LEN];
+    char actual[SHA256_HEX_LEN];
+    if (content_hash_read(package_name, version, recorded)) {
+        return sha256_file(path, actual) && strcmp(recorded, actual) == 0;
+    }
+
+    int same;
+    if (kind == VAULT_COPY_RAW) {
+        same = files_identical(vault_path, path);
+    } else {
+        unsigned char *data = NULL;
+        size_t len = 0;
+        if (!vault_load(package_name, version, &data, &len)) return 0;
+
+        size_t other_len = 0;
+        unsigned char *other = map_file(path, &other_len);
+        same = other && other_len == len && memcmp(data, other, len) == 0;
+
+        unmap_file(other, other_len);
+        free(data);
+    }
+
+    if (same && sha256_file(path, actual)) content_hash_write(package_name, version, actual);
+    return same;
+}
@@ -0,0 +1,292 @@
+#include "lyra.h"
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/keyctl.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+// Vault key handling
+//
+// The vault password is stretched with scrypt into 64 bytes: the first half is
+// the vault key that frozen copies are encrypted under, the second half is only
+// used to build the verifier stored in config/.auth. The .auth file also keeps
+// the salt and cost parameters, so the cost in lyra.conf can change without
+// locking anyone out of an existing vault.
+//
+// With key_agent_ttl set, the derived key is parked in the user's kernel
+// keyring with an expiry, so a run of -fc / -r calls pays for scrypt once.
+
+#define VAULT_SALT_SIZE 16
+#define VAULT_AGENT_PREFIX "lyra:vault:"
+
+// Key permission bits (keyutils.h isn't a dependency)
+#define AGENT_PERM_POSSESSOR_ALL 0x3f000000
+#define AGENT_PERM_USER_VIEW     0x00010000
+#define AGENT_PERM_USER_READ     0x00020000
+
+static void auth_path(char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/.lyra/config/.auth", get_user_home());
+}
+
+static int hex_decode(const char *hex, unsigned char *out, size_t out_len) {
+    if (!hex || strlen(hex) != out_len * 2) return 0;
+
+    for (size_t i = 0; i < out_len; i++) {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) return 0;
+        out[i] = (unsigned char)byte;
+    }
+    return 1;
+}
+
+static void hex_encode(const unsigned char *data, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0x0f];
+    }
+    out[len * 2] = '\0';
+}
+
+static unsigned long djb2_hash(char *password) {
+    unsigned long hash = 5381;
+    for (int i = 0; password[i]; i++) {
+        hash = ((hash << 5) + hash) + password[i];
+    }
+    return hash;
+}
+
+static int scrypt_derive(char *password, const unsigned char *salt, uint64_t n, uint64_t r,
+                         uint64_t p, unsigned char *out, size_t out_len) {
+    // scrypt needs 128 * N * r * p bytes; leave headroom over OpenSSL's 32 MB default cap
+    uint64_t maxmem = 128 * n * r * p + (64u << 20);
+    return EVP_PBE_scrypt(password, strlen(password), salt, VAULT_SALT_SIZE,
+                          n, r, p, maxmem, out, out_len) == 1;
+}
+
+static void make_verifier(const unsigned char *derived, char *hex_out) {
+    unsigned char digest[SHA256_DIGEST_LEN];
+    unsigned int len = 0;
+    EVP_Digest(derived + LYRA_KEY_SIZE, LYRA_KEY_SIZE, digest, &len, EVP_sha256(), NULL);
+    sha256_to_hex(digest, hex_out);
+}
+
+// Write .auth with fresh salt and the cost from lyra.conf
+int vault_auth_write(char *password) {
+    uint64_t n = config_get_long("kdf_n", VAULT_KDF_DEFAULT_N);
+    uint64_t r = config_get_long("kdf_r", VAULT_KDF_DEFAULT_R);
+    uint64_t p = config_get_long("kdf_p", VAULT_KDF_DEFAULT_P);
+
+    if (n < 1024 || (n & (n - 1)) != 0 || r < 1 || p < 1) {
+        printf("✗ Error: Invalid kdf_n/kdf_r/kdf_p in lyra.conf\n");
+        return 0;
+    }
+
+    unsigned char salt[VAULT_SALT_SIZE];
+    unsigned char derived[LYRA_KEY_SIZE * 2];
+    if (RAND_bytes(salt, sizeof(salt)) != 1 ||
+        !scrypt_derive(password, salt, n, r, p, derived, sizeof(derived))) {
+        printf("✗ Error: Key derivation failed\n");
+        return 0;
+    }
+
+    char salt_hex[VAULT_SALT_SIZE * 2 + 1];
+    char verifier_hex[SHA256_HEX_LEN];
+    hex_encode(salt, sizeof(salt), salt_hex);
+    make_verifier(derived, verifier_hex);
+    OPENSSL_cleanse(derived, sizeof(derived));
+
+    cJSON *auth = cJSON_CreateObject();
+    cJSON_AddStringToObject(auth, "kdf", "scrypt");
+    cJSON_AddNumberToObject(auth, "N", (double)n);
+    cJSON_AddNumberToObject(auth, "r", (double)r);
+    cJSON_AddNumberToObject(auth, "p", (double)p);
+    cJSON_AddStringToObject(auth, "salt", salt_hex);
+    cJSON_AddStringToObject(auth, "verifier", verifier_hex);
+
+    char path[512];
+    char tmp_path[600];
+    auth_path(path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    char *json_str = cJSON_Print(auth);
+    cJSON_Delete(auth);
+
+    int ok = 0;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0 && json_str) {
+        size_t len = strlen(json_str);
+        ok = write(fd, json_str, len) == (ssize_t)len && write(fd, "\n", 1) == 1 && fsync(fd) == 0;
+    }
+    if (fd >= 0) close(fd);
+    free(json_str);
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Check the password against .auth and derive the vault key from it.
+// Returns 1 on match. Old djb2 hashes are accepted once and upgraded in place.
+int vault_derive_key(char *password, unsigned char *key_out) {
+    char path[512];
+    auth_path(path, sizeof(path));
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        printf("✗ Error: Vault password not set up\n");
+        return 0;
+    }
+
+    char first[32] = "";
+    size_t got = fread(first, 1, sizeof(first) - 1, fp);
+    first[got] = '\0';
+    fclose(fp);
+
+    if (got > 0 && first[0] >= '0' && first[0] <= '9') {
+        unsigned long stored_hash = strtoul(first, NULL, 10);
+        if (djb2_hash(password) != stored_hash) return 0;
+
+        printf("→ Upgrading vault password hash to scrypt...\n");
+        if (!vault_auth_write(password)) {
+            printf("✗ Error: Could not upgrade vault password hash\n");
+            return 0;
+        }
+    }
+
+    cJSON *auth = json_read_file(path);
+    cJSON *n = cJSON_GetObjectItem(auth, "N");
+    cJSON *r = cJSON_GetObjectItem(auth, "r");
+    cJSON *p = cJSON_GetObjectItem(auth, "p");
+    cJSON *salt_hex = cJSON_GetObjectItem(auth, "salt");
+    cJSON *verifier = cJSON_GetObjectItem(auth, "verifier");
+
+    unsigned char salt[VAULT_SALT_SIZE];
+    unsigned char derived[LYRA_KEY_SIZE * 2];
+    char check_hex[SHA256_HEX_LEN];
+    int ok = 0;
+
+    if (n && r && p && verifier && verifier->valuestring && salt_hex &&
+        hex_decode(salt_hex->valuestring, salt, sizeof(salt)) &&
+        scrypt_derive(password, salt, (uint64_t)n->valuedouble, (uint64_t)r->valuedouble,
+                      (uint64_t)p->valuedouble, derived, sizeof(derived))) {
+        make_verifier(derived, check_hex);
+        if (strlen(verifier->valuestring) == SHA256_HEX_LEN - 1 &&
+            CRYPTO_memcmp(check_hex, verifier->valuestring, SHA256_HEX_LEN - 1) == 0) {
+            memcpy(key_out, derived, LYRA_KEY_SIZE);
+            ok = 1;
+        }
+    }
+
+    OPENSSL_cleanse(derived, sizeof(derived));
+    cJSON_Delete(auth);
+
+    return ok;
+}
+
+// The agent entry is named after the vault salt, so a re-keyed vault never
+// picks up a stale key
+static int agent_description(char *desc_out, size_t size) {
+    char path[512];
+    auth_path(path, sizeof(path));
+
+    cJSON *auth = json_read_file(path);
+    cJSON *salt_hex = cJSON_GetObjectItem(auth, "salt");
+    int ok = salt_hex && salt_hex->valuestring;
+    if (ok) {
+        snprintf(desc_out, size, VAULT_AGENT_PREFIX "%.16s", salt_hex->valuestring);
+    }
+    cJSON_Delete(auth);
+
+    return ok;
+}
+
+static long agent_find() {
+    char desc[64];
+    if (!agent_description(desc, sizeof(desc))) return -1;
+
+    return syscall(SYS_keyctl, KEYCTL_SEARCH, KEY_SPEC_USER_KEYRING, "user", desc, 0);
+}
+
+int vault_agent_get(unsigned char *key_out) {
+    long id = agent_find();
+    if (id < 0) return 0;
+
+    unsigned char buffer[LYRA_KEY_SIZE];
+    long len = syscall(SYS_keyctl, KEYCTL_READ, id, buffer, sizeof(buffer), 0);
+    if (len != LYRA_KEY_SIZE) return 0;
+
+    memcpy(key_out, buffer, LYRA_KEY_SIZE);
+    OPENSSL_cleanse(buffer, sizeof(buffer));
+    return 1;
+}
+
+int vault_agent_put(const unsigned char *key, long ttl_seconds) {
+    char desc[64];
+    if (ttl_seconds <= 0 || !agent_description(desc, sizeof(desc))) return 0;
+
+    long id = syscall(SYS_add_key, "user", desc, key, (size_t)LYRA_KEY_SIZE, KEY_SPEC_USER_KEYRING);
+    if (id < 0) return 0;
+
+    syscall(SYS_keyctl, KEYCTL_SETPERM, id, AGENT_PERM_POSSESSOR_ALL | AGENT_PERM_USER_VIEW | AGENT_PERM_USER_READ);
+    return syscall(SYS_keyctl, KEYCTL_SET_TIMEOUT, id, (unsigned long)ttl_seconds) == 0;
+}
+
+void vault_agent_clear() {
+    long id = agent_find();
+    if (id >= 0) {
+        syscall(SYS_keyctl, KEYCTL_INVALIDATE, id);
+    }
+}
+
+// Get the vault key from the agent, or prompt for the password and derive it.
+// Sets up the vault password first if there isn't one yet.
+int vault_unlock(VaultKey *vk) {
+    memset(vk, 0, sizeof(*vk));
+
+    char path[512];
+    auth_path(path, sizeof(path));
+    if (access(path, F_OK) != 0) {
+        vault_password_setup();
+    }
+
+    long ttl = config_get_long("key_agent_ttl", 0);
+    if (ttl > 0 && vault_agent_get(vk->key)) {
+        return 1;
+    }
+
+    vault_password_prompt(vk->password, 0);
+
+    printf("→ Deriving vault key...\n");
+    if (!vault_derive_key(vk->password, vk->key)) {
+        printf("✗ Incorrect password!\n");
+        vault_key_clear(vk);
+        return 0;
+    }
+
+    if (ttl > 0 && !vault_agent_put(vk->key, ttl)) {
+        printf("Warning: Could not cache vault key in the kernel keyring\n");
+    }
+
+    return 1;
+}
+
+// Whether vault_unlock() would have to read a password from stdin
+int vault_unlock_prompts() {
+    char path[512];
+    auth_path(path, sizeof(path));
+    if (access(path, F_OK) != 0) return 1;
+
+    unsigned char key[LYRA_KEY_SIZE];
+    int cached = config_get_long("key_agent_ttl", 0) > 0 && vault_agent_get(key);
+    OPENSSL_cleanse(key, sizeof(key));
+    return !cached;
+}
+
+void vault_key_clear(VaultKey *vk) {
+    OPENSSL_cleanse(vk, sizeof(*vk));
+}
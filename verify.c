@@ -0,0 +1,458 @@
+#include "lyra.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <pthread.h>
+
+// Integrity log and `lyra verify`
+//
+// ~/.lyra/integrity holds the expected SHA-256 of every file lyra writes:
+// installed files, vault copies, frozen archives and chunks. Each line is
+//   <sha256> <size> <mtime sec>.<nsec> <inode> <path>
+// Writers only append (under a flock), later lines win, and verify rewrites
+// the file compacted. The size/mtime/inode part is a stat cache: a file that
+// still matches it was verified before and isn't re-read unless --full.
+
+typedef struct {
+    char *path;
+    char sha256[SHA256_HEX_LEN];
+    long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+    unsigned long long ino;
+    int used;
+} IntegrityEntry;
+
+typedef struct {
+    IntegrityEntry *table;
+    size_t capacity;
+    size_t count;
+} IntegrityTable;
+
+struct IntegrityLog {
+    int lock_fd;
+    FILE *fp;
+};
+
+static void integrity_path(char *path_out, size_t size) {
+    snprintf(path_out, size, "%s/.lyra/integrity", get_user_home());
+}
+
+static uint64_t path_hash(const char *path) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *path; path++) {
+        h = (h ^ (unsigned char)*path) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static IntegrityEntry *table_slot(IntegrityTable *t, const char *path) {
+    size_t mask = t->capacity - 1;
+    for (size_t i = path_hash(path) & mask;; i = (i + 1) & mask) {
+        IntegrityEntry *slot = &t->table[i];
+        if (!slot->used || strcmp(slot->path, path) == 0) return slot;
+    }
+}
+
+static int table_grow(IntegrityTable *t) {
+    size_t old_capacity = t->capacity;
+    IntegrityEntry *old_table = t->table;
+
+    t->capacity = old_capacity ? old_capacity * 2 : 1024;
+    t->table = calloc(t->capacity, sizeof(IntegrityEntry));
+    if (!t->table) {
+        t->table = old_table;
+        t->capacity = old_capacity;
+        return 0;
+    }
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_table[i].used) *table_slot(t, old_table[i].path) = old_table[i];
+    }
+    free(old_table);
+    return 1;
+}
+
+static IntegrityEntry *table_get(IntegrityTable *t, const char *path, int create) {
+    if (create && (t->count + 1) * 10 >= t->capacity * 7 && !table_grow(t)) return NULL;
+
+    IntegrityEntry *slot = table_slot(t, path);
+    if (slot->used || !create) return slot->used ? slot : NULL;
+
+    slot->path = strdup(path);
+    if (!slot->path) return NULL;
+    slot->used = 1;
+    t->count++;
+    return slot;
+}
+
+static void table_free(IntegrityTable *t) {
+    for (size_t i = 0; i < t->capacity; i++) {
+        if (t->table[i].used) free(t->table[i].path);
+    }
+    free(t->table);
+}
+
+static void stat_into(IntegrityEntry *entry, struct stat *st) {
+    entry->size = st->st_size;
+    entry->mtime_sec = st->st_mtim.tv_sec;
+    entry->mtime_nsec = st->st_mtim.tv_nsec;
+    entry->ino = st->st_ino;
+}
+
+static int stat_matches(IntegrityEntry *entry, struct stat *st) {
+    return entry->size == st->st_size && entry->mtime_sec == st->st_mtim.tv_sec &&
+           entry->mtime_nsec == st->st_mtim.tv_nsec && entry->ino == st->st_ino;
+}
+
+static int same_record(IntegrityEntry *a, IntegrityEntry *b) {
+    return strcmp(a->sha256, b->sha256) == 0 && a->size == b->size && a->mtime_sec == b->mtime_sec &&
+           a->mtime_nsec == b->mtime_nsec && a->ino == b->ino;
+}
+
+static void table_load(IntegrityTable *t) {
+    char path[512];
+    integrity_path(path, sizeof(path));
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+
+        IntegrityEntry parsed;
+        int offset = 0;
+        if (sscanf(line, "%64s %lld %lld.%ld %llu %n", parsed.sha256, &parsed.size,
+                   &parsed.mtime_sec, &parsed.mtime_nsec, &parsed.ino, &offset) != 5 || offset == 0) {
+            continue;
+        }
+
+        IntegrityEntry *entry = table_get(t, line + offset, 1);
+        if (!entry) break;
+        memcpy(entry->sha256, parsed.sha256, SHA256_HEX_LEN);
+        entry->size = parsed.size;
+        entry->mtime_sec = parsed.mtime_sec;
+        entry->mtime_nsec = parsed.mtime_nsec;
+        entry->ino = parsed.ino;
+    }
+    fclose(fp);
+}
+
+static void write_entry(FILE *fp, IntegrityEntry *entry) {
+    fprintf(fp, "%s %lld %lld.%09ld %llu %s\n", entry->sha256, entry->size,
+            entry->mtime_sec, entry->mtime_nsec, entry->ino, entry->path);
+}
+
+IntegrityLog *integrity_log_open() {
+    char path[512];
+    integrity_path(path, sizeof(path));
+
+    IntegrityLog *log = calloc(1, sizeof(IntegrityLog));
+    if (!log) return NULL;
+
+    log->lock_fd = catalog_lock(path);
+    log->fp = fopen(path, "a");
+    if (!log->fp) {
+        catalog_unlock(log->lock_fd);
+        free(log);
+        return NULL;
+    }
+    return log;
+}
+
+// Record path's expected hash; NULL sha256_hex hashes the file as it is now
+void integrity_log_add(IntegrityLog *log, char *path, char *sha256_hex) {
+    struct stat st;
+    if (!log || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return;
+
+    IntegrityEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.path = path;
+    stat_into(&entry, &st);
+
+    if (sha256_hex) {
+        snprintf(entry.sha256, sizeof(entry.sha256), "%s", sha256_hex);
+    } else if (!sha256_file(path, entry.sha256)) {
+        return;
+    }
+
+    write_entry(log->fp, &entry);
+}
+
+void integrity_log_close(IntegrityLog *log) {
+    if (!log) return;
+    fflush(log->fp);
+    fclose(log->fp);
+    catalog_unlock(log->lock_fd);
+    free(log);
+}
+
+void integrity_record(char *path, char *sha256_hex) {
+    IntegrityLog *log = integrity_log_open();
+    integrity_log_add(log, path, sha256_hex);
+    integrity_log_close(log);
+}
+
+// Everything verify looks at
+
+enum { VERIFY_OK, VERIFY_CACHED, VERIFY_NEW, VERIFY_CORRUPT, VERIFY_MISSING, VERIFY_UNREADABLE };
+
+typedef struct {
+    char path[1024];
+    char expected[SHA256_HEX_LEN];
+    char actual[SHA256_HEX_LEN];
+    int known;
+    int full;
+    IntegrityEntry cached;
+    struct stat st;
+    int status;
+} VerifyTask;
+
+typedef struct {
+    VerifyTask *tasks;
+    int count;
+    int capacity;
+} VerifyList;
+
+static void verify_add(VerifyList *list, const char *path) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        VerifyTask *grown = realloc(list->tasks, capacity * sizeof(VerifyTask));
+        if (!grown) return;
+        list->tasks = grown;
+        list->capacity = capacity;
+    }
+
+    VerifyTask *task = &list->tasks[list->count++];
+    memset(task, 0, sizeof(*task));
+    snprintf(task->path, sizeof(task->path), "%s", path);
+}
+
+static void collect_vault(VerifyList *list) {
+    char vault_dir[512];
+    snprintf(vault_dir, sizeof(vault_dir), "%s/.lyra/vault", get_user_home());
+
+    DIR *dir = opendir(vault_dir);
+    if (!dir) return;
+
+    struct dirent *pkg;
+    while ((pkg = readdir(dir)) != NULL) {
+        if (pkg->d_name[0] == '.') continue;
+        if (strcmp(pkg->d_name, "frozen") == 0 || strcmp(pkg->d_name, "snapshots") == 0) continue;
+
+        char pkg_dir[1024];
+        snprintf(pkg_dir, sizeof(pkg_dir), "%s/%s", vault_dir, pkg->d_name);
+        DIR *versions = opendir(pkg_dir);
+        if (!versions) continue;
+
+        struct dirent *ver;
+        while ((ver = readdir(versions)) != NULL) {
+            if (ver->d_name[0] == '.') continue;
+
+            // An empty version dir means a lost copy
+            char file_path[1024];
+            if (!vault_copy_path(pkg->d_name, ver->d_name, file_path, sizeof(file_path))) {
+                snprintf(file_path, sizeof(file_path), "%s/%s/%s", pkg_dir, ver->d_name, pkg->d_name);
+            }
+            verify_add(list, file_path);
+        }
+        closedir(versions);
+    }
+    closedir(dir);
+}
+
+static void collect_frozen(VerifyList *list) {
+    char *home = get_user_home();
+    cJSON *catalog = frozen_catalog_load();
+
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(catalog, "copies")) {
+        cJSON *package = cJSON_GetObjectItem(item, "package");
+        cJSON *version = cJSON_GetObjectItem(item, "version");
+        cJSON *file = cJSON_GetObjectItem(item, "file");
+        if (!package || !version || !file || !file->valuestring) continue;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/.lyra/vault/frozen/%s/%s/%s",
+                 home, package->valuestring, version->valuestring, file->valuestring);
+        verify_add(list, path);
+    }
+
+    cJSON_Delete(catalog);
+}
+
+static void collect_chunk(char *path, void *ctx) {
+    verify_add(ctx, path);
+}
+
+static void verify_task(void *arg) {
+    VerifyTask *task = arg;
+
+    if (stat(task->path, &task->st) != 0) {
+        task->status = VERIFY_MISSING;
+        return;
+    }
+
+    if (task->known && !task->full && stat_matches(&task->cached, &task->st)) {
+        task->status = VERIFY_CACHED;
+        return;
+    }
+
+    if (!sha256_file(task->path, task->actual)) {
+        task->status = VERIFY_UNREADABLE;
+        return;
+    }
+
+    if (!task->known) {
+        task->status = VERIFY_NEW;
+    } else {
+        task->status = strcmp(task->actual, task->expected) == 0 ? VERIFY_OK : VERIFY_CORRUPT;
+    }
+}
+
+// Check every file lyra manages against the integrity log. Returns the
+// number of problems found.
+int verify_all(int full) {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    VerifyList list = { 0 };
+
+    // Every installed file, plus vault copies of muted versions whose directory is gone
+    char *home = get_user_home();
+    cJSON *root = db_read();
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, root) {
+        char path[1024];
+        cJSON *files = manifest_files(pkg, pkg->string);
+        cJSON *file = NULL;
+        cJSON_ArrayForEach(file, files) {
+            cJSON *file_path = cJSON_GetObjectItem(file, "path");
+            if (cJSON_IsString(file_path)) verify_add(&list, file_path->valuestring);
+        }
+        cJSON_Delete(files);
+
+        cJSON *muted = NULL;
+        cJSON_ArrayForEach(muted, cJSON_GetObjectItem(pkg, "versions")) {
+            cJSON *version = cJSON_GetObjectItem(muted, "version");
+            if (!version || !version->valuestring) continue;
+
+            snprintf(path, sizeof(path), "%s/.lyra/vault/%s/%s", home, pkg->string, version->valuestring);
+            if (access(path, F_OK) == 0) continue;  // picked up by collect_vault
+            snprintf(path, sizeof(path), "%s/.lyra/vault/%s/%s/%s",
+                     home, pkg->string, version->valuestring, pkg->string);
+            verify_add(&list, path);
+        }
+    }
+    cJSON_Delete(root);
+
+    collect_vault(&list);
+    collect_frozen(&list);
+    chunk_store_each_file(collect_chunk, &list);
+
+    IntegrityTable table = { 0 };
+    if (!table_grow(&table)) {
+        free(list.tasks);
+        return 1;
+    }
+    table_load(&table);
+
+    for (int i = 0; i < list.count; i++) {
+        IntegrityEntry *entry = table_get(&table, list.tasks[i].path, 0);
+        list.tasks[i].full = full;
+        if (entry) {
+            list.tasks[i].known = 1;
+            list.tasks[i].cached = *entry;
+            list.tasks[i].cached.path = NULL;
+            memcpy(list.tasks[i].expected, entry->sha256, SHA256_HEX_LEN);
+        }
+    }
+    table_free(&table);
+
+    printf("→ Verifying %d files...\n", list.count);
+    pool_run(verify_task, list.tasks, sizeof(VerifyTask), list.count, 0);
+
+    int counts[VERIFY_UNREADABLE + 1] = { 0 };
+    int hashed = 0;
+    for (int i = 0; i < list.count; i++) {
+        VerifyTask *task = &list.tasks[i];
+        counts[task->status]++;
+        if (task->status != VERIFY_CACHED && task->status != VERIFY_MISSING) hashed++;
+
+        if (task->status == VERIFY_CORRUPT) {
+            printf("  ✗ CORRUPT  %s\n", task->path);
+            printf("             expected %.16s…, found %.16s…\n", task->expected, task->actual);
+        } else if (task->status == VERIFY_MISSING) {
+            printf("  ✗ MISSING  %s\n", task->path);
+        } else if (task->status == VERIFY_UNREADABLE) {
+            printf("  ✗ UNREADABLE  %s\n", task->path);
+        }
+    }
+
+    // Rewrite the log: refreshed stat cache for files that checked out, new
+    // baselines, and nothing for files lyra no longer tracks. Lines appended
+    // since we loaded are folded in too.
+    char log_path[512];
+    char tmp_path[600];
+    integrity_path(log_path, sizeof(log_path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", log_path, (int)getpid());
+
+    int lock_fd = catalog_lock(log_path);
+    IntegrityTable latest = { 0 };
+    table_grow(&latest);
+    table_load(&latest);
+
+    FILE *fp = fopen(tmp_path, "w");
+    int ok = fp != NULL;
+    for (int i = 0; ok && i < list.count; i++) {
+        VerifyTask *task = &list.tasks[i];
+        IntegrityEntry *entry = table_get(&latest, task->path, 0);
+
+        IntegrityEntry out;
+        memset(&out, 0, sizeof(out));
+        out.path = task->path;
+
+        if (entry && (!task->known || !same_record(entry, &task->cached))) {
+            out = *entry;  // re-recorded while we were hashing; that wins
+        } else if (task->status == VERIFY_OK || task->status == VERIFY_NEW) {
+            memcpy(out.sha256, task->actual, SHA256_HEX_LEN);
+            stat_into(&out, &task->st);
+        } else if (entry) {
+            out = *entry;  // cached, corrupt or missing: keep what was expected
+        } else {
+            continue;
+        }
+
+        write_entry(fp, &out);
+    }
+    if (fp) {
+        ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0 && ok;
+        fclose(fp);
+    }
+    if (!ok || rename(tmp_path, log_path) != 0) {
+        remove(tmp_path);
+        printf("Warning: Could not update %s\n", log_path);
+    }
+    catalog_unlock(lock_fd);
+    table_free(&latest);
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double elapsed = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+    int problems = counts[VERIFY_CORRUPT] + counts[VERIFY_MISSING] + counts[VERIFY_UNREADABLE];
+    metrics_gauge("lyra_verify_problems", NULL, problems);
+    metrics_gauge("lyra_verify_last_run_timestamp_seconds", NULL, (double)time(NULL));
+
+    printf("\n━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Checked: %d  Re-hashed: %d  Unchanged: %d  New: %d\n",
+           list.count, hashed, counts[VERIFY_CACHED], counts[VERIFY_NEW]);
+    printf("Corrupt: %d  Missing: %d  Unreadable: %d  (%.2fs)\n",
+           counts[VERIFY_CORRUPT], counts[VERIFY_MISSING], counts[VERIFY_UNREADABLE], elapsed);
+    if (problems == 0) {
+        printf("✓ Everything matches\n");
+    }
+
+    free(list.tasks);
+    return problems;
+}